@@ -0,0 +1,29 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+// Runs the function several times, prints the best time, and returns it in milliseconds.
+template <typename Func>
+double linq_measure(std::string_view name, Func&& func, int times = 5)
+{
+    using clock = std::chrono::steady_clock;
+    clock::duration best = clock::duration::max();
+    for (int i = 0; i < times; i++)
+    {
+        auto start = clock::now();
+        func();
+        best = (std::min)(best, clock::now() - start);
+    }
+    double ms = std::chrono::duration_cast<std::chrono::microseconds>(best).count() / 1000.0;
+    std::cout << name << ": " << ms << " ms" << std::endl;
+    return ms;
+}
+
+// Gets the element count from the first argument, or the default.
+inline std::size_t linq_benchmark_size(int argc, char** argv, std::size_t def)
+{
+    return argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : def;
+}
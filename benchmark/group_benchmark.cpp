@@ -0,0 +1,28 @@
+#include "benchmark_utility.hpp"
+#include <linq/aggregate.hpp>
+#include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace linq;
+
+int main(int argc, char** argv)
+{
+    size_t size = linq_benchmark_size(argc, argv, 5000000);
+    mt19937_64 gen{ 42 };
+    uniform_int_distribution<int> key{ 0, 99999 };
+    vector<pair<int, double>> rows;
+    rows.reserve(size);
+    for (size_t i = 0; i < size; i++)
+        rows.emplace_back(key(gen), static_cast<double>(i));
+
+    cout << "Grouping " << size << " elements." << endl;
+    auto keysel{ [](const pair<int, double>& r) { return r.first; } };
+    auto elesel{ [](const pair<int, double>& r) { return r.second; } };
+    auto rstsel{ [](int key, auto e) { return pair{ key, e >> sum() }; } };
+    linq_measure("group", [&] { rows >> group(keysel, elesel, rstsel) >> count(); });
+    linq_measure("hash_group", [&] { rows >> hash_group(keysel, elesel, rstsel) >> count(); });
+    linq_measure("group_aggregate", [&] { rows >> group_aggregate(keysel, 0.0, [](double& s, const pair<int, double>& r) { s += r.second; }) >> count(); });
+}
@@ -0,0 +1,88 @@
+#include "benchmark_utility.hpp"
+#include <algorithm>
+#include <linq/aggregate.hpp>
+#include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace linq;
+
+int main(int argc, char** argv)
+{
+    size_t size = linq_benchmark_size(argc, argv, 1000000);
+    mt19937_64 gen{ 42 };
+    uniform_int_distribution<int> key{ 0, static_cast<int>(size) - 1 };
+    vector<pair<int, double>> outer, inner, small;
+    outer.reserve(size);
+    inner.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        outer.emplace_back(key(gen), static_cast<double>(i));
+        inner.emplace_back(key(gen), static_cast<double>(i));
+    }
+    for (size_t i = 0; i < size / 1000; i++)
+        small.emplace_back(key(gen), static_cast<double>(i));
+
+    cout << "Joining " << size << " elements." << endl;
+    auto keysel{ [](const pair<int, double>& r) { return r.first; } };
+    auto elesel{ [](const pair<int, double>& r) { return r.second; } };
+    auto rstsel{ [](const pair<int, double>& r, double e) { return r.second + e; } };
+    linq_measure("ordered join", [&] {
+        auto e{ outer >> join<std::less<>>(inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+    linq_measure("hash join", [&] {
+        auto e{ outer >> join(inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+    linq_measure("ordered join, small outer", [&] {
+        auto e{ small >> join<std::less<>>(inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+    linq_measure("hash join, small outer", [&] {
+        auto e{ small >> join(inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+
+    auto inner_lookup{ inner >> to_lookup(keysel, elesel) };
+    linq_measure("prebuilt lookup join, small outer", [&] {
+        auto e{ small >> join(inner_lookup, keysel, rstsel) };
+        e >> count();
+    });
+
+    auto sorted_outer{ outer }, sorted_inner{ inner };
+    std::sort(sorted_outer.begin(), sorted_outer.end());
+    std::sort(sorted_inner.begin(), sorted_inner.end());
+    linq_measure("hash join, sorted", [&] {
+        auto e{ sorted_outer >> join(sorted_inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+    linq_measure("merge join, sorted", [&] {
+        auto e{ sorted_outer >> merge_join(sorted_inner, keysel, keysel, elesel, rstsel) };
+        e >> count();
+    });
+
+    // The throughput of probing, as the inner table grows out of the cache.
+    size_t max_inner = linq_benchmark_size(argc - 1, argv + 1, 8 << 20);
+    for (size_t inner_size = 16 << 10; inner_size <= max_inner; inner_size *= 8)
+    {
+        uniform_int_distribution<int> inner_key{ 0, static_cast<int>(inner_size) - 1 };
+        vector<pair<int, double>> probe, table;
+        probe.reserve(size);
+        table.reserve(inner_size);
+        for (size_t i = 0; i < size; i++)
+            probe.emplace_back(inner_key(gen), static_cast<double>(i));
+        for (size_t i = 0; i < inner_size; i++)
+            table.emplace_back(static_cast<int>(i), static_cast<double>(i));
+        cout << "Probing " << size << " elements into " << inner_size << " elements." << endl;
+        double hash_ms = linq_measure("hash join", [&] {
+            auto e{ probe >> join(table, keysel, keysel, elesel, rstsel) };
+            e >> count();
+        });
+        double partitioned_ms = linq_measure("partitioned join", [&] { probe >> partitioned_join(table, keysel, keysel, elesel, rstsel); });
+        double parallel_ms = linq_measure("parallel partitioned join", [&] { probe >> parallel() >> partitioned_join(table, keysel, keysel, elesel, rstsel); });
+        cout << "Throughput (M rows/s): hash " << size / hash_ms / 1000 << ", partitioned " << size / partitioned_ms / 1000 << ", parallel partitioned " << size / parallel_ms / 1000 << endl;
+    }
+}
@@ -0,0 +1,62 @@
+#include "benchmark_utility.hpp"
+#include <algorithm>
+#include <linq/aggregate.hpp>
+#include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+using namespace linq;
+
+int main(int argc, char** argv)
+{
+    size_t size = linq_benchmark_size(argc, argv, 1000000);
+    mt19937_64 gen{ 42 };
+    uniform_int_distribution<int> key{ 0, static_cast<int>(size / 10) };
+    vector<int> ints1, ints2;
+    vector<string> strings1, strings2;
+    for (size_t i = 0; i < size; i++)
+    {
+        ints1.push_back(key(gen));
+        ints2.push_back(key(gen));
+        strings1.push_back("item-" + to_string(ints1.back()));
+        strings2.push_back("item-" + to_string(ints2.back()));
+    }
+    vector<string_view> views1(strings1.begin(), strings1.end());
+
+    // The results are kept, so that the queries are not optimized out.
+    volatile size_t sink{};
+    cout << "Set operations on " << size << " elements." << endl;
+    linq_measure("distinct ints", [&] { sink = ints1 >> distinct() >> count(); });
+    linq_measure("hash_distinct ints", [&] { sink = ints1 >> hash_distinct() >> count(); });
+    linq_measure("distinct strings", [&] { sink = strings1 >> distinct() >> count(); });
+    linq_measure("hash_distinct strings", [&] { sink = strings1 >> hash_distinct() >> count(); });
+    linq_measure("union_set strings", [&] { sink = strings1 >> union_set(strings2) >> count(); });
+    linq_measure("hash_union_set strings", [&] { sink = strings1 >> hash_union_set(strings2) >> count(); });
+    linq_measure("intersect strings", [&] { sink = strings1 >> intersect(strings2) >> count(); });
+    linq_measure("hash_intersect strings", [&] { sink = strings1 >> hash_intersect(strings2) >> count(); });
+    linq_measure("hash_intersect string_views", [&] { sink = views1 >> hash_intersect(strings2) >> count(); });
+    linq_measure("except strings", [&] { sink = strings1 >> except(strings2) >> count(); });
+    linq_measure("hash_except strings", [&] { sink = strings1 >> hash_except(strings2) >> count(); });
+
+    std::sort(strings1.begin(), strings1.end());
+    std::sort(strings2.begin(), strings2.end());
+    linq_measure("distinct sorted strings", [&] { sink = strings1 >> distinct() >> count(); });
+    linq_measure("distinct_sorted strings", [&] { sink = strings1 >> distinct_sorted() >> count(); });
+    linq_measure("union_set sorted strings", [&] { sink = strings1 >> union_set(strings2) >> count(); });
+    linq_measure("union_sorted strings", [&] { sink = strings1 >> union_sorted(strings2) >> count(); });
+    linq_measure("intersect sorted strings", [&] { sink = strings1 >> intersect(strings2) >> count(); });
+    linq_measure("intersect_sorted strings", [&] { sink = strings1 >> intersect_sorted(strings2) >> count(); });
+    linq_measure("except sorted strings", [&] { sink = strings1 >> except(strings2) >> count(); });
+    linq_measure("except_sorted strings", [&] { sink = strings1 >> except_sorted(strings2) >> count(); });
+    linq_measure("concat and sort strings", [&] {
+        vector<string> v{ strings1 };
+        v.insert(v.end(), strings2.begin(), strings2.end());
+        std::sort(v.begin(), v.end());
+        sink = v.size();
+    });
+    linq_measure("merge_sorted strings", [&] { sink = (strings1 >> merge_sorted(strings2) >> to_vector<string>()).size(); });
+}
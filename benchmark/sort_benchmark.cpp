@@ -0,0 +1,59 @@
+#include "benchmark_utility.hpp"
+#include <linq/aggregate.hpp>
+#include <linq/parallel.hpp>
+#include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace linq;
+
+struct sort_benchmark_row
+{
+    int group;
+    double score;
+    string name;
+};
+
+int main(int argc, char** argv)
+{
+    size_t size = linq_benchmark_size(argc, argv, 5000000);
+    mt19937_64 gen{ 42 };
+    uniform_int_distribution<int> group{ 0, 999 };
+    uniform_real_distribution<double> score{ 0.0, 100.0 };
+    vector<sort_benchmark_row> rows;
+    rows.reserve(size);
+    for (size_t i = 0; i < size; i++)
+        rows.push_back({ group(gen), score(gen), to_string(i) });
+    vector<int> ints{ rows >> select([](const sort_benchmark_row& r) { return r.group * 100000 + static_cast<int>(r.score * 1000); }) >> to_vector<int>() };
+
+    cout << "Sorting " << size << " elements with " << impl::default_thread_count() << " threads." << endl;
+    linq_measure("int std::sort", [&] {
+        auto v{ ints };
+        std::sort(v.begin(), v.end());
+    });
+    linq_measure("int sort", [&] { ints >> sort(); });
+    linq_measure("int parallel sort", [&] { ints >> parallel() >> sort(); });
+    auto by_group{ make_comparer([](const sort_benchmark_row& r) { return r.group; }) };
+    auto by_score{ make_comparer([](const sort_benchmark_row& r) { return r.score; }, descending{}) };
+    auto by_score_lambda{ [](const sort_benchmark_row& a, const sort_benchmark_row& b) { return (a.score < b.score) - (a.score > b.score); } };
+    linq_measure("row sort by score with a lambda", [&] { rows >> sort(by_score_lambda); });
+    linq_measure("row sort by score", [&] { rows >> sort(by_score); });
+    auto by_name{ make_comparer([](const sort_benchmark_row& r) -> const string& { return r.name; }, string_ascending<char>{}) };
+    auto by_name_lambda{ [](const sort_benchmark_row& a, const sort_benchmark_row& b) { return a.name.compare(b.name); } };
+    linq_measure("row sort by name with a lambda", [&] { rows >> sort(by_name_lambda); });
+    linq_measure("row sort by name", [&] { rows >> sort(by_name); });
+    auto label{ [](const sort_benchmark_row& r) { return to_string(r.group) + "-" + r.name; } };
+    auto by_label_lambda{ [&](const sort_benchmark_row& a, const sort_benchmark_row& b) { return label(a).compare(label(b)); } };
+    linq_measure("row sort by label with a lambda", [&] { rows >> sort(by_group, by_label_lambda); });
+    linq_measure("row sort by cached label", [&] { rows >> sort(by_group, make_comparer(label, string_ascending<char>{})); });
+    linq_measure("row sort", [&] { rows >> sort(by_group, by_score); });
+    linq_measure("row parallel sort", [&] { rows >> parallel() >> sort(by_group, by_score); });
+    linq_measure("row stable sort", [&] { rows >> stable_sort(by_group); });
+    linq_measure("row parallel stable sort", [&] { rows >> parallel() >> stable_sort(by_group); });
+    linq_measure("row sort and take 100", [&] { rows >> sort(by_score) >> take(100) >> to_vector<sort_benchmark_row>(); });
+    linq_measure("row top 100", [&] { rows >> (sort(by_score) >> take(100)); });
+    linq_measure("row order_by and take 100", [&] { rows >> order_by(by_score) >> take(100) >> to_vector<sort_benchmark_row>(); });
+}
@@ -27,10 +27,22 @@
 #define LINQ_AGGREGATE_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <linq/core.hpp>
+#include <linq/hash.hpp>
+#include <linq/parallel.hpp>
+#include <linq/query.hpp>
 #include <map>
+#include <mutex>
 #include <set>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace linq
@@ -39,26 +51,32 @@ namespace linq
     template <typename Action>
     constexpr auto for_each(Action&& action)
     {
-        return [&](auto&& container) {
-            for (auto& item : container)
-                action(item);
-            return container;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& action) {
+                impl::push_each(container, [&](auto&& item) {
+                    action(item);
+                    return true;
+                });
+                return container;
+            },
+            std::forward<Action>(action));
     }
 
     // Applies an action to each element and return the enumerable.
     template <typename Action>
     constexpr auto for_each_index(Action&& action)
     {
-        return [&](auto&& container) {
-            std::size_t i = 0;
-            for (auto& item : container)
-            {
-                action(item, i);
-                i++;
-            }
-            return container;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& action) {
+                std::size_t i = 0;
+                impl::push_each(container, [&](auto&& item) {
+                    action(item, i);
+                    i++;
+                    return true;
+                });
+                return container;
+            },
+            std::forward<Action>(action));
     }
 
     namespace impl
@@ -83,7 +101,7 @@ namespace linq
             using traits_type = std::iterator_traits<It>;
 
             peek_iterator_impl(It begin, It end, Action&& action)
-                : m_begin(begin), m_end(end), m_action(std::forward<Action>(action)) { set_result(); }
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_action(std::forward<Action>(action)) { set_result(); }
 
             typename traits_type::reference value()
             {
@@ -108,11 +126,13 @@ namespace linq
     template <typename Action>
     constexpr auto peek(Action&& action)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::peek_iterator<It, Action>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Action>(action) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& action) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::peek_iterator<It, decltype(action)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(action)>(action) }, impl::fixed_size(container) };
+            },
+            std::forward<Action>(action));
     }
 
     namespace impl
@@ -138,7 +158,7 @@ namespace linq
             using traits_type = std::iterator_traits<It>;
 
             peek_index_iterator_impl(It begin, It end, Action&& action)
-                : m_begin(begin), m_end(end), m_action(std::forward<Action>(action)) { set_result(); }
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_action(std::forward<Action>(action)) { set_result(); }
 
             typename traits_type::reference value()
             {
@@ -163,11 +183,13 @@ namespace linq
     template <typename Action>
     constexpr auto peek_index(Action&& action)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::peek_index_iterator<It, Action>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Action>(action) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& action) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::peek_index_iterator<It, decltype(action)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(action)>(action) }, impl::fixed_size(container) };
+            },
+            std::forward<Action>(action));
     }
 
     // Always returns true.
@@ -185,121 +207,187 @@ namespace linq
     template <typename Pred = always_true>
     constexpr auto count(Pred&& pred = {})
     {
-        return [&](auto&& container) {
-            std::size_t result{ 0 };
-            for (auto& item : container)
-            {
-                if (pred(item))
-                    ++result;
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                if constexpr (std::is_same_v<std::decay_t<decltype(pred)>, always_true>)
+                {
+                    if (auto size = impl::known_size(container))
+                        return *size;
+                }
+                return impl::reduce(
+                    container, std::size_t{ 0 },
+                    [&](std::size_t& result, auto&& item) {
+                        if (pred(item))
+                            ++result;
+                    },
+                    std::plus<std::size_t>{});
+            },
+            std::forward<Pred>(pred));
     }
 
     // Determines whether all elements satisfy a condition.
     template <typename Pred>
     constexpr auto all(Pred&& pred)
     {
-        return [&](auto&& container) {
-            for (auto& item : container)
-            {
-                if (!pred(item))
-                    return false;
-            }
-            return true;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                return impl::reduce(
+                    container, true, [&](bool& result, auto&& item) { return result = static_cast<bool>(pred(item)); }, std::logical_and<bool>{});
+            },
+            std::forward<Pred>(pred));
     }
 
     // Determines if any elements satisfy a condition.
     template <typename Pred = always_true>
     constexpr auto any(Pred&& pred = {})
     {
-        return [&](auto&& container) {
-            for (auto& item : container)
-            {
-                if (pred(item))
-                    return true;
-            }
-            return false;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                return impl::reduce(
+                    container, false, [&](bool& result, auto&& item) { return !(result = static_cast<bool>(pred(item))); }, std::logical_or<bool>{});
+            },
+            std::forward<Pred>(pred));
     }
 
     constexpr auto empty()
     {
-        return [](auto&& container) {
-            auto begin = std::begin(container);
-            auto end = std::end(container);
-            return begin == end;
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                auto begin = std::begin(container);
+                auto end = std::end(container);
+                return begin == end;
+            });
     }
 
     template <typename T, typename Comparer = std::equal_to<void>>
     constexpr auto contains(T&& value, Comparer&& comparer = {})
     {
-        return any([&](auto&& a) { return std::forward<Comparer>(comparer)(a, value); });
+        return impl::make_query(
+            [](auto&& container, auto&& value, auto&& comparer) {
+                return any([&](auto&& a) { return comparer(a, value); })(container);
+            },
+            std::forward<T>(value), std::forward<Comparer>(comparer));
     }
 
     // Applies an accumulator function over an enumerable.
     template <typename T, typename Func>
     constexpr auto aggregate(T&& seed, Func&& func)
     {
-        return [&](auto&& container) {
-            T result{ seed };
-            for (auto& item : container)
-            {
-                result = func(result, item);
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& seed, auto&& func) {
+                std::decay_t<T> result{ seed };
+                impl::push_each(container, [&](auto&& item) {
+                    result = func(result, item);
+                    return true;
+                });
+                return result;
+            },
+            std::forward<T>(seed), std::forward<Func>(func));
+    }
+
+    // Applies an accumulator function over an enumerable.
+    // When it runs by chunks, each chunk starts from the seed, and the partial results are combined in order,
+    // so the seed should be the identity of the combiner.
+    template <typename T, typename Func, typename Combine>
+    constexpr auto aggregate(T&& seed, Func&& func, Combine&& combine)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& seed, auto&& func, auto&& combine) {
+                return impl::reduce(
+                    container, std::decay_t<T>{ seed }, [&](std::decay_t<T>& result, auto&& item) { result = func(result, item); }, combine);
+            },
+            std::forward<T>(seed), std::forward<Func>(func), std::forward<Combine>(combine));
+    }
+
+    // Reduces the elements into a result. Each partial result starts from the identity,
+    // and fold(result, item) updates it in place. The fold could return false once the whole result is decided.
+    // When it runs by chunks, the partial results are combined in order by combine(result1, result2).
+    template <typename T, typename Fold, typename Combine>
+    constexpr auto reduce(T&& identity, Fold&& fold, Combine&& combine)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& identity, auto&& fold, auto&& combine) {
+                return impl::reduce(container, std::decay_t<T>{ identity }, fold, combine);
+            },
+            std::forward<T>(identity), std::forward<Fold>(fold), std::forward<Combine>(combine));
     }
 
     // Returns the first element that satisfies a condition or a default value if no such element is found.
     template <typename Pred = always_true, typename T>
     constexpr auto front(Pred&& pred = {}, T&& def = {})
     {
-        return [&](auto&& container) {
-            for (auto& item : container)
-            {
-                if (pred(item)) return item;
-            }
-            return std::forward<T>(def);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred, auto&& def) {
+                std::optional<std::decay_t<T>> result{};
+                impl::push_each(container, [&](auto&& item) {
+                    if (!pred(item)) return true;
+                    result.emplace(std::forward<decltype(item)>(item));
+                    return false;
+                });
+                if (result)
+                    return std::move(*result);
+                else
+                    return std::decay_t<T>{ std::forward<decltype(def)>(def) };
+            },
+            std::forward<Pred>(pred), std::forward<T>(def));
     }
 
     // Returns the first element that satisfies a specified condition.
     template <typename Pred = always_true>
     constexpr auto front(Pred&& pred = {})
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return front<Pred, T>(std::forward<Pred>(pred))(container);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                return front<decltype(pred), T>(std::forward<decltype(pred)>(pred))(container);
+            },
+            std::forward<Pred>(pred));
     }
 
     // Returns the last element that satisfies a condition or a default value if no such element is found.
     template <typename Pred = always_true, typename T>
     constexpr auto back(Pred&& pred = {}, T&& def = {})
     {
-        return [&](auto&& container) {
-            T result{ std::forward<T>(def) };
-            for (auto& item : container)
-            {
-                if (pred(item)) result = item;
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred, auto&& def) {
+                using It = decltype(std::begin(container));
+                if constexpr (impl::is_iterator_category_v<It, std::bidirectional_iterator_tag>)
+                {
+                    // Search from the end.
+                    auto begin = std::begin(container);
+                    auto end = std::end(container);
+                    while (begin != end)
+                    {
+                        --end;
+                        if (pred(*end)) return std::decay_t<T>{ *end };
+                    }
+                    return std::decay_t<T>{ std::forward<decltype(def)>(def) };
+                }
+                else
+                {
+                    std::decay_t<T> result{ std::forward<decltype(def)>(def) };
+                    impl::push_each(container, [&](auto&& item) {
+                        if (pred(item)) result = item;
+                        return true;
+                    });
+                    return result;
+                }
+            },
+            std::forward<Pred>(pred), std::forward<T>(def));
     }
 
     // Returns the last element that satisfies a specified condition.
     template <typename Pred = always_true>
     constexpr auto back(Pred&& pred = {})
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return back<Pred, T>(std::forward<Pred>(pred))(container);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                return back<decltype(pred), T>(std::forward<decltype(pred)>(pred))(container);
+            },
+            std::forward<Pred>(pred));
     }
 
     struct more_than_one : std::logic_error
@@ -312,26 +400,28 @@ namespace linq
     template <typename Pred = always_true, typename T>
     constexpr auto single(Pred&& pred = {}, T&& def = {})
     {
-        return [&](auto&& container) {
-            T result{ std::forward<T>(def) };
-            std::size_t num{ 0 };
-            for (auto& item : container)
-            {
-                if (pred(item))
+        return impl::make_query(
+            [](auto&& container, auto&& pred, auto&& def) {
+                std::decay_t<T> result{ std::forward<decltype(def)>(def) };
+                std::size_t num{ 0 };
+                impl::push_each(container, [&](auto&& item) {
+                    if (pred(item))
+                    {
+                        result = item;
+                        ++num;
+                    }
+                    return true;
+                });
+                switch (num)
                 {
-                    result = item;
-                    ++num;
+                case 0:
+                case 1:
+                    return result;
+                default:
+                    throw more_than_one{};
                 }
-            }
-            switch (num)
-            {
-            case 0:
-            case 1:
-                return result;
-            default:
-                throw more_than_one{};
-            }
-        };
+            },
+            std::forward<Pred>(pred), std::forward<T>(def));
     }
 
     // Returns the only element that satisfies a specified condition or a default value if no such element exists;
@@ -339,11 +429,13 @@ namespace linq
     template <typename Pred = always_true>
     constexpr auto single(Pred&& pred = {})
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return single<Pred, T>(std::forward<Pred>(pred))(container);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                return single<decltype(pred), T>(std::forward<decltype(pred)>(pred))(container);
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -356,12 +448,12 @@ namespace linq
             std::optional<T> m_def;
 
         public:
-            using traits_type = iterator_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>>;
+            using traits_type = common_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>, const T&, typename std::iterator_traits<It>::reference>;
 
-            default_if_empty_iterator_impl(It begin, It end, T&& t) : m_begin(begin), m_end(end)
+            default_if_empty_iterator_impl(It begin, It end, T t) : m_begin(std::move(begin)), m_end(std::move(end))
             {
                 if (m_begin == m_end)
-                    m_def.emplace(std::forward<T>(t));
+                    m_def.emplace(std::move(t));
             }
 
             typename traits_type::reference value() const { return m_begin != m_end ? *m_begin : *m_def; }
@@ -379,49 +471,72 @@ namespace linq
 
         template <typename It, typename T>
         using default_if_empty_iterator = iterator_base<default_if_empty_iterator_impl<It, T>>;
+
+        // An empty enumerable is replaced by a singleton.
+        constexpr std::optional<std::size_t> default_if_empty_size(std::optional<std::size_t> size)
+        {
+            if (size && *size == 0)
+                return 1;
+            else
+                return size;
+        }
     } // namespace impl
 
     // Returns the elements of the specified enumerable or the element type's default value in a singleton collection if the enumerable is empty.
     constexpr auto default_if_empty()
     {
-        return [](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return impl::iterable{ impl::default_if_empty_iterator<It, T>{
-                impl::iterator_ctor, std::begin(container), std::end(container), T{} } };
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                return impl::iterable{ impl::default_if_empty_iterator<It, T>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), T{} }, impl::default_if_empty_size(impl::fixed_size(container)) };
+            });
     }
 
     // Returns the elements of the specified enumerable or the specified value in a singleton collection if the enumerable is empty.
     template <typename T>
     constexpr auto default_if_empty(T&& def)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::default_if_empty_iterator<It, T>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::forward<T>(def) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& def) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::default_if_empty_iterator<It, std::decay_t<T>>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(def)>(def) }, impl::default_if_empty_size(impl::fixed_size(container)) };
+            },
+            std::forward<T>(def));
     }
 
     // Calculates the average value of the elements.
     constexpr auto average()
     {
-        return [](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            std::size_t num{ 0 };
-            return aggregate<T>({}, [&num](auto& a, auto& b) { ++num; return a + b; })(container) / static_cast<T>(num);
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                // The sum and the count are reduced together.
+                using partial_type = std::pair<T, std::size_t>;
+                partial_type result = impl::reduce(
+                    container, partial_type{},
+                    [](partial_type& result, auto&& item) {
+                        result.first = result.first + item;
+                        ++result.second;
+                    },
+                    [](partial_type& a, partial_type& b) { return partial_type{ a.first + b.first, a.second + b.second }; });
+                return result.first / static_cast<T>(result.second);
+            });
     }
 
     // Calculates the sum of the elements.
     constexpr auto sum()
     {
-        return [](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return aggregate<T>({}, [](auto& a, auto& b) { return a + b; })(container);
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                auto add = [](auto& a, auto& b) { return a + b; };
+                return aggregate<T>({}, add, add)(container);
+            });
     }
 
     namespace impl
@@ -430,24 +545,23 @@ namespace linq
         class reverse_iterator_impl
         {
         private:
-            std::vector<T> m_vec;
-            typename std::vector<T>::const_reverse_iterator m_begin, m_end;
+            // The buffer is shared by the copies of the iterator.
+            std::shared_ptr<const std::vector<T>> m_vec;
+            std::size_t m_index;
 
         public:
-            using traits_type = std::iterator_traits<typename std::vector<T>::const_reverse_iterator>;
+            using traits_type = iterator_impl_traits<T>;
 
-            template <typename It>
-            reverse_iterator_impl(It begin, It end) : m_vec(begin, end)
+            reverse_iterator_impl(std::vector<T>&& vec) : m_vec(std::make_shared<const std::vector<T>>(std::move(vec)))
             {
-                m_begin = m_vec.crbegin();
-                m_end = m_vec.crend();
+                m_index = m_vec->size();
             }
 
-            typename traits_type::reference value() const { return *m_begin; }
+            typename traits_type::reference value() const { return (*m_vec)[m_index - 1]; }
 
-            void move_next() { ++m_begin; }
+            void move_next() { --m_index; }
 
-            bool is_valid() const { return m_begin != m_end; }
+            bool is_valid() const { return m_index > 0; }
         };
 
         template <typename T>
@@ -457,18 +571,30 @@ namespace linq
     // Inverts the order of the elements.
     constexpr auto reverse()
     {
-        return [](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return impl::iterable{ impl::reverse_iterator<T>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                // A temporary container dies with the query, so it is copied, unless it is an iterable.
+                if constexpr (impl::is_iterator_category_v<It, std::bidirectional_iterator_tag> &&
+                              (std::is_lvalue_reference_v<decltype(container)> || impl::is_iterable_v<std::decay_t<decltype(container)>>))
+                {
+                    // Enumerates from the end directly.
+                    return impl::iterable{ std::make_reverse_iterator(std::end(container)), std::make_reverse_iterator(std::begin(container)), impl::fixed_size(container) };
+                }
+                else
+                {
+                    using T = typename std::iterator_traits<It>::value_type;
+                    auto size = impl::known_size(container);
+                    return impl::iterable{ impl::reverse_iterator<T>{ impl::iterator_ctor, impl::make_vector<T>(container) }, size };
+                }
+            });
     }
 
     // Always returns the param itself.
     struct identity
     {
         template <typename T>
-        constexpr T&& operator()(T&& t)
+        constexpr T&& operator()(T&& t) const
         {
             return std::forward<T>(t);
         }
@@ -524,11 +650,36 @@ namespace linq
         }
     };
 
+    namespace impl
+    {
+        // Compares the keys selected from the elements.
+        // The sorts look into the selector and the comparer to find a faster way.
+        template <typename Selector, typename Comparer>
+        struct key_comparer
+        {
+            Selector selector;
+            Comparer comparer;
+
+            template <typename T1, typename T2>
+            constexpr auto operator()(T1&& t1, T2&& t2) const
+            {
+                return comparer(selector(t1), selector(t2));
+            }
+
+            // A stateful selector, like a mutable lambda, could only be called by a non-const comparer.
+            template <typename T1, typename T2>
+            constexpr auto operator()(T1&& t1, T2&& t2)
+            {
+                return comparer(selector(t1), selector(t2));
+            }
+        };
+    } // namespace impl
+
     // Make a comparer with a selector and a ascending/descending comparer.
     template <typename Selector = identity, typename Comparer = ascending>
     constexpr auto make_comparer(Selector&& selector = {}, Comparer&& comparer = {})
     {
-        return [&](auto&& t1, auto&& t2) { return comparer(selector(t1), selector(t2)); };
+        return impl::key_comparer<std::decay_t<Selector>, std::decay_t<Comparer>>{ std::forward<Selector>(selector), std::forward<Comparer>(comparer) };
     }
 
     namespace impl
@@ -562,353 +713,2068 @@ namespace linq
         }
     }
 
-    // Sorts the enumerable by the specified comparer.
-    template <typename... Comparer>
-    constexpr auto sort(Comparer&&... comparer)
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            std::vector<T> result(std::begin(container), std::end(container));
-            std::sort(result.begin(), result.end(), make_sorter<Comparer...>(std::forward<Comparer>(comparer)...));
-            return result;
-        };
-    }
-
-    // Gets the limit value of an enumerable.
-    template <typename Comparer>
-    constexpr auto limit(Comparer&& comparer)
+    namespace impl
     {
-        return [&](auto&& container) {
+        // Copies the enumerable into a vector and sorts it.
+        // A parallel enumerable is sorted by chunks, and the chunks are merged in parallel.
+        template <bool Stable, typename Container, typename Sorter>
+        auto sort_vector(Container&& container, Sorter&& sorter)
+        {
             using It = decltype(std::begin(container));
             using T = typename std::iterator_traits<It>::value_type;
-            auto begin = std::begin(container);
-            auto end = std::end(container);
-            if (begin == end)
-                return T{};
-            T result = *begin;
-            for (++begin; begin != end; ++begin)
+            if constexpr (is_parallel_v<std::decay_t<Container>>)
             {
-                if (!comparer(result, *begin))
-                    result = *begin;
+                std::vector<T> result = parallel_make_vector<T>(container, std::allocator<T>{});
+                parallel_sort<Stable>(result, sorter, container.options());
+                return result;
             }
-            return result;
-        };
-    }
-
-    template <typename Comparer, typename T>
-    constexpr auto limit(Comparer&& comparer, T&& def)
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            std::common_type_t<T, typename std::iterator_traits<It>::value_type> result{ std::forward<T>(def) };
-            for (auto& item : container)
+            else
             {
-                if (!comparer(result, item))
-                    result = item;
+                std::vector<T> result = make_vector<T>(container);
+                sort_range<Stable>(result.begin(), result.end(), sorter);
+                return result;
             }
-            return result;
-        };
-    }
-
-    constexpr auto(min)()
-    {
-        return limit<std::less<void>>({});
-    }
-
-    template <typename T>
-    constexpr auto(min)(T&& def)
-    {
-        return limit<std::less<void>, T>({}, std::forward<T>(def));
-    }
-
-    constexpr auto(max)()
-    {
-        return limit<std::greater<void>>({});
-    }
-
-    template <typename T>
-    constexpr auto(max)(T&& def)
-    {
-        return limit<std::greater<void>, T>({}, std::forward<T>(def));
-    }
+        }
 
-    // Returns the element at a specified index.
-    template <typename T>
-    constexpr auto get_at(std::size_t index, T&& def)
-    {
-        return [index, &def](auto&& container) {
-            auto begin = std::begin(container);
-            auto end = std::end(container);
-            for (std::size_t i{ 0 }; begin != end && i < index; ++begin, ++i)
-                ;
-            if (begin == end)
-                return std::forward<T>(def);
-            else
-                return *begin;
+        // The unsigned integer with the same size as a number, whose bits could be sorted.
+        template <typename K, typename = void>
+        struct radix_number
+        {
         };
-    }
 
-    // Returns the element at a specified index.
-    constexpr auto get_at(std::size_t index)
-    {
-        return [=](auto&& container) {
-            using It = decltype(std::begin(container));
-            using T = typename std::iterator_traits<It>::value_type;
-            return get_at<T>(index, {})(container);
+        template <>
+        struct radix_number<bool>
+        {
+            using type = std::uint8_t;
         };
-    }
 
-    // Returns the index of the first element which satifies the predicate.
-    template <typename Pred>
-    constexpr auto index_of(Pred&& pred)
-    {
-        return [&](auto&& container) {
-            std::size_t index{ 0 };
-            auto begin = std::begin(container);
-            auto end = std::end(container);
-            for (; begin != end && !pred(*begin); ++begin, ++index)
-                ;
-            if (begin == end)
-                return static_cast<std::size_t>(-1);
-            else
-                return index;
+        template <typename K>
+        struct radix_number<K, std::enable_if_t<std::is_integral_v<K> && !std::is_same_v<K, bool>>>
+        {
+            using type = std::make_unsigned_t<K>;
         };
-    }
 
-    namespace impl
-    {
-        template <typename It, typename Comparer>
-        class distinct_iterator_impl
+        template <typename K>
+        struct radix_number<K, std::enable_if_t<std::is_floating_point_v<K> && std::numeric_limits<K>::is_iec559 && sizeof(K) == 4>>
         {
-        private:
-            using value_type = typename std::iterator_traits<It>::value_type;
+            using type = std::uint32_t;
+        };
 
-            std::set<value_type, Comparer> m_set;
-            It m_begin, m_end;
+        template <typename K>
+        struct radix_number<K, std::enable_if_t<std::is_floating_point_v<K> && std::numeric_limits<K>::is_iec559 && sizeof(K) == 8>>
+        {
+            using type = std::uint64_t;
+        };
 
-        public:
-            using traits_type = std::iterator_traits<It>;
+        template <typename K>
+        using radix_number_t = typename radix_number<K>::type;
 
-            distinct_iterator_impl(It begin, It end) : m_begin(begin), m_end(end) { move_next(); }
+        template <typename K, typename = void>
+        inline constexpr bool is_radix_number_v{ false };
 
-            typename traits_type::reference value() { return *m_begin; }
+        template <typename K>
+        inline constexpr bool is_radix_number_v<K, std::void_t<radix_number_t<K>>>{ true };
 
-            void move_next()
+        // Maps a number to an unsigned integer in the same order.
+        template <typename K>
+        radix_number_t<K> radix_bits(K value)
+        {
+            using U = radix_number_t<K>;
+            constexpr U sign{ static_cast<U>(U{ 1 } << (sizeof(U) * 8 - 1)) };
+            if constexpr (std::is_same_v<K, bool> || std::is_unsigned_v<K>)
             {
-                for (; m_begin != m_end; ++m_begin)
-                {
-                    if (m_set.emplace(*m_begin).second)
-                        break;
-                }
+                return static_cast<U>(value);
+            }
+            else if constexpr (std::is_integral_v<K>)
+            {
+                return static_cast<U>(static_cast<U>(value) ^ sign);
+            }
+            else
+            {
+                // The negative zero equals to zero.
+                // The negative numbers are inverted, and the others get the sign bit.
+                if (value == 0) value = 0;
+                U bits;
+                std::memcpy(&bits, &value, sizeof(U));
+                return (bits & sign) ? static_cast<U>(~bits) : static_cast<U>(bits | sign);
             }
+        }
 
-            bool is_valid() const { return m_begin != m_end; }
+        // Describes whether a comparer of the elements could sort them by the radix of the keys.
+        // A selector which could not be called as const is left to the comparison sort.
+        template <typename T, typename Comparer, typename = void>
+        struct radix_key_traits
+        {
+            static constexpr std::size_t bits{ 0 };
+            static constexpr bool is_string{ false };
         };
 
-        template <typename It, typename Comparer>
-        using distinct_iterator = iterator_base<distinct_iterator_impl<It, Comparer>>;
-    } // namespace impl
+        template <typename T, typename Selector, typename Comparer>
+        struct radix_key_traits<T, key_comparer<Selector, Comparer>, std::enable_if_t<std::is_invocable_v<const Selector&, T&>>>
+        {
+            using result_type = std::invoke_result_t<const Selector&, T&>;
+            using key_type = std::decay_t<result_type>;
 
-    // Returns distinct elements.
-    template <typename Comparer = std::less<void>>
-    constexpr auto distinct()
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::distinct_iterator<It, Comparer>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
+            static constexpr bool is_descending{ std::is_same_v<Comparer, descending> || std::is_same_v<Comparer, string_descending<char>> };
+            static constexpr bool is_numeric_comparer{ std::is_same_v<Comparer, ascending> || std::is_same_v<Comparer, descending> };
+            static constexpr bool is_string_comparer{ std::is_same_v<Comparer, string_ascending<char>> || std::is_same_v<Comparer, string_descending<char>> };
+
+            static constexpr std::size_t bits{ is_numeric_comparer && is_radix_number_v<key_type> ? sizeof(key_type) * 8 : 0 };
+            static constexpr bool is_string{ (is_numeric_comparer && (std::is_same_v<key_type, std::string> || std::is_same_v<key_type, std::string_view>)) ||
+                                             (is_string_comparer && std::is_convertible_v<key_type, std::string_view>) };
         };
-    }
 
-    namespace impl
-    {
-        template <typename It1, typename It2, typename Comparer>
-        class union_set_iterator_impl
-        {
-        private:
-            using value_type = std::common_type_t<typename std::iterator_traits<It1>::value_type, typename std::iterator_traits<It2>::value_type>;
+        // The numeric keys are packed into one unsigned integer, if they are not wider than 64 bits.
+        template <typename T, typename... Comparer>
+        inline constexpr bool is_radix_packable_v{ (radix_key_traits<T, Comparer>::bits && ...) && (radix_key_traits<T, Comparer>::bits + ... + 0) <= 64 };
 
-            std::set<value_type, Comparer> m_set;
-            It1 m_begin1, m_end1;
-            It2 m_begin2, m_end2;
+        template <typename T, typename... Comparer>
+        inline constexpr bool is_radix_string_v{ false };
 
-            template <typename It>
-            bool move_next(It& begin, const It& end)
-            {
-                for (; begin != end; ++begin)
-                {
-                    if (m_set.emplace(*begin).second)
-                        return true;
-                }
-                return false;
-            }
+        template <typename T, typename Comparer>
+        inline constexpr bool is_radix_string_v<T, Comparer>{ radix_key_traits<T, Comparer>::is_string };
 
-        public:
-            using traits_type = iterator_impl_traits<value_type>;
+        template <typename T, typename... Comparer>
+        inline constexpr bool is_radix_sortable_v{ sizeof...(Comparer) > 0 && (is_radix_packable_v<T, Comparer...> || is_radix_string_v<T, Comparer...>) };
+
+        // The comparison sort is faster for a few elements.
+        inline constexpr std::size_t radix_sort_threshold{ 256 };
 
-            union_set_iterator_impl(It1 begin1, It1 end1, It2 begin2, It2 end2) : m_begin1(begin1), m_end1(end1), m_begin2(begin2), m_end2(end2)
+        // Packs the keys of an element, and the first key takes the highest bits.
+        template <typename Key, typename T, typename C1, typename... Comparer>
+        Key radix_pack(T& item, const C1& c1, const Comparer&... comparer)
+        {
+            using traits = radix_key_traits<T, C1>;
+            auto bits = radix_bits<typename traits::key_type>(c1.selector(item));
+            if constexpr (traits::is_descending) bits = static_cast<decltype(bits)>(~bits);
+            Key key{ bits };
+            if constexpr (sizeof...(Comparer))
             {
-                move_next();
+                key = static_cast<Key>(key << (radix_key_traits<T, Comparer>::bits + ...)) | radix_pack<Key>(item, comparer...);
             }
+            return key;
+        }
 
-            typename traits_type::reference value() { return m_begin1 != m_end1 ? *m_begin1 : *m_begin2; }
-
-            void move_next()
+        // Sorts the keys with LSD radix sort by bytes. It is stable, and skips the bytes which are the same in all keys.
+        template <std::size_t Bits, typename Key>
+        void radix_sort_keys(std::vector<std::pair<Key, std::size_t>>& keys)
+        {
+            constexpr std::size_t digits{ Bits / 8 };
+            std::vector<std::array<std::size_t, 256>> counts(digits);
+            for (auto& key : keys)
             {
-                if (m_begin1 == m_end1 || (m_begin1 != m_end1 && !move_next(m_begin1, m_end1)))
-                    move_next(m_begin2, m_end2);
+                for (std::size_t d = 0; d < digits; d++)
+                    counts[d][(key.first >> (d * 8)) & 0xFF]++;
+            }
+            std::vector<std::pair<Key, std::size_t>> buffer(keys.size());
+            auto* from = &keys;
+            auto* to = &buffer;
+            for (std::size_t d = 0; d < digits; d++)
+            {
+                auto& count = counts[d];
+                if (count[(from->front().first >> (d * 8)) & 0xFF] == keys.size()) continue;
+                std::size_t offset{ 0 };
+                for (auto& c : count)
+                    offset += std::exchange(c, offset);
+                for (auto& key : *from)
+                    (*to)[count[(key.first >> (d * 8)) & 0xFF]++] = key;
+                std::swap(from, to);
             }
+            if (from != &keys) keys.swap(buffer);
+        }
 
-            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
-        };
+        // Sorts the indices by the strings with MSD radix sort by bytes.
+        // It is stable, and the small buckets are sorted by comparison.
+        inline void radix_sort_strings(std::size_t* first, std::size_t* last, std::size_t* buffer, const std::string_view* strings, std::size_t depth, bool descending)
+        {
+            constexpr std::ptrdiff_t small_size{ 32 };
+            // The end of a string goes into the first bucket.
+            auto digit = [&](std::size_t i) -> std::size_t { return depth < strings[i].size() ? static_cast<unsigned char>(strings[i][depth]) + 1 : 0; };
+            while (last - first > small_size)
+            {
+                std::array<std::size_t, 257> count{};
+                for (auto p = first; p != last; ++p)
+                    count[digit(*p)]++;
+                auto size = static_cast<std::size_t>(last - first);
+                std::size_t d = digit(*first);
+                if (count[d] == size)
+                {
+                    // All strings end here, or share the byte.
+                    if (d == 0) return;
+                    depth++;
+                    continue;
+                }
+                std::array<std::size_t, 257> offsets;
+                std::size_t offset{ 0 };
+                for (std::size_t b = 0; b < 257; b++)
+                {
+                    std::size_t bucket = descending ? 256 - b : b;
+                    offsets[bucket] = offset;
+                    offset += count[bucket];
+                }
+                for (auto p = first; p != last; ++p)
+                    buffer[offsets[digit(*p)]++] = *p;
+                std::copy(buffer, buffer + size, first);
+                // Now the offsets are the ends of the buckets.
+                // The largest bucket is sorted in this loop, and the others recursively, so the recursion is at most log(n) deep.
+                std::size_t largest{ 0 };
+                for (std::size_t bucket = 1; bucket < 257; bucket++)
+                {
+                    if (count[bucket] > count[largest]) largest = bucket;
+                }
+                for (std::size_t bucket = 1; bucket < 257; bucket++)
+                {
+                    if (bucket != largest && count[bucket] > 1)
+                        radix_sort_strings(first + (offsets[bucket] - count[bucket]), first + offsets[bucket], buffer, strings, depth + 1, descending);
+                }
+                if (largest == 0 || count[largest] < 2) return;
+                last = first + offsets[largest];
+                first = last - count[largest];
+                depth++;
+            }
+            std::stable_sort(first, last, [&](std::size_t a, std::size_t b) {
+                auto sa = strings[a].substr(depth);
+                auto sb = strings[b].substr(depth);
+                return descending ? sb < sa : sa < sb;
+            });
+        }
+
+        // Sorts the vector by the radix of the keys. It is stable.
+        template <typename T, typename Allocator, typename... Comparer>
+        void radix_sort(std::vector<T, Allocator>& v, const Comparer&... comparer)
+        {
+            std::vector<T, Allocator> result(v.get_allocator());
+            result.reserve(v.size());
+            if constexpr (is_radix_packable_v<T, Comparer...>)
+            {
+                constexpr std::size_t bits{ (radix_key_traits<T, Comparer>::bits + ...) };
+                using Key = std::conditional_t<(bits <= 32), std::uint32_t, std::uint64_t>;
+                std::vector<std::pair<Key, std::size_t>> keys;
+                keys.reserve(v.size());
+                for (std::size_t i = 0; i < v.size(); i++)
+                    keys.emplace_back(radix_pack<Key>(v[i], comparer...), i);
+                radix_sort_keys<bits>(keys);
+                for (auto& key : keys)
+                    result.push_back(std::move(v[key.second]));
+            }
+            else
+            {
+                using traits = radix_key_traits<T, Comparer...>;
+                const auto& c = std::get<0>(std::forward_as_tuple(comparer...));
+                // The keys are cached, unless the selector refers to the element.
+                std::vector<std::conditional_t<std::is_lvalue_reference_v<typename traits::result_type>, std::string_view, typename traits::key_type>> keys;
+                keys.reserve(v.size());
+                for (auto& item : v)
+                    keys.emplace_back(c.selector(item));
+                std::vector<std::string_view> strings(keys.begin(), keys.end());
+                std::vector<std::size_t> order(v.size()), buffer(v.size());
+                std::iota(order.begin(), order.end(), std::size_t{ 0 });
+                radix_sort_strings(order.data(), order.data() + order.size(), buffer.data(), strings.data(), 0, traits::is_descending);
+                for (std::size_t i : order)
+                    result.push_back(std::move(v[i]));
+            }
+            v.swap(result);
+        }
+    } // namespace impl
+
+    namespace impl
+    {
+        // The cached key of an element for a comparer.
+        // Another comparer than a key comparer, or one whose selector could not be called as const, compares the elements themselves.
+        template <typename T, typename Comparer, typename = void>
+        struct cached_key
+        {
+            using type = T*;
+
+            static constexpr bool is_expensive{ false };
+
+            static type get(const Comparer&, T& item) { return &item; }
+            static auto compare(const Comparer& c, type a, type b) { return c(*a, *b); }
+        };
+
+        // A key referring to the element is cached as a pointer, and a key created by the selector is cached as a value.
+        template <typename T, typename Selector, typename Comparer>
+        struct cached_key<T, key_comparer<Selector, Comparer>, std::enable_if_t<std::is_invocable_v<const Selector&, T&>>>
+        {
+            using result_type = std::invoke_result_t<const Selector&, T&>;
+            using type = std::conditional_t<std::is_lvalue_reference_v<result_type>, std::remove_reference_t<result_type>*, std::decay_t<result_type>>;
+
+            // A created key which is not trivially copyable, like a string, is expensive to select for each comparison.
+            static constexpr bool is_expensive{ !std::is_lvalue_reference_v<result_type> && !std::is_trivially_copyable_v<type> };
+
+            static type get(const key_comparer<Selector, Comparer>& c, T& item)
+            {
+                if constexpr (std::is_lvalue_reference_v<result_type>)
+                    return std::addressof(c.selector(item));
+                else
+                    return c.selector(item);
+            }
+
+            static auto compare(const key_comparer<Selector, Comparer>& c, const type& a, const type& b)
+            {
+                if constexpr (std::is_lvalue_reference_v<result_type>)
+                    return c.comparer(*a, *b);
+                else
+                    return c.comparer(a, b);
+            }
+        };
+
+        template <typename T, typename... Comparer>
+        inline constexpr bool has_expensive_key_v{ (cached_key<T, Comparer>::is_expensive || ...) };
+
+        // Compares the cached keys in order, and gets a negative, zero or positive result.
+        template <typename T, typename... Comparer, typename Keys, std::size_t... I>
+        int compare_cached_keys(const Keys& a, const Keys& b, std::index_sequence<I...>, const Comparer&... comparer)
+        {
+            int result{ 0 };
+            auto sign = [](auto t) { return t < 0 ? -1 : (t == 0 ? 0 : 1); };
+            static_cast<void>((... || ((result = sign(cached_key<T, Comparer>::compare(comparer, std::get<I>(a), std::get<I>(b)))) != 0)));
+            return result;
+        }
+
+        // Selects the keys once for each element, sorts the keys with the indices, and then gathers the elements.
+        // The indices break the ties, so it is stable.
+        template <typename T, typename Allocator, typename... Comparer>
+        void sort_by_cached_keys(std::vector<T, Allocator>& v, const Comparer&... comparer)
+        {
+            struct entry
+            {
+                std::tuple<typename cached_key<T, Comparer>::type...> keys;
+                std::size_t index;
+            };
+            std::vector<entry> entries;
+            entries.reserve(v.size());
+            for (std::size_t i = 0; i < v.size(); i++)
+                entries.push_back({ { cached_key<T, Comparer>::get(comparer, v[i])... }, i });
+            std::sort(entries.begin(), entries.end(), [&](const entry& a, const entry& b) {
+                int result = compare_cached_keys<T, Comparer...>(a.keys, b.keys, std::index_sequence_for<Comparer...>{}, comparer...);
+                return result ? result < 0 : a.index < b.index;
+            });
+            std::vector<T, Allocator> result(v.get_allocator());
+            result.reserve(v.size());
+            for (auto& e : entries)
+                result.push_back(std::move(v[e.index]));
+            v.swap(result);
+        }
+
+        // The query of sort is named, so that it could fuse with the following take.
+        template <bool Stable>
+        struct sort_query
+        {
+            template <typename Container, typename... Comparer>
+            auto operator()(Container&& container, Comparer&&... comparer) const
+            {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                if constexpr (sizeof...(Comparer) == 0)
+                {
+                    return (*this)(container, make_comparer());
+                }
+                else if constexpr (!is_parallel_v<std::decay_t<Container>> && is_radix_sortable_v<T, std::decay_t<Comparer>...>)
+                {
+                    // The integer, floating and string keys are sorted by their bytes.
+                    std::vector<T> result = make_vector<T>(container);
+                    if (result.size() < radix_sort_threshold)
+                        sort_range<true>(result.begin(), result.end(), make_sorter(comparer...));
+                    else
+                        radix_sort(result, comparer...);
+                    return result;
+                }
+                else if constexpr (!is_parallel_v<std::decay_t<Container>> && has_expensive_key_v<T, std::decay_t<Comparer>...>)
+                {
+                    // The keys created by the selectors are cached, instead of creating them for each comparison.
+                    std::vector<T> result = make_vector<T>(container);
+                    sort_by_cached_keys(result, comparer...);
+                    return result;
+                }
+                else
+                {
+                    return sort_vector<Stable>(container, make_sorter<Comparer...>(std::forward<Comparer>(comparer)...));
+                }
+            }
+        };
+    } // namespace impl
+
+    // Sorts the enumerable by the specified comparer.
+    // It sorts all the elements into a vector at once, so v >> sort(c) >> take(k) still sorts them all;
+    // compose the queries as v >> (sort(c) >> take(k)), or use top_k or order_by, to sort only the first k.
+    template <typename... Comparer>
+    constexpr auto sort(Comparer&&... comparer)
+    {
+        return impl::make_query(impl::sort_query<false>{}, std::forward<Comparer>(comparer)...);
+    }
+
+    // Sorts the enumerable by the specified comparer, and keeps the order of the equivalent elements.
+    template <typename... Comparer>
+    constexpr auto stable_sort(Comparer&&... comparer)
+    {
+        return impl::make_query(impl::sort_query<true>{}, std::forward<Comparer>(comparer)...);
+    }
+
+    // Sorts the enumerable by the specified comparer, and selects the keys only once for each element.
+    // It keeps the order of the equivalent elements.
+    template <typename... Comparer>
+    constexpr auto cached_sort(Comparer&&... comparer)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&&... comparer) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                std::vector<T> result = impl::make_vector<T>(container);
+                if constexpr (sizeof...(comparer) == 0)
+                    impl::sort_by_cached_keys(result, make_comparer());
+                else
+                    impl::sort_by_cached_keys(result, comparer...);
+                return result;
+            },
+            std::forward<Comparer>(comparer)...);
+    }
+
+    namespace impl
+    {
+        // Keeps the first k elements in the order of the sorter, with a heap whose top is the last one.
+        // The earlier one of the equivalent elements goes first, as a stable sort does.
+        template <typename T, typename Sorter>
+        class top_k_heap
+        {
+        private:
+            using entry = std::pair<T, std::size_t>;
+
+            std::vector<entry> m_heap;
+            std::size_t m_k, m_index{ 0 };
+            const Sorter& m_sorter;
+
+            auto heap_less() const
+            {
+                return [this](const entry& a, const entry& b) { return m_sorter(a.first, b.first) || (!m_sorter(b.first, a.first) && a.second < b.second); };
+            }
+
+        public:
+            top_k_heap(std::size_t k, const Sorter& sorter) : m_k(k), m_sorter(sorter) {}
+
+            template <typename Item>
+            void push(Item&& item)
+            {
+                if (m_heap.size() < m_k)
+                {
+                    m_heap.emplace_back(std::forward<Item>(item), m_index);
+                    std::push_heap(m_heap.begin(), m_heap.end(), heap_less());
+                }
+                // A later element replaces the top only if it goes strictly before it.
+                else if (m_k && m_sorter(item, m_heap.front().first))
+                {
+                    std::pop_heap(m_heap.begin(), m_heap.end(), heap_less());
+                    m_heap.back() = entry{ std::forward<Item>(item), m_index };
+                    std::push_heap(m_heap.begin(), m_heap.end(), heap_less());
+                }
+                m_index++;
+            }
+
+            std::vector<T> take() &&
+            {
+                std::sort_heap(m_heap.begin(), m_heap.end(), heap_less());
+                std::vector<T> result;
+                result.reserve(m_heap.size());
+                for (auto& e : m_heap)
+                    result.emplace_back(std::move(e.first));
+                return result;
+            }
+        };
+
+        // Gets the first k elements of the sorted enumerable.
+        // The chunks of a parallel enumerable keep their own heaps, and the results are merged in order.
+        template <typename Container, typename Sorter>
+        auto top_k_vector(Container&& container, std::size_t k, const Sorter& sorter)
+        {
+            using It = decltype(std::begin(container));
+            using T = typename std::iterator_traits<It>::value_type;
+            top_k_heap<T, Sorter> heap{ k, sorter };
+            if constexpr (is_parallel_v<std::decay_t<Container>>)
+            {
+                auto parts = map_chunks(container, [&](auto& begin, const auto& end, std::size_t) {
+                    top_k_heap<T, Sorter> part{ k, sorter };
+                    push_range(begin, end, [&](auto&& item) {
+                        part.push(std::forward<decltype(item)>(item));
+                        return true;
+                    });
+                    return std::move(part).take();
+                });
+                for (auto& part : parts)
+                {
+                    for (auto& item : *part.value)
+                        heap.push(std::move(item));
+                }
+            }
+            else
+            {
+                push_each(container, [&](auto&& item) {
+                    heap.push(std::forward<decltype(item)>(item));
+                    return true;
+                });
+            }
+            return std::move(heap).take();
+        }
+    } // namespace impl
+
+    // Gets the first k elements in the order of the specified comparer, with O(k) memory.
+    // The equivalent elements keep their order.
+    // A sort composed with a take, as in v >> (sort(c) >> take(k)), becomes top_k; without the parentheses it does not.
+    template <typename... Comparer>
+    constexpr auto top_k(std::size_t k, Comparer&&... comparer)
+    {
+        return impl::make_query(
+            [](auto&& container, std::size_t k, auto&&... comparer) {
+                return impl::top_k_vector(container, k, make_sorter<decltype(comparer)...>(std::forward<decltype(comparer)>(comparer)...));
+            },
+            k, std::forward<Comparer>(comparer)...);
+    }
+
+    // A sort composed with a following take gets the first elements with top_k instead.
+    template <bool Stable, typename... Comparer, typename Take, typename = std::enable_if_t<impl::is_take_query_v<Take>>>
+    constexpr auto operator>>(impl::query<impl::sort_query<Stable>, Comparer...> q1, Take&& q2)
+    {
+        return std::apply([&](auto&&... comparer) { return top_k(std::get<0>(q2.args()), std::forward<decltype(comparer)>(comparer)...); }, std::move(q1).args());
+    }
+
+    namespace impl
+    {
+        // The elements sorted lazily, shared by the copies of the iterators.
+        // The rest elements are kept in a heap at the front, and the sorted ones are popped to the back in order.
+        // The heap is popped under a mutex, so that the copies could be read on different threads;
+        // the sorted elements are not moved again, and they are read without it.
+        template <typename T, typename... Comparer>
+        class lazy_sort_state
+        {
+        private:
+            using entry = std::pair<T, std::size_t>;
+
+            std::vector<entry> m_items;
+            std::atomic<std::size_t> m_sorted{ 0 };
+            std::mutex m_mutex;
+            std::tuple<Comparer...> m_comparers;
+
+            // The index breaks the ties, so that the sort is stable.
+            template <typename Sorter>
+            static bool less(const Sorter& sorter, const entry& a, const entry& b)
+            {
+                return sorter(a.first, b.first) || (!sorter(b.first, a.first) && a.second < b.second);
+            }
+
+            // The sorter is made once for all comparisons.
+            auto heap_greater() const
+            {
+                return std::apply(
+                    [](const Comparer&... comparer) {
+                        return [sorter = make_sorter(comparer...)](const entry& a, const entry& b) { return less(sorter, b, a); };
+                    },
+                    m_comparers);
+            }
+
+        public:
+            template <typename Container, typename... Cs>
+            lazy_sort_state(Container&& container, Cs&&... comparer) : m_comparers(std::forward<Cs>(comparer)...)
+            {
+                if (auto size = known_size(container)) m_items.reserve(*size);
+                push_each(container, [&](auto&& item) {
+                    m_items.emplace_back(std::forward<decltype(item)>(item), m_items.size());
+                    return true;
+                });
+                std::make_heap(m_items.begin(), m_items.end(), heap_greater());
+            }
+
+            std::size_t size() const noexcept { return m_items.size(); }
+
+            // Gets the element at the index of the sorted order, and pops the heap until it is sorted.
+            const T& at(std::size_t index)
+            {
+                if (index >= m_sorted.load(std::memory_order_acquire))
+                {
+                    std::lock_guard<std::mutex> lock{ m_mutex };
+                    auto greater = heap_greater();
+                    for (std::size_t sorted = m_sorted.load(std::memory_order_relaxed); sorted <= index; sorted++)
+                    {
+                        std::pop_heap(m_items.begin(), m_items.end() - sorted, greater);
+                        m_sorted.store(sorted + 1, std::memory_order_release);
+                    }
+                }
+                return m_items[m_items.size() - 1 - index].first;
+            }
+        };
+
+        template <typename T, typename... Comparer>
+        class order_by_iterator_impl
+        {
+        private:
+            std::shared_ptr<lazy_sort_state<T, Comparer...>> m_state;
+            std::size_t m_index{ 0 };
+
+        public:
+            using traits_type = iterator_impl_traits<T>;
+
+            order_by_iterator_impl(std::shared_ptr<lazy_sort_state<T, Comparer...>> state) : m_state(std::move(state)) {}
+
+            typename traits_type::reference value() const { return m_state->at(m_index); }
+
+            void move_next() { ++m_index; }
+
+            bool is_valid() const { return m_index < m_state->size(); }
+        };
+
+        template <typename T, typename... Comparer>
+        using order_by_iterator = iterator_base<order_by_iterator_impl<T, Comparer...>>;
+
+        template <typename Container, typename... Comparer>
+        auto make_order_by(Container&& container, Comparer&&... comparer)
+        {
+            using It = decltype(std::begin(container));
+            using T = typename std::iterator_traits<It>::value_type;
+            if constexpr (sizeof...(Comparer) == 0)
+            {
+                return make_order_by(container, make_comparer());
+            }
+            else
+            {
+                auto state = std::make_shared<lazy_sort_state<T, std::decay_t<Comparer>...>>(container, std::forward<Comparer>(comparer)...);
+                std::optional<std::size_t> size{ state->size() };
+                return iterable{ order_by_iterator<T, std::decay_t<Comparer>...>{ iterator_ctor, std::move(state) }, size };
+            }
+        }
+    } // namespace impl
+
+    // Sorts the enumerable lazily by the specified comparer, and keeps the order of the equivalent elements.
+    // It builds a heap in O(n), and each element costs O(log n) when it is enumerated,
+    // so the first elements come out without sorting all of them.
+    template <typename... Comparer>
+    constexpr auto order_by(Comparer&&... comparer)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&&... comparer) { return impl::make_order_by(container, std::forward<decltype(comparer)>(comparer)...); },
+            std::forward<Comparer>(comparer)...);
+    }
+
+    // Gets the limit value of an enumerable.
+    template <typename Comparer>
+    constexpr auto limit(Comparer&& comparer)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& comparer) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                // A later element replaces an equivalent one.
+                auto replace = [&](std::optional<T>& result, auto&& item) {
+                    if (!result)
+                        result.emplace(item);
+                    else if (!comparer(*result, item))
+                        *result = item;
+                };
+                auto result = impl::reduce(container, std::optional<T>{}, replace, [&](std::optional<T>& a, std::optional<T>& b) {
+                    if (b) replace(a, *b);
+                    return a;
+                });
+                return result ? std::move(*result) : T{};
+            },
+            std::forward<Comparer>(comparer));
+    }
+
+    template <typename Comparer, typename T>
+    constexpr auto limit(Comparer&& comparer, T&& def)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& comparer, auto&& def) {
+                using It = decltype(std::begin(container));
+                std::common_type_t<std::decay_t<T>, typename std::iterator_traits<It>::value_type> result{ std::forward<decltype(def)>(def) };
+                // The default value takes part in every chunk, which does not change the limit.
+                return impl::reduce(
+                    container, result,
+                    [&](decltype(result)& result, auto&& item) {
+                        if (!comparer(result, item))
+                            result = item;
+                    },
+                    [&](decltype(result)& a, decltype(result)& b) { return comparer(a, b) ? a : b; });
+            },
+            std::forward<Comparer>(comparer), std::forward<T>(def));
+    }
+
+    constexpr auto(min)()
+    {
+        return limit<std::less<void>>({});
+    }
+
+    template <typename T>
+    constexpr auto(min)(T&& def)
+    {
+        return limit<std::less<void>, T>({}, std::forward<T>(def));
+    }
+
+    constexpr auto(max)()
+    {
+        return limit<std::greater<void>>({});
+    }
+
+    template <typename T>
+    constexpr auto(max)(T&& def)
+    {
+        return limit<std::greater<void>, T>({}, std::forward<T>(def));
+    }
+
+    // Returns the element at a specified index.
+    template <typename T>
+    constexpr auto get_at(std::size_t index, T&& def)
+    {
+        return impl::make_query(
+            [](auto&& container, std::size_t index, auto&& def) {
+                auto end = std::end(container);
+                auto begin = impl::advance_bounded(std::begin(container), end, index);
+                if (begin == end)
+                    return std::forward<decltype(def)>(def);
+                else
+                    return *begin;
+            },
+            index, std::forward<T>(def));
+    }
+
+    // Returns the element at a specified index.
+    constexpr auto get_at(std::size_t index)
+    {
+        return impl::make_query(
+            [](auto&& container, std::size_t index) {
+                using It = decltype(std::begin(container));
+                using T = typename std::iterator_traits<It>::value_type;
+                return get_at<T>(index, {})(container);
+            },
+            index);
+    }
+
+    // Returns the index of the first element which satifies the predicate.
+    template <typename Pred>
+    constexpr auto index_of(Pred&& pred)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                std::size_t index{ 0 };
+                if (impl::push_each(container, [&](auto&& item) {
+                        if (pred(item)) return false;
+                        ++index;
+                        return true;
+                    }))
+                    return static_cast<std::size_t>(-1);
+                else
+                    return index;
+            },
+            std::forward<Pred>(pred));
+    }
+
+    namespace impl
+    {
+        // The inner side of a hash join. The elements of a key are contiguous in a flat lookup, and probing never inserts.
+        template <typename TKey, typename TElement, typename Hash, typename KeyEq>
+        class hash_join_lookup
+        {
+        private:
+            using lookup_type = flat_lookup<TKey, TElement, Hash, KeyEq>;
+
+            lookup_type m_lookup;
+
+            // When the outer side is known to be smaller, its keys are hashed first,
+            // and only the inner elements matching them are kept.
+            // It is not done for an outer stage, which would compute its elements twice.
+            template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2>
+            static lookup_type build(It begin, It end, It2 begin2, It2 end2, KeySelector& keysel, KeySelector2& keysel2, ElementSelector2& elesel2, std::optional<std::size_t> size, std::optional<std::size_t> size2)
+            {
+                if (!is_stage_iterator_v<It> && size && size2 && *size < *size2)
+                {
+                    flat_hash_index<TKey, Hash, KeyEq> outer{ *size };
+                    for (; begin != end; ++begin)
+                        outer.insert(keysel(*begin));
+                    return lookup_type{ std::move(begin2), std::move(end2), keysel2, elesel2, std::nullopt, Hash{}, KeyEq{},
+                                        [&outer](const auto& key) { return outer.find(key) != outer.npos; } };
+                }
+                return lookup_type{ std::move(begin2), std::move(end2), keysel2, elesel2, size2 };
+            }
+
+        public:
+            using group_type = typename lookup_type::group_type;
+
+            template <typename It2, typename KeySelector2, typename ElementSelector2>
+            hash_join_lookup(It2 begin2, It2 end2, KeySelector2& keysel2, ElementSelector2& elesel2, std::optional<std::size_t> size2)
+                : m_lookup(std::move(begin2), std::move(end2), keysel2, elesel2, size2)
+            {
+            }
+
+            template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2>
+            hash_join_lookup(It begin, It end, It2 begin2, It2 end2, KeySelector& keysel, KeySelector2& keysel2, ElementSelector2& elesel2, std::optional<std::size_t> size, std::optional<std::size_t> size2)
+                : m_lookup(build(std::move(begin), std::move(end), std::move(begin2), std::move(end2), keysel, keysel2, elesel2, size, size2))
+            {
+            }
+
+            template <typename K>
+            group_type find(const K& key) const
+            {
+                std::size_t index = m_lookup.find(key);
+                return index == lookup_type::npos ? group_type{ nullptr, nullptr, 0 } : m_lookup.group(index);
+            }
+
+            template <typename K>
+            bool contains(const K& key) const
+            {
+                return m_lookup.find(key) != lookup_type::npos;
+            }
+
+            std::size_t size() const noexcept { return m_lookup.size(); }
+
+            const std::vector<TKey>& keys() const noexcept { return m_lookup.keys(); }
+        };
+
+        template <typename T>
+        inline constexpr bool is_lookup_v{ false };
+    } // namespace impl
+
+    // The elements grouped by their keys in a hash table, built once by to_lookup.
+    // It could be probed, or passed to join, group_join, intersect and except instead of a sequence, without being built again.
+    // The copies share the same table. The keys of other types are converted to TKey when they probe it.
+    template <typename TKey, typename TElement, typename Hash = default_hash, typename KeyEq = std::equal_to<void>>
+    class lookup
+    {
+    public:
+        using index_type = impl::hash_join_lookup<TKey, TElement, Hash, KeyEq>;
+        using key_type = TKey;
+        using element_type = TElement;
+        using group_type = typename index_type::group_type;
+
+    private:
+        std::shared_ptr<const index_type> m_index;
+
+    public:
+        explicit lookup(std::shared_ptr<const index_type> index) noexcept : m_index(std::move(index)) {}
+
+        // Gets the count of the keys.
+        std::size_t size() const noexcept { return m_index->size(); }
+
+        // Gets the keys in the order of their first appearance.
+        const std::vector<TKey>& keys() const noexcept { return m_index->keys(); }
+
+        template <typename K>
+        bool contains(const K& key) const
+        {
+            return m_index->contains(key);
+        }
+
+        // Gets the elements of the key, which are empty if the key is not found.
+        template <typename K>
+        group_type operator[](const K& key) const
+        {
+            return m_index->find(key);
+        }
+
+        const std::shared_ptr<const index_type>& index() const noexcept { return m_index; }
+    };
+
+    namespace impl
+    {
+        template <typename TKey, typename TElement, typename Hash, typename KeyEq>
+        inline constexpr bool is_lookup_v<lookup<TKey, TElement, Hash, KeyEq>>{ true };
+
+        // A temporary lookup is captured in a shared container, and it is still probed by its keys.
+        template <typename TKey, typename TElement, typename Hash, typename KeyEq>
+        const lookup<TKey, TElement, Hash, KeyEq>& unwrap_container(const std::shared_ptr<const lookup<TKey, TElement, Hash, KeyEq>>& container) noexcept
+        {
+            return *container;
+        }
+
+        template <typename Set, typename T>
+        bool set_contains(const Set& set, const T& value)
+        {
+            return set.find(value) != set.end();
+        }
+
+        template <typename TKey, typename TElement, typename Hash, typename KeyEq, typename T>
+        bool set_contains(const hash_join_lookup<TKey, TElement, Hash, KeyEq>& set, const T& value)
+        {
+            return set.contains(value);
+        }
+    } // namespace impl
+
+    // Builds a lookup of the elements selected by the element selector, grouped by the keys.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename KeySelector, typename ElementSelector = identity>
+    constexpr auto to_lookup(KeySelector&& keysel, ElementSelector&& elesel = {})
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel) {
+                using TKey = std::decay_t<decltype(keysel(*std::begin(container)))>;
+                using TElement = std::decay_t<decltype(elesel(*std::begin(container)))>;
+                using result_type = lookup<TKey, TElement, Hash, KeyEq>;
+                return result_type{ std::make_shared<const typename result_type::index_type>(std::begin(container), std::end(container), keysel, elesel, impl::known_size(container)) };
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel));
+    }
+
+    namespace impl
+    {
+        template <typename It, typename Comparer>
+        class distinct_iterator_impl
+        {
+        private:
+            using value_type = typename std::iterator_traits<It>::value_type;
+
+            std::set<value_type, Comparer> m_set;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            distinct_iterator_impl(It begin, It end) : m_begin(std::move(begin)), m_end(std::move(end)) { move_next(); }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    if (m_set.emplace(*m_begin).second)
+                        break;
+                }
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Comparer>
+        using distinct_iterator = iterator_base<distinct_iterator_impl<It, Comparer>>;
+    } // namespace impl
+
+    // Returns distinct elements.
+    template <typename Comparer = std::less<void>>
+    constexpr auto distinct()
+    {
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::distinct_iterator<It, Comparer>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
+            });
+    }
+
+    namespace impl
+    {
+        template <typename It1, typename It2, typename Comparer>
+        class union_set_iterator_impl
+        {
+        private:
+            using value_type = std::common_type_t<typename std::iterator_traits<It1>::value_type, typename std::iterator_traits<It2>::value_type>;
+
+            std::set<value_type, Comparer> m_set;
+            It1 m_begin1, m_end1;
+            It2 m_begin2, m_end2;
+
+            template <typename It>
+            bool move_next(It& begin, const It& end)
+            {
+                for (; begin != end; ++begin)
+                {
+                    if (m_set.emplace(*begin).second)
+                        return true;
+                }
+                return false;
+            }
+
+        public:
+            using traits_type = common_impl_traits<value_type, typename std::iterator_traits<It1>::reference, typename std::iterator_traits<It2>::reference>;
+
+            union_set_iterator_impl(It1 begin1, It1 end1, It2 begin2, It2 end2) : m_begin1(std::move(begin1)), m_end1(std::move(end1)), m_begin2(std::move(begin2)), m_end2(std::move(end2))
+            {
+                move_next();
+            }
+
+            typename traits_type::reference value() { return m_begin1 != m_end1 ? *m_begin1 : *m_begin2; }
+
+            void move_next()
+            {
+                if (m_begin1 == m_end1 || (m_begin1 != m_end1 && !move_next(m_begin1, m_end1)))
+                    move_next(m_begin2, m_end2);
+            }
+
+            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+        };
+
+        template <typename It1, typename It2, typename Comparer>
+        using union_set_iterator = iterator_base<union_set_iterator_impl<It1, It2, Comparer>>;
+    } // namespace impl
+
+    // Produces the set union of two enumerable.
+    template <typename Comparer = std::less<void>, typename Container2>
+    constexpr auto union_set(Container2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It1 = decltype(std::begin(container));
+                using It2 = decltype(std::begin(c2));
+                return impl::iterable{ impl::union_set_iterator<It1, It2, Comparer>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
+            },
+            impl::capture_container(std::forward<Container2>(c2)));
+    }
+
+    namespace impl
+    {
+        template <typename It, typename Comparer, typename Set>
+        class intersect_iterator_impl
+        {
+        private:
+            using value_type = typename std::iterator_traits<It>::value_type;
+
+            // The set of the second enumerable is shared by the copies of the iterator.
+            std::shared_ptr<const Set> m_lookup;
+            std::set<value_type, Comparer> m_set;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            intersect_iterator_impl(It begin, It end, std::shared_ptr<const Set> lookup)
+                : m_lookup(std::move(lookup)), m_begin(std::move(begin)), m_end(std::move(end))
+            {
+                move_next();
+            }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    if (set_contains(*m_lookup, *m_begin) && m_set.emplace(*m_begin).second)
+                        break;
+                }
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Comparer, typename Set>
+        using intersect_iterator = iterator_base<intersect_iterator_impl<It, Comparer, Set>>;
+
+        // A lookup is probed by its keys, and other enumerable are collected into a set.
+        template <typename Comparer, typename It, typename C2>
+        auto make_probe_set(C2&& c2)
+        {
+            if constexpr (is_lookup_v<std::decay_t<C2>>)
+                return c2.index();
+            else
+                return std::make_shared<const std::set<typename std::iterator_traits<It>::value_type, Comparer>>(std::begin(c2), std::end(c2));
+        }
+    } // namespace impl
+
+    // Produces the set intersection of two enumerable.
+    template <typename Comparer = std::less<void>, typename C2>
+    constexpr auto intersect(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                auto set = impl::make_probe_set<Comparer, It>(c2);
+                return impl::iterable{ impl::intersect_iterator<It, Comparer, std::remove_const_t<typename decltype(set)::element_type>>{ impl::iterator_ctor, std::begin(container), std::end(container), std::move(set) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    namespace impl
+    {
+        template <typename It, typename Comparer, typename Set>
+        class except_iterator_impl
+        {
+        private:
+            using value_type = typename std::iterator_traits<It>::value_type;
+
+            // The set of the second enumerable is shared by the copies of the iterator.
+            std::shared_ptr<const Set> m_lookup;
+            std::set<value_type, Comparer> m_set;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            except_iterator_impl(It begin, It end, std::shared_ptr<const Set> lookup)
+                : m_lookup(std::move(lookup)), m_begin(std::move(begin)), m_end(std::move(end))
+            {
+                move_next();
+            }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    if (!set_contains(*m_lookup, *m_begin) && m_set.emplace(*m_begin).second)
+                        break;
+                }
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Comparer, typename Set>
+        using except_iterator = iterator_base<except_iterator_impl<It, Comparer, Set>>;
+    } // namespace impl
+
+    // Produces the set difference of two enumerable.
+    template <typename Comparer = std::less<void>, typename C2>
+    constexpr auto except(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                auto set = impl::make_probe_set<Comparer, It>(c2);
+                return impl::iterable{ impl::except_iterator<It, Comparer, std::remove_const_t<typename decltype(set)::element_type>>{ impl::iterator_ctor, std::begin(container), std::end(container), std::move(set) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    namespace impl
+    {
+        template <typename It, typename Hash, typename KeyEq>
+        class hash_distinct_iterator_impl
+        {
+        private:
+            using value_type = typename std::iterator_traits<It>::value_type;
+
+            // The elements are stored by pointers if they are stable in the source.
+            flat_hash_set<value_type, Hash, KeyEq, is_stable_reference_v<It>> m_set;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            hash_distinct_iterator_impl(It begin, It end) : m_begin(std::move(begin)), m_end(std::move(end)) { move_next(); }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    if (m_set.insert(*m_begin))
+                        break;
+                }
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Hash, typename KeyEq>
+        using hash_distinct_iterator = iterator_base<hash_distinct_iterator_impl<It, Hash, KeyEq>>;
+    } // namespace impl
+
+    // Returns distinct elements from an enumerable with a flat hash set, in the order of their first appearance.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>>
+    constexpr auto hash_distinct()
+    {
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::hash_distinct_iterator<It, Hash, KeyEq>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
+            });
+    }
+
+    namespace impl
+    {
+        template <typename It1, typename It2, typename Hash, typename KeyEq>
+        class hash_union_set_iterator_impl
+        {
+        private:
+            using value_type = std::common_type_t<typename std::iterator_traits<It1>::value_type, typename std::iterator_traits<It2>::value_type>;
+
+            flat_hash_set<value_type, Hash, KeyEq, is_stable_reference_v<It1, value_type> && is_stable_reference_v<It2, value_type>> m_set;
+            It1 m_begin1, m_end1;
+            It2 m_begin2, m_end2;
+
+            template <typename It>
+            bool move_next(It& begin, const It& end)
+            {
+                for (; begin != end; ++begin)
+                {
+                    if (m_set.insert(*begin))
+                        return true;
+                }
+                return false;
+            }
+
+        public:
+            using traits_type = common_impl_traits<value_type, typename std::iterator_traits<It1>::reference, typename std::iterator_traits<It2>::reference>;
+
+            hash_union_set_iterator_impl(It1 begin1, It1 end1, It2 begin2, It2 end2) : m_begin1(std::move(begin1)), m_end1(std::move(end1)), m_begin2(std::move(begin2)), m_end2(std::move(end2))
+            {
+                move_next();
+            }
+
+            typename traits_type::reference value() { return m_begin1 != m_end1 ? *m_begin1 : *m_begin2; }
+
+            void move_next()
+            {
+                if (m_begin1 == m_end1 || !move_next(m_begin1, m_end1))
+                    move_next(m_begin2, m_end2);
+            }
+
+            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+        };
+
+        template <typename It1, typename It2, typename Hash, typename KeyEq>
+        using hash_union_set_iterator = iterator_base<hash_union_set_iterator_impl<It1, It2, Hash, KeyEq>>;
+    } // namespace impl
+
+    // Produces the set union of two enumerable with a flat hash set.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename Container2>
+    constexpr auto hash_union_set(Container2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It1 = decltype(std::begin(container));
+                using It2 = decltype(std::begin(c2));
+                return impl::iterable{ impl::hash_union_set_iterator<It1, It2, Hash, KeyEq>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
+            },
+            impl::capture_container(std::forward<Container2>(c2)));
+    }
+
+    namespace impl
+    {
+        template <typename T, typename Hash, typename KeyEq, bool ByRef, typename K>
+        bool set_contains(const flat_hash_set<T, Hash, KeyEq, ByRef>& set, const K& value)
+        {
+            return set.contains(value);
+        }
+
+        // Keeps the distinct elements which are contained in the set of the second enumerable, or which are not.
+        template <typename It, typename Set, typename Hash, typename KeyEq, bool Contained>
+        class hash_probe_iterator_impl
+        {
+        private:
+            using value_type = typename std::iterator_traits<It>::value_type;
+
+            // The set of the second enumerable is shared by the copies of the iterator.
+            std::shared_ptr<const Set> m_lookup;
+            flat_hash_set<value_type, Hash, KeyEq, is_stable_reference_v<It>> m_set;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            hash_probe_iterator_impl(It begin, It end, std::shared_ptr<const Set> lookup)
+                : m_lookup(std::move(lookup)), m_begin(std::move(begin)), m_end(std::move(end))
+            {
+                move_next();
+            }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    auto&& item = *m_begin;
+                    if (set_contains(*m_lookup, item) == Contained && m_set.insert(item))
+                        break;
+                }
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Set, typename Hash, typename KeyEq, bool Contained>
+        using hash_probe_iterator = iterator_base<hash_probe_iterator_impl<It, Set, Hash, KeyEq, Contained>>;
+
+        template <typename T>
+        inline constexpr bool is_shared_ptr_v{ false };
+
+        template <typename T>
+        inline constexpr bool is_shared_ptr_v<std::shared_ptr<T>>{ true };
+
+        // A lookup is probed by its keys. The elements of other enumerable are collected into a flat hash set,
+        // by pointers only if the temporary container is owned by the stage, and its elements are stable; the set keeps the container alive.
+        // The elements of an lvalue container are copied, so that it could be changed after the query is applied.
+        template <typename Hash, typename KeyEq, typename Captured2>
+        auto make_hash_probe_set(const Captured2& captured2)
+        {
+            auto&& c2 = unwrap_container(captured2);
+            if constexpr (is_lookup_v<std::decay_t<decltype(c2)>>)
+                return c2.index();
+            else
+            {
+                using It2 = decltype(std::begin(c2));
+                constexpr bool by_ref = is_shared_ptr_v<Captured2> && is_stable_reference_v<It2>;
+                using set_type = flat_hash_set<typename std::iterator_traits<It2>::value_type, Hash, KeyEq, by_ref>;
+                if constexpr (by_ref)
+                {
+                    auto holder = std::make_shared<const std::pair<Captured2, set_type>>(std::piecewise_construct, std::forward_as_tuple(captured2),
+                                                                                          std::forward_as_tuple(std::begin(c2), std::end(c2), known_size(c2)));
+                    return std::shared_ptr<const set_type>{ holder, &holder->second };
+                }
+                else
+                    return std::make_shared<const set_type>(std::begin(c2), std::end(c2), known_size(c2));
+            }
+        }
+
+        template <bool Contained, typename Hash, typename KeyEq, typename Container, typename Captured2>
+        auto make_hash_probe(Container&& container, const Captured2& captured2)
+        {
+            using It = decltype(std::begin(container));
+            auto set = make_hash_probe_set<Hash, KeyEq>(captured2);
+            using Set = std::remove_const_t<typename decltype(set)::element_type>;
+            return iterable{ hash_probe_iterator<It, Set, Hash, KeyEq, Contained>{ iterator_ctor, std::begin(container), std::end(container), std::move(set) } };
+        }
+    } // namespace impl
+
+    // Produces the set intersection of two enumerable with flat hash sets.
+    // The elements of the first one could be of another type, like string_view, if the hasher and the equality accept them.
+    // The second one is collected when the query is applied; later changes to it are not seen.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename C2>
+    constexpr auto hash_intersect(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) { return impl::make_hash_probe<true, Hash, KeyEq>(container, captured2); },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    // Produces the set difference of two enumerable with flat hash sets.
+    // The elements of the first one could be of another type, like string_view, if the hasher and the equality accept them.
+    // The second one is collected when the query is applied; later changes to it are not seen.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename C2>
+    constexpr auto hash_except(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) { return impl::make_hash_probe<false, Hash, KeyEq>(container, captured2); },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    namespace impl
+    {
+        // Skips the elements equivalent to the value, at the front of a sorted range.
+        template <typename It, typename T, typename Comparer>
+        void skip_equivalent(It& begin, const It& end, const T& value, Comparer& comp)
+        {
+            while (begin != end && !comp(value, *begin))
+                ++begin;
+        }
+
+        // Calls the function with the current element, which stays valid when the iterator is incremented in it:
+        // the stable element itself, or a copy of its value.
+        template <typename It, typename Func>
+        void with_current(const It& it, Func&& func)
+        {
+            if constexpr (is_stable_reference_v<It>)
+                func(*it);
+            else
+            {
+                const typename std::iterator_traits<It>::value_type current(*it);
+                func(current);
+            }
+        }
+
+        template <typename It, typename Comparer>
+        class distinct_sorted_iterator_impl
+        {
+        private:
+            It m_begin, m_end;
+            Comparer m_comp{};
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            distinct_sorted_iterator_impl(It begin, It end) : m_begin(std::move(begin)), m_end(std::move(end)) {}
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                with_current(m_begin, [this](const auto& current) {
+                    ++m_begin;
+                    skip_equivalent(m_begin, m_end, current, m_comp);
+                });
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename Comparer>
+        using distinct_sorted_iterator = iterator_base<distinct_sorted_iterator_impl<It, Comparer>>;
+    } // namespace impl
+
+    // Returns distinct elements from an enumerable sorted in the order of the comparer, by skipping the adjacent equivalent ones.
+    template <typename Comparer = std::less<void>>
+    constexpr auto distinct_sorted()
+    {
+        return impl::make_query(
+            [](auto&& container) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::distinct_sorted_iterator<It, Comparer>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
+            });
+    }
+
+    namespace impl
+    {
+        template <typename It1, typename It2, typename Comparer>
+        class union_sorted_iterator_impl
+        {
+        private:
+            using value_type = std::common_type_t<typename std::iterator_traits<It1>::value_type, typename std::iterator_traits<It2>::value_type>;
+
+            It1 m_begin1, m_end1;
+            It2 m_begin2, m_end2;
+            Comparer m_comp{};
+
+            // The first enumerable takes the equivalent elements.
+            bool is_first() const { return m_begin1 != m_end1 && (m_begin2 == m_end2 || !m_comp(*m_begin2, *m_begin1)); }
+
+        public:
+            using traits_type = common_impl_traits<value_type, typename std::iterator_traits<It1>::reference, typename std::iterator_traits<It2>::reference>;
+
+            union_sorted_iterator_impl(It1 begin1, It1 end1, It2 begin2, It2 end2)
+                : m_begin1(std::move(begin1)), m_end1(std::move(end1)), m_begin2(std::move(begin2)), m_end2(std::move(end2))
+            {
+            }
+
+            typename traits_type::reference value() { return is_first() ? *m_begin1 : *m_begin2; }
+
+            void move_next()
+            {
+                if (is_first())
+                {
+                    with_current(m_begin1, [this](const auto& current) {
+                        ++m_begin1;
+                        skip_equivalent(m_begin1, m_end1, current, m_comp);
+                        skip_equivalent(m_begin2, m_end2, current, m_comp);
+                    });
+                }
+                else
+                {
+                    with_current(m_begin2, [this](const auto& current) {
+                        ++m_begin2;
+                        skip_equivalent(m_begin2, m_end2, current, m_comp);
+                    });
+                }
+            }
+
+            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+        };
+
+        template <typename It1, typename It2, typename Comparer>
+        using union_sorted_iterator = iterator_base<union_sorted_iterator_impl<It1, It2, Comparer>>;
+    } // namespace impl
+
+    // Produces the set union of two enumerable sorted in the order of the comparer, in one pass with O(1) memory.
+    template <typename Comparer = std::less<void>, typename Container2>
+    constexpr auto union_sorted(Container2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It1 = decltype(std::begin(container));
+                using It2 = decltype(std::begin(c2));
+                return impl::iterable{ impl::union_sorted_iterator<It1, It2, Comparer>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
+            },
+            impl::capture_container(std::forward<Container2>(c2)));
+    }
+
+    namespace impl
+    {
+        // Keeps the distinct elements of a sorted enumerable which are contained in another sorted enumerable, or which are not.
+        template <typename It, typename It2, typename Comparer, bool Contained>
+        class sorted_probe_iterator_impl
+        {
+        private:
+            It m_begin, m_end;
+            It2 m_begin2, m_end2;
+            Comparer m_comp{};
+
+            void skip_current()
+            {
+                with_current(m_begin, [this](const auto& current) {
+                    ++m_begin;
+                    skip_equivalent(m_begin, m_end, current, m_comp);
+                });
+            }
+
+            void seek()
+            {
+                while (m_begin != m_end)
+                {
+                    while (m_begin2 != m_end2 && m_comp(*m_begin2, *m_begin))
+                        ++m_begin2;
+                    bool contained = m_begin2 != m_end2 && !m_comp(*m_begin, *m_begin2);
+                    if (contained == Contained) return;
+                    if (Contained && m_begin2 == m_end2)
+                        m_begin = m_end;
+                    else
+                        skip_current();
+                }
+            }
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+
+            sorted_probe_iterator_impl(It begin, It end, It2 begin2, It2 end2)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_begin2(std::move(begin2)), m_end2(std::move(end2))
+            {
+                seek();
+            }
+
+            typename traits_type::reference value() { return *m_begin; }
+
+            void move_next()
+            {
+                skip_current();
+                seek();
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename It, typename It2, typename Comparer, bool Contained>
+        using sorted_probe_iterator = iterator_base<sorted_probe_iterator_impl<It, It2, Comparer, Contained>>;
+
+        template <bool Contained, typename Comparer, typename Container, typename Captured2>
+        auto make_sorted_probe(Container&& container, Captured2&& captured2)
+        {
+            auto&& c2 = unwrap_container(captured2);
+            using It = decltype(std::begin(container));
+            using It2 = decltype(std::begin(c2));
+            return iterable{ sorted_probe_iterator<It, It2, Comparer, Contained>{ iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
+        }
+    } // namespace impl
+
+    // Produces the set intersection of two enumerable sorted in the order of the comparer, in one pass with O(1) memory.
+    template <typename Comparer = std::less<void>, typename C2>
+    constexpr auto intersect_sorted(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) { return impl::make_sorted_probe<true, Comparer>(container, captured2); },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    // Produces the set difference of two enumerable sorted in the order of the comparer, in one pass with O(1) memory.
+    template <typename Comparer = std::less<void>, typename C2>
+    constexpr auto except_sorted(C2&& c2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2) { return impl::make_sorted_probe<false, Comparer>(container, captured2); },
+            impl::capture_container(std::forward<C2>(c2)));
+    }
+
+    namespace impl
+    {
+        template <typename Comparer, typename... Its>
+        class merge_sorted_iterator_impl
+        {
+        private:
+            static constexpr std::size_t segment_count{ sizeof...(Its) };
+
+            std::tuple<std::pair<Its, Its>...> m_segments;
+            // The segment with the least front element, and segment_count if all are empty.
+            std::size_t m_index{ segment_count };
+            Comparer m_comp{};
+
+            // Calls func with the index of the current segment as a constant.
+            template <std::size_t I = 0, typename Func>
+            decltype(auto) visit(Func&& func) const
+            {
+                if constexpr (I + 1 < segment_count)
+                {
+                    if (m_index != I) return visit<I + 1>(std::forward<Func>(func));
+                }
+                return func(std::integral_constant<std::size_t, I>{});
+            }
+
+            // The earlier segment takes the equivalent elements, so the merge is stable.
+            template <std::size_t I>
+            void consider()
+            {
+                auto& [begin, end] = std::get<I>(m_segments);
+                if (begin != end && (m_index == segment_count || m_comp(*begin, value())))
+                    m_index = I;
+            }
+
+            template <std::size_t... Is>
+            void seek_least(std::index_sequence<Is...>)
+            {
+                m_index = segment_count;
+                (consider<Is>(), ...);
+            }
+
+        public:
+            using traits_type = common_impl_traits<
+                std::common_type_t<typename std::iterator_traits<Its>::value_type...>,
+                typename std::iterator_traits<Its>::reference...>;
+
+            merge_sorted_iterator_impl(std::pair<Its, Its>... segments) : m_segments(std::move(segments)...) { seek_least(std::index_sequence_for<Its...>{}); }
+
+            typename traits_type::reference value() const
+            {
+                return visit([this](auto i) -> typename traits_type::reference { return *std::get<decltype(i)::value>(m_segments).first; });
+            }
+
+            void move_next()
+            {
+                visit([this](auto i) { ++std::get<decltype(i)::value>(m_segments).first; });
+                seek_least(std::index_sequence_for<Its...>{});
+            }
+
+            bool is_valid() const noexcept { return m_index < segment_count; }
+        };
+
+        template <typename Comparer, typename... Its>
+        using merge_sorted_iterator = iterator_base<merge_sorted_iterator_impl<Comparer, Its...>>;
+    } // namespace impl
+
+    // Merges the enumerables sorted in the order of the comparer into one sorted enumerable, keeping all elements.
+    // The fronts of the enumerables are compared on each step, so it is for a few enumerables.
+    template <typename Comparer = std::less<void>, typename Container2, typename... Containers>
+    constexpr auto merge_sorted(Container2&& container2, Containers&&... containers)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&&... captured) {
+                return [&](auto&&... cs) {
+                    return impl::iterable{ impl::merge_sorted_iterator<Comparer, decltype(std::begin(container)), decltype(std::begin(cs))...>{
+                                               impl::iterator_ctor, impl::make_segment(container), impl::make_segment(cs)... },
+                                           impl::add_known_size(impl::fixed_size(container), impl::fixed_size(cs)...) };
+                }(impl::unwrap_container(captured)...);
+            },
+            impl::capture_container(std::forward<Container2>(container2)), impl::capture_container(std::forward<Containers>(containers))...);
+    }
+
+    namespace impl
+    {
+        template <typename TKey, typename TElement, typename ResultSelector, typename Comparer>
+        class group_iterator_impl
+        {
+        private:
+            using lookup_type = std::map<TKey, std::vector<TElement>, Comparer>;
+
+            // The lookup is shared by the copies of the iterator.
+            std::shared_ptr<const lookup_type> m_lookup;
+            typename lookup_type::const_iterator m_begin, m_end;
+            std::decay_t<ResultSelector> m_rstsel;
+
+            using result_type = decltype(m_rstsel(m_begin->first, m_begin->second));
+            std::optional<result_type> m_result{};
+
+            void set_result()
+            {
+                if (m_begin != m_end)
+                {
+                    m_result = m_rstsel(m_begin->first, m_begin->second);
+                }
+            }
+
+        public:
+            using traits_type = iterator_impl_traits<result_type>;
+
+            template <typename It, typename KeySelector, typename ElementSelector>
+            group_iterator_impl(It begin, It end, KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel) : m_rstsel(std::forward<ResultSelector>(rstsel))
+            {
+                auto lookup = std::make_shared<lookup_type>();
+                for (; begin != end; ++begin)
+                {
+                    (*lookup)[keysel(*begin)].emplace_back(elesel(*begin));
+                }
+                m_lookup = std::move(lookup);
+                m_begin = m_lookup->begin();
+                m_end = m_lookup->end();
+                set_result();
+            }
+
+            typename traits_type::reference value() { return *m_result; }
+
+            void move_next()
+            {
+                ++m_begin;
+                set_result();
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+        };
+
+        template <typename TKey, typename TElement, typename ResultSelector, typename Comparer>
+        using group_iterator = iterator_base<group_iterator_impl<TKey, TElement, ResultSelector, Comparer>>;
+    } // namespace impl
+
+    // Groups the elements according to a specified key selector function and creates a result value from each group and its key.
+    // Key values are compared by using a specified comparer, and the elements of each group are projected by using a specified function.
+    template <typename Comparer = std::less<void>, typename KeySelector, typename ElementSelector, typename ResultSelector>
+    constexpr auto group(KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& rstsel) {
+                using TKey = std::remove_reference_t<decltype(keysel(*std::begin(container)))>;
+                using TElement = std::remove_reference_t<decltype(elesel(*std::begin(container)))>;
+                return impl::iterable{ impl::group_iterator<TKey, TElement, decltype(rstsel), Comparer>{
+                    impl::iterator_ctor,
+                    std::begin(container), std::end(container),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(elesel)>(elesel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), std::forward<ResultSelector>(rstsel));
+    }
+
+    namespace impl
+    {
+        template <typename TKey, typename TElement, typename ResultSelector, typename Hash, typename KeyEq>
+        class hash_group_iterator_impl
+        {
+        private:
+            using lookup_type = flat_lookup<TKey, TElement, Hash, KeyEq>;
+
+            // The lookup is shared by the copies of the iterator.
+            std::shared_ptr<const lookup_type> m_lookup;
+            std::size_t m_index{ 0 };
+            std::decay_t<ResultSelector> m_rstsel;
+
+            using result_type = decltype(m_rstsel(m_lookup->key(0), m_lookup->group(0)));
+            std::optional<result_type> m_result{};
+
+            void set_result()
+            {
+                if (m_index < m_lookup->size())
+                {
+                    m_result = m_rstsel(m_lookup->key(m_index), m_lookup->group(m_index));
+                }
+            }
+
+        public:
+            using traits_type = iterator_impl_traits<result_type>;
+
+            template <typename Container, typename KeySelector, typename ElementSelector>
+            hash_group_iterator_impl(Container&& container, KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel)
+                : m_lookup(std::make_shared<const lookup_type>(std::begin(container), std::end(container), keysel, elesel, known_size(container))), m_rstsel(std::forward<ResultSelector>(rstsel))
+            {
+                set_result();
+            }
+
+            typename traits_type::reference value() { return *m_result; }
+
+            void move_next()
+            {
+                ++m_index;
+                set_result();
+            }
+
+            bool is_valid() const { return m_index < m_lookup->size(); }
+        };
+
+        template <typename TKey, typename TElement, typename ResultSelector, typename Hash, typename KeyEq>
+        using hash_group_iterator = iterator_base<hash_group_iterator_impl<TKey, TElement, ResultSelector, Hash, KeyEq>>;
+    } // namespace impl
+
+    // Groups the elements like group, but finds the keys in a hash table.
+    // The groups are in the order of the first appearance of their keys, and the elements of a group are passed as a contiguous enumerable.
+    // Use group when the groups should be sorted by the keys.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename KeySelector, typename ElementSelector, typename ResultSelector>
+    constexpr auto hash_group(KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& rstsel) {
+                using TKey = std::decay_t<decltype(keysel(*std::begin(container)))>;
+                using TElement = std::decay_t<decltype(elesel(*std::begin(container)))>;
+                return impl::iterable{ impl::hash_group_iterator<TKey, TElement, decltype(rstsel), Hash, KeyEq>{
+                    impl::iterator_ctor, container,
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(elesel)>(elesel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), std::forward<ResultSelector>(rstsel));
+    }
+
+    namespace impl
+    {
+        // One accumulator for each key, found in a hash table. The elements are folded into it without being buffered.
+        template <typename TKey, typename TAcc, typename Hash, typename KeyEq>
+        class group_accumulator
+        {
+        private:
+            flat_hash_index<TKey, Hash, KeyEq> m_index;
+            std::vector<TAcc> m_accs;
+
+            // A fold returning void updates the accumulator in place, otherwise the result replaces it.
+            template <typename Fold, typename Item>
+            static void fold_into(TAcc& acc, Fold& fold, Item&& item)
+            {
+                if constexpr (std::is_void_v<decltype(fold(acc, std::forward<Item>(item)))>)
+                    fold(acc, std::forward<Item>(item));
+                else
+                    acc = fold(acc, std::forward<Item>(item));
+            }
+
+        public:
+            template <typename K, typename Fold, typename Item>
+            void add(K&& key, const TAcc& seed, Fold& fold, Item&& item)
+            {
+                auto [index, inserted] = m_index.insert(std::forward<K>(key));
+                if (inserted) m_accs.emplace_back(seed);
+                fold_into(m_accs[index], fold, std::forward<Item>(item));
+            }
+
+            // Combines the accumulators of a later part. The new keys keep their order after the existing ones.
+            template <typename Combine>
+            void merge(group_accumulator&& other, Combine& combine)
+            {
+                auto keys = std::move(other.m_index).extract_keys();
+                for (std::size_t i = 0; i < keys.size(); i++)
+                {
+                    auto [index, inserted] = m_index.insert(std::move(keys[i]));
+                    if (inserted)
+                        m_accs.emplace_back(std::move(other.m_accs[i]));
+                    else
+                        m_accs[index] = combine(m_accs[index], other.m_accs[i]);
+                }
+            }
+
+            std::vector<std::pair<TKey, TAcc>> results() &&
+            {
+                auto keys = std::move(m_index).extract_keys();
+                std::vector<std::pair<TKey, TAcc>> result;
+                result.reserve(keys.size());
+                for (std::size_t i = 0; i < keys.size(); i++)
+                    result.emplace_back(std::move(keys[i]), std::move(m_accs[i]));
+                return result;
+            }
+        };
 
-        template <typename It1, typename It2, typename Comparer>
-        using union_set_iterator = iterator_base<union_set_iterator_impl<It1, It2, Comparer>>;
+        template <typename Hash, typename KeyEq, typename Container, typename KeySelector, typename T, typename Fold, typename Combine>
+        auto group_aggregate(Container&& container, KeySelector& keysel, const T& seed, Fold& fold, Combine* combine)
+        {
+            using TKey = std::decay_t<decltype(keysel(*std::begin(container)))>;
+            using accumulator_type = group_accumulator<TKey, T, Hash, KeyEq>;
+            if constexpr (is_parallel_v<std::decay_t<Container>> && !std::is_void_v<Combine>)
+            {
+                auto parts = map_chunks(container, [&](auto& begin, const auto& end, std::size_t) {
+                    accumulator_type acc;
+                    push_range(begin, end, [&](auto&& item) {
+                        acc.add(keysel(item), seed, fold, item);
+                        return true;
+                    });
+                    return acc;
+                });
+                accumulator_type result;
+                for (auto& part : parts)
+                    result.merge(std::move(*part.value), *combine);
+                return std::move(result).results();
+            }
+            else
+            {
+                accumulator_type result;
+                push_each(container, [&](auto&& item) {
+                    result.add(keysel(item), seed, fold, item);
+                    return true;
+                });
+                return std::move(result).results();
+            }
+        }
     } // namespace impl
 
-    // Produces the set union of two enumerable.
-    template <typename Comparer = std::less<void>, typename Container2>
-    constexpr auto union_set(Container2&& c2)
+    // Folds the elements of each key into an accumulator starting from the seed, without keeping the elements.
+    // The fold could update the accumulator in place, or return the new one.
+    // It returns the keys with their accumulators, in the order of the first appearance of the keys.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename KeySelector, typename T, typename Fold>
+    constexpr auto group_aggregate(KeySelector&& keysel, T&& seed, Fold&& fold)
     {
-        return [&](auto&& container) {
-            using It1 = decltype(std::begin(container));
-            using It2 = decltype(std::begin(c2));
-            return impl::iterable{ impl::union_set_iterator<It1, It2, Comparer>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& seed, auto&& fold) {
+                return impl::group_aggregate<Hash, KeyEq>(container, keysel, seed, fold, static_cast<void*>(nullptr));
+            },
+            std::forward<KeySelector>(keysel), std::forward<T>(seed), std::forward<Fold>(fold));
+    }
+
+    // When it runs by chunks, each chunk keeps its own accumulators,
+    // and the accumulators of a key are combined in order, so the seed should be the identity of the combiner.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename KeySelector, typename T, typename Fold, typename Combine>
+    constexpr auto group_aggregate(KeySelector&& keysel, T&& seed, Fold&& fold, Combine&& combine)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& seed, auto&& fold, auto&& combine) {
+                return impl::group_aggregate<Hash, KeyEq>(container, keysel, seed, fold, std::addressof(combine));
+            },
+            std::forward<KeySelector>(keysel), std::forward<T>(seed), std::forward<Fold>(fold), std::forward<Combine>(combine));
     }
 
     namespace impl
     {
-        template <typename It, typename Comparer>
-        class intersect_iterator_impl
+        // The inner side of a join in an ordered map, used when a comparer is specified.
+        template <typename TKey, typename TElement, typename Comparer>
+        class map_join_lookup
         {
         private:
-            using value_type = typename std::iterator_traits<It>::value_type;
-
-            std::set<value_type, Comparer> m_set;
-            It m_begin, m_end;
+            std::map<TKey, std::vector<TElement>, Comparer> m_map;
 
         public:
-            using traits_type = std::iterator_traits<It>;
-
-            template <typename It2>
-            intersect_iterator_impl(It begin, It end, It2 begin2, It2 end2) : m_set(begin2, end2), m_begin(begin), m_end(end)
-            {
-                move_next();
-            }
-
-            typename traits_type::reference value() { return *m_begin; }
+            using group_type = const std::vector<TElement>&;
 
-            void move_next()
+            template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2>
+            map_join_lookup(It, It, It2 begin2, It2 end2, KeySelector&, KeySelector2& keysel2, ElementSelector2& elesel2, std::optional<std::size_t>, std::optional<std::size_t>)
             {
-                for (; m_begin != m_end; ++m_begin)
+                for (; begin2 != end2; ++begin2)
                 {
-                    if (m_set.erase(*m_begin))
-                        break;
+                    auto&& item = *begin2;
+                    m_map[keysel2(item)].emplace_back(elesel2(item));
                 }
             }
 
-            bool is_valid() const { return m_begin != m_end; }
+            template <typename K>
+            group_type find(const K& key) const
+            {
+                static const std::vector<TElement> empty{};
+                auto it = m_map.find(key);
+                return it == m_map.end() ? empty : it->second;
+            }
         };
 
-        template <typename It, typename Comparer>
-        using intersect_iterator = iterator_base<intersect_iterator_impl<It, Comparer>>;
-    } // namespace impl
+        template <typename TKey, typename TElement, typename Comparer, typename Hash, typename KeyEq>
+        struct join_lookup
+        {
+            using type = map_join_lookup<TKey, TElement, Comparer>;
+        };
 
-    // Produces the set intersection of two enumerable.
-    template <typename Comparer = std::less<void>, typename C2>
-    constexpr auto intersect(C2&& c2)
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::intersect_iterator<It, Comparer>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
+        // A void comparer means the hash join, if the hasher could hash the keys; otherwise the keys are ordered by std::less.
+        template <typename TKey, typename TElement, typename Hash, typename KeyEq>
+        struct join_lookup<TKey, TElement, void, Hash, KeyEq>
+        {
+            using type = std::conditional_t<std::is_invocable_v<const Hash&, const TKey&>, hash_join_lookup<TKey, TElement, Hash, KeyEq>, map_join_lookup<TKey, TElement, std::less<>>>;
         };
-    }
 
-    namespace impl
-    {
-        template <typename It, typename Comparer>
-        class except_iterator_impl
+        template <typename TKey, typename TElement, typename Comparer, typename Hash, typename KeyEq>
+        using join_lookup_t = typename join_lookup<TKey, TElement, Comparer, Hash, KeyEq>::type;
+
+        template <typename Comparer, typename Hash, typename KeyEq, typename Container, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2>
+        auto make_join_lookup(Container&& container, C2&& c2, KeySelector& keysel, KeySelector2& keysel2, ElementSelector2& elesel2)
         {
-        private:
-            using value_type = typename std::iterator_traits<It>::value_type;
+            using TKey = std::decay_t<decltype(keysel2(*std::begin(c2)))>;
+            using TElement = std::decay_t<decltype(elesel2(*std::begin(c2)))>;
+            return std::make_shared<const join_lookup_t<TKey, TElement, Comparer, Hash, KeyEq>>(
+                std::begin(container), std::end(container), std::begin(c2), std::end(c2), keysel, keysel2, elesel2, known_size(container), known_size(c2));
+        }
 
-            std::set<value_type, Comparer> m_set;
+        template <typename It, typename Lookup, typename KeySelector, typename ResultSelector>
+        class group_join_iterator_impl
+        {
+        private:
             It m_begin, m_end;
+            // The lookup is shared by the copies of the iterator.
+            std::shared_ptr<const Lookup> m_lookup;
+            std::decay_t<KeySelector> m_keysel;
+            std::decay_t<ResultSelector> m_rstsel;
+
+            using result_type = decltype(m_rstsel(*m_begin, std::declval<typename Lookup::group_type>()));
+            std::optional<result_type> m_result;
+
+            void set_result()
+            {
+                if (m_begin != m_end)
+                {
+                    auto&& item = *m_begin;
+                    m_result = m_rstsel(item, m_lookup->find(m_keysel(item)));
+                }
+            }
 
         public:
-            using traits_type = std::iterator_traits<It>;
+            using traits_type = iterator_impl_traits<result_type>;
 
-            template <typename It2>
-            except_iterator_impl(It begin, It end, It2 begin2, It2 end2) : m_set(begin2, end2), m_begin(begin), m_end(end)
+            group_join_iterator_impl(It begin, It end, std::shared_ptr<const Lookup> lookup, KeySelector&& keysel, ResultSelector&& rstsel)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_lookup(std::move(lookup)), m_keysel(std::forward<KeySelector>(keysel)), m_rstsel(std::forward<ResultSelector>(rstsel))
             {
-                move_next();
+                set_result();
             }
 
-            typename traits_type::reference value() { return *m_begin; }
+            typename traits_type::reference value() { return *m_result; }
 
             void move_next()
             {
-                for (; m_begin != m_end; ++m_begin)
-                {
-                    if (m_set.emplace(*m_begin).second)
-                        break;
-                }
+                ++m_begin;
+                set_result();
             }
 
             bool is_valid() const { return m_begin != m_end; }
         };
 
-        template <typename It, typename Comparer>
-        using except_iterator = iterator_base<except_iterator_impl<It, Comparer>>;
+        template <typename It, typename Lookup, typename KeySelector, typename ResultSelector>
+        using group_join_iterator = iterator_base<group_join_iterator_impl<It, Lookup, KeySelector, ResultSelector>>;
     } // namespace impl
 
-    // Produces the set difference of two enumerable.
-    template <typename Comparer = std::less<void>, typename C2>
-    constexpr auto except(C2&& c2)
+    // Correlates the elements of two enumerable based on matching keys and groups the results.
+    // By default it is a hash join, and the groups are passed as contiguous ranges;
+    // with a comparer, it looks up an ordered map instead, and the groups are vectors.
+    template <typename Comparer = void, typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
+    constexpr auto group_join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::except_iterator<It, Comparer>{ impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& captured2, auto&& keysel, auto&& keysel2, auto&& elesel2, auto&& rstsel) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                auto lookup = impl::make_join_lookup<Comparer, Hash, KeyEq>(container, c2, keysel, keysel2, elesel2);
+                using Lookup = typename decltype(lookup)::element_type;
+                return impl::iterable{ impl::group_join_iterator<It, std::remove_const_t<Lookup>, decltype(keysel), decltype(rstsel)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::move(lookup),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)), std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2), std::forward<ResultSelector>(rstsel));
+    }
+
+    // Correlates the elements with the groups of a lookup, whose keys and elements are selected when it is built.
+    template <typename TKey, typename TElement, typename Hash, typename KeyEq, typename KeySelector, typename ResultSelector>
+    constexpr auto group_join(const lookup<TKey, TElement, Hash, KeyEq>& l, KeySelector&& keysel, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& l, auto&& keysel, auto&& rstsel) {
+                using It = decltype(std::begin(container));
+                using Lookup = typename lookup<TKey, TElement, Hash, KeyEq>::index_type;
+                return impl::iterable{ impl::group_join_iterator<It, Lookup, decltype(keysel), decltype(rstsel)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), l.index(),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            l, std::forward<KeySelector>(keysel), std::forward<ResultSelector>(rstsel));
     }
 
     namespace impl
     {
-        template <typename TKey, typename TElement, typename ResultSelector, typename Comparer>
-        class group_iterator_impl
+        template <typename It, typename Lookup, typename KeySelector, typename ResultSelector>
+        class join_iterator_impl
         {
         private:
-            std::map<TKey, std::vector<TElement>, Comparer> m_lookup;
-            typename std::map<TKey, std::vector<TElement>, Comparer>::iterator m_begin, m_end;
+            using inner_iterator = decltype(std::begin(std::declval<typename Lookup::group_type>()));
+
+            It m_begin, m_end;
+            // The lookup is shared by the copies of the iterator.
+            std::shared_ptr<const Lookup> m_lookup;
+            inner_iterator m_inner_begin{}, m_inner_end{};
+            std::decay_t<KeySelector> m_keysel;
             std::decay_t<ResultSelector> m_rstsel;
 
-            using result_type = decltype(m_rstsel(m_begin->first, m_lookup[m_begin->first]));
-            std::optional<result_type> m_result{};
+            using result_type = decltype(m_rstsel(*m_begin, *m_inner_begin));
+            std::optional<result_type> m_result;
 
-            void set_result()
+            void set_inner()
             {
-                if (m_begin != m_end)
+                for (; m_begin != m_end; ++m_begin)
                 {
-                    auto& f = m_begin->first;
-                    m_result = m_rstsel(f, m_lookup[f]);
+                    auto&& group = m_lookup->find(m_keysel(*m_begin));
+                    m_inner_begin = std::begin(group);
+                    m_inner_end = std::end(group);
+                    if (m_inner_begin != m_inner_end) return;
                 }
+                m_inner_begin = m_inner_end;
+            }
+
+            void set_result()
+            {
+                if (m_inner_begin != m_inner_end)
+                    m_result = m_rstsel(*m_begin, *m_inner_begin);
             }
 
         public:
             using traits_type = iterator_impl_traits<result_type>;
 
-            template <typename It, typename KeySelector, typename ElementSelector>
-            group_iterator_impl(It begin, It end, KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel) : m_rstsel(std::forward<ResultSelector>(rstsel))
+            join_iterator_impl(It begin, It end, std::shared_ptr<const Lookup> lookup, KeySelector&& keysel, ResultSelector&& rstsel)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_lookup(std::move(lookup)), m_keysel(std::forward<KeySelector>(keysel)), m_rstsel(std::forward<ResultSelector>(rstsel))
             {
-                for (; begin != end; ++begin)
-                {
-                    m_lookup[keysel(*begin)].emplace_back(elesel(*begin));
-                }
-                m_begin = m_lookup.begin();
-                m_end = m_lookup.end();
+                set_inner();
                 set_result();
             }
 
@@ -916,66 +2782,345 @@ namespace linq
 
             void move_next()
             {
-                ++m_begin;
+                ++m_inner_begin;
+                if (m_inner_begin == m_inner_end)
+                {
+                    ++m_begin;
+                    set_inner();
+                }
                 set_result();
             }
 
-            bool is_valid() const { return m_begin != m_end; }
+            bool is_valid() const { return m_inner_begin != m_inner_end; }
         };
 
-        template <typename TKey, typename TElement, typename ResultSelector, typename Comparer>
-        using group_iterator = iterator_base<group_iterator_impl<TKey, TElement, ResultSelector, Comparer>>;
+        template <typename It, typename Lookup, typename KeySelector, typename ResultSelector>
+        using join_iterator = iterator_base<join_iterator_impl<It, Lookup, KeySelector, ResultSelector>>;
     } // namespace impl
 
-    // Groups the elements according to a specified key selector function and creates a result value from each group and its key.
-    // Key values are compared by using a specified comparer, and the elements of each group are projected by using a specified function.
-    template <typename Comparer = std::less<void>, typename KeySelector, typename ElementSelector, typename ResultSelector>
-    constexpr auto group(KeySelector&& keysel, ElementSelector&& elesel, ResultSelector&& rstsel)
+    // Correlates the elements of two enumerable based on matching keys.
+    // By default it is a hash join; with a comparer, it looks up an ordered map instead.
+    template <typename Comparer = void, typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
+    constexpr auto join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2, auto&& keysel, auto&& keysel2, auto&& elesel2, auto&& rstsel) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                auto lookup = impl::make_join_lookup<Comparer, Hash, KeyEq>(container, c2, keysel, keysel2, elesel2);
+                using Lookup = typename decltype(lookup)::element_type;
+                return impl::iterable{ impl::join_iterator<It, std::remove_const_t<Lookup>, decltype(keysel), decltype(rstsel)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::move(lookup),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)), std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2), std::forward<ResultSelector>(rstsel));
+    }
+
+    // Correlates the elements with the elements of a lookup, whose keys and elements are selected when it is built.
+    template <typename TKey, typename TElement, typename Hash, typename KeyEq, typename KeySelector, typename ResultSelector>
+    constexpr auto join(const lookup<TKey, TElement, Hash, KeyEq>& l, KeySelector&& keysel, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& l, auto&& keysel, auto&& rstsel) {
+                using It = decltype(std::begin(container));
+                using Lookup = typename lookup<TKey, TElement, Hash, KeyEq>::index_type;
+                return impl::iterable{ impl::join_iterator<It, Lookup, decltype(keysel), decltype(rstsel)>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), l.index(),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            l, std::forward<KeySelector>(keysel), std::forward<ResultSelector>(rstsel));
+    }
+
+    namespace impl
     {
-        return [&](auto&& container) {
-            using TKey = std::remove_reference_t<decltype(keysel(*std::begin(container)))>;
-            using TElement = std::remove_reference_t<decltype(elesel(*std::begin(container)))>;
-            return impl::iterable{ impl::group_iterator<TKey, TElement, ResultSelector, Comparer>{
-                impl::iterator_ctor,
-                std::begin(container), std::end(container),
-                std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), std::forward<ResultSelector>(rstsel) } };
+        // The target size of a partition of the inner rows, so that it fits in the cache with its hash table.
+        inline constexpr std::size_t join_partition_bytes{ 256 * 1024 };
+
+        // The partitions are written in one pass, so the fanout is limited.
+        inline constexpr unsigned join_partition_max_bits{ 12 };
+
+        // The hash is mixed before its top bits are taken as the partition,
+        // because the hash tables in a partition use the top bits of the hash as well.
+        constexpr std::size_t join_partition_of(std::size_t hash, unsigned bits) noexcept
+        {
+            std::uint64_t h = hash;
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53ULL;
+            h ^= h >> 33;
+            return bits ? static_cast<std::size_t>(h >> (64 - bits)) : 0;
+        }
+
+        template <typename Key, typename Value>
+        struct join_row
+        {
+            Key key;
+            Value value;
+        };
+
+        template <typename Row>
+        struct join_partitions
+        {
+            std::vector<Row> rows;
+            // The partition p is [offsets[p], offsets[p + 1]) of the rows.
+            std::vector<std::size_t> offsets;
+            unsigned bits;
         };
+
+        // Partitions the rows of a sequence by the hashes of their keys. The rows keep their order in a partition.
+        // The hashes are counted in the first pass, and a forward sequence is enumerated again to scatter the rows to their partitions,
+        // so that the rows are only written once. The bits of the partitions are chosen by the count and the size of the rows.
+        // The keys are converted to Key before they are hashed and stored, if it is not void.
+        template <typename Hash, typename Key = void, typename Container, typename KeySelector, typename ValueSelector, typename ChooseBits>
+        auto make_join_partitions(Container&& container, KeySelector& keysel, ValueSelector& valsel, ChooseBits&& choose_bits)
+        {
+            using It = decltype(std::begin(container));
+            using TSelected = std::decay_t<decltype(keysel(*std::begin(container)))>;
+            using TKey = std::conditional_t<std::is_void_v<Key>, TSelected, Key>;
+            using TValue = std::decay_t<decltype(valsel(*std::begin(container)))>;
+            using row_type = join_row<TKey, TValue>;
+            constexpr bool two_pass{ std::is_default_constructible_v<row_type> && std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category> };
+            Hash hash{};
+            auto hash_key = [&hash](auto&& key) {
+                if constexpr (std::is_same_v<std::decay_t<decltype(key)>, TKey>)
+                    return hash(key);
+                else
+                    return hash(TKey(std::forward<decltype(key)>(key)));
+            };
+            join_partitions<row_type> result{};
+            std::vector<std::size_t> hashes;
+            if (auto size = known_size(container))
+            {
+                hashes.reserve(*size);
+                if constexpr (!two_pass) result.rows.reserve(*size);
+            }
+            push_each(container, [&](auto&& item) {
+                if constexpr (two_pass)
+                    hashes.push_back(hash_key(keysel(item)));
+                else
+                {
+                    TKey key = keysel(item);
+                    hashes.push_back(hash(key));
+                    result.rows.push_back(row_type{ std::move(key), valsel(item) });
+                }
+                return true;
+            });
+            result.bits = choose_bits(hashes.size(), sizeof(row_type));
+            result.offsets.assign((std::size_t{ 1 } << result.bits) + 1, 0);
+            for (std::size_t& h : hashes)
+            {
+                h = join_partition_of(h, result.bits);
+                result.offsets[h + 1]++;
+            }
+            for (std::size_t i = 1; i < result.offsets.size(); i++)
+                result.offsets[i] += result.offsets[i - 1];
+            std::vector<std::size_t> next(result.offsets.begin(), result.offsets.end() - 1);
+            if constexpr (two_pass)
+            {
+                result.rows.resize(hashes.size());
+                std::size_t i = 0;
+                push_each(container, [&](auto&& item) {
+                    auto& row = result.rows[next[hashes[i++]]++];
+                    row.key = keysel(item);
+                    row.value = valsel(item);
+                    return true;
+                });
+            }
+            else if (result.bits)
+            {
+                std::vector<std::size_t> order(hashes.size());
+                for (std::size_t i = 0; i < hashes.size(); i++)
+                    order[next[hashes[i]]++] = i;
+                std::vector<row_type> rows;
+                rows.reserve(order.size());
+                for (std::size_t i : order)
+                    rows.emplace_back(std::move(result.rows[i]));
+                result.rows = std::move(rows);
+            }
+            return result;
+        }
+
+        template <typename Hash, typename KeyEq, typename Container, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
+        auto radix_join(Container&& container, C2&& c2, KeySelector& keysel, KeySelector2& keysel2, ElementSelector2& elesel2, ResultSelector& rstsel)
+        {
+            auto copy_item = [](const auto& item) { return item; };
+            auto inner = make_join_partitions<Hash>(c2, keysel2, elesel2, [](std::size_t count, std::size_t row_size) {
+                unsigned bits = 0;
+                while (bits < join_partition_max_bits && ((count * row_size) >> bits) > join_partition_bytes)
+                    bits++;
+                return bits;
+            });
+            using inner_row = typename decltype(inner.rows)::value_type;
+            using TKey = decltype(inner_row::key);
+            // The outer keys are hashed as the inner keys, so that the equal keys of different types are in the same partition.
+            using TOuterKey = std::decay_t<decltype(keysel(*std::begin(container)))>;
+            using outer_key = std::conditional_t<is_direct_key_v<TKey, TOuterKey, Hash, KeyEq>, TOuterKey, TKey>;
+            auto outer = make_join_partitions<Hash, outer_key>(container, keysel, copy_item, [&inner](std::size_t, std::size_t) { return inner.bits; });
+            using outer_row = typename decltype(outer.rows)::value_type;
+            using TElement = decltype(inner_row::value);
+            using result_type = std::decay_t<decltype(rstsel(std::declval<decltype(outer_row::value)&>(), std::declval<const TElement&>()))>;
+            const auto& inner_offsets = inner.offsets;
+            const auto& outer_offsets = outer.offsets;
+
+            // The inner rows of a partition are moved into a flat lookup, and the outer rows probe it in order.
+            std::vector<std::vector<result_type>> results(inner_offsets.size() - 1);
+            auto join_partition = [&](std::size_t p) {
+                auto key_of = [](inner_row& row) -> TKey&& { return std::move(row.key); };
+                auto element_of = [](inner_row& row) -> TElement&& { return std::move(row.value); };
+                std::size_t size = inner_offsets[p + 1] - inner_offsets[p];
+                if (!size) return;
+                flat_lookup<TKey, TElement, Hash, KeyEq> lookup{ inner.rows.begin() + inner_offsets[p], inner.rows.begin() + inner_offsets[p + 1], key_of, element_of, size };
+                auto& result = results[p];
+                result.reserve(outer_offsets[p + 1] - outer_offsets[p]);
+                for (std::size_t i = outer_offsets[p]; i < outer_offsets[p + 1]; i++)
+                {
+                    auto& row = outer.rows[i];
+                    std::size_t index = lookup.find(row.key);
+                    if (index == lookup.npos) continue;
+                    for (auto& e : lookup.group(index))
+                        result.emplace_back(rstsel(row.value, e));
+                }
+            };
+            if constexpr (is_parallel_v<std::decay_t<Container>>)
+                parallel_for(results.size(), container.options().threads, join_partition);
+            else
+            {
+                for (std::size_t p = 0; p < results.size(); p++)
+                    join_partition(p);
+            }
+
+            if (results.size() == 1) return std::move(results.front());
+            std::size_t total = 0;
+            for (auto& part : results)
+                total += part.size();
+            std::vector<result_type> result;
+            result.reserve(total);
+            for (auto& part : results)
+                std::move(part.begin(), part.end(), std::back_inserter(result));
+            return result;
+        }
+    } // namespace impl
+
+    // Correlates the elements of two enumerable based on matching keys, with a radix partitioned hash join.
+    // Both sequences are partitioned by the hashes of their keys, so that each partition of the second one fits in the cache,
+    // and the partitions are joined in pairs, on the thread pool if the first sequence is parallel.
+    // It returns a vector in the order of the partitions; in a partition, the results are in the order of join.
+    template <typename Hash = default_hash, typename KeyEq = std::equal_to<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
+    constexpr auto partitioned_join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2, auto&& keysel, auto&& keysel2, auto&& elesel2, auto&& rstsel) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                return impl::radix_join<Hash, KeyEq>(container, c2, keysel, keysel2, elesel2, rstsel);
+            },
+            impl::capture_container(std::forward<C2>(c2)), std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2), std::forward<ResultSelector>(rstsel));
     }
 
+    struct not_sorted : std::logic_error
+    {
+        not_sorted() : logic_error("The sequence is not sorted by the keys.") {}
+    };
+
     namespace impl
     {
-        template <typename It, typename TKey, typename TElement, typename KeySelector, typename ResultSelector, typename Comparer>
-        class group_join_iterator_impl
+        // The run of the elements of a sorted sequence equivalent to a key. The keys should not decrease,
+        // and the run moves forward in lockstep with them, so the run of a repeated key is enumerated again without any buffer.
+        // The order is verified on the elements it meets.
+        template <typename It2, typename TKey, typename KeySelector2, typename Comparer>
+        class merge_join_run
+        {
+        private:
+            It2 m_begin, m_end, m_source_end;
+            std::optional<It2> m_last;
+            std::size_t m_size{ 0 };
+            std::optional<TKey> m_key;
+            std::decay_t<KeySelector2> m_keysel2;
+            Comparer m_comp{};
+
+            void check_order(const It2& it)
+            {
+                if (m_last && m_comp(m_keysel2(*it), m_keysel2(**m_last))) throw not_sorted{};
+                m_last = it;
+            }
+
+        public:
+            merge_join_run(It2 begin, It2 end, KeySelector2&& keysel2)
+                : m_begin(begin), m_end(begin), m_source_end(std::move(end)), m_keysel2(std::forward<KeySelector2>(keysel2))
+            {
+            }
+
+            template <typename K>
+            void seek(K&& key)
+            {
+                if (m_key)
+                {
+                    if (m_comp(key, *m_key)) throw not_sorted{};
+                    if (!m_comp(*m_key, key)) return;
+                }
+                m_begin = m_end;
+                for (; m_begin != m_source_end; ++m_begin)
+                {
+                    check_order(m_begin);
+                    if (!m_comp(m_keysel2(*m_begin), key)) break;
+                }
+                m_end = m_begin;
+                m_size = 0;
+                for (; m_end != m_source_end; ++m_end, ++m_size)
+                {
+                    if (m_size) check_order(m_end);
+                    if (m_comp(key, m_keysel2(*m_end))) break;
+                }
+                m_key.emplace(std::forward<K>(key));
+            }
+
+            const It2& begin() const noexcept { return m_begin; }
+            const It2& end() const noexcept { return m_end; }
+            std::size_t size() const noexcept { return m_size; }
+        };
+
+        template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector, typename Comparer>
+        class merge_join_iterator_impl
         {
         private:
             It m_begin, m_end;
-            std::map<TKey, std::vector<TElement>, Comparer> m_lookup;
-            KeySelector m_keysel;
-            ResultSelector m_rstsel;
+            std::decay_t<KeySelector> m_keysel;
+            merge_join_run<It2, std::decay_t<decltype(m_keysel(*m_begin))>, KeySelector2, Comparer> m_run;
+            It2 m_inner{};
+            std::decay_t<ElementSelector2> m_elesel2;
+            std::decay_t<ResultSelector> m_rstsel;
 
-            using result_type = decltype(m_rstsel(*m_begin, m_lookup[m_keysel(*m_begin)]));
+            using result_type = decltype(m_rstsel(*m_begin, m_elesel2(*m_inner)));
             std::optional<result_type> m_result;
 
-            void set_result()
+            void set_inner()
             {
-                if (m_begin != m_end)
+                for (; m_begin != m_end; ++m_begin)
                 {
-                    auto& item = *m_begin;
-                    m_result = m_rstsel(item, m_lookup[m_keysel(item)]);
+                    m_run.seek(m_keysel(*m_begin));
+                    if (m_run.size())
+                    {
+                        m_inner = m_run.begin();
+                        return;
+                    }
                 }
             }
 
+            void set_result()
+            {
+                if (m_begin != m_end)
+                    m_result = m_rstsel(*m_begin, m_elesel2(*m_inner));
+            }
+
         public:
             using traits_type = iterator_impl_traits<result_type>;
 
-            template <typename It2, typename KeySelector2, typename ElementSelector2>
-            group_join_iterator_impl(It begin, It end, It2 begin2, It2 end2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
-                : m_begin(begin), m_end(end), m_keysel(std::forward<KeySelector>(keysel)), m_rstsel(std::forward<ResultSelector>(rstsel))
+            merge_join_iterator_impl(It begin, It end, It2 begin2, It2 end2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_keysel(std::forward<KeySelector>(keysel)),
+                  m_run(std::move(begin2), std::move(end2), std::forward<KeySelector2>(keysel2)),
+                  m_elesel2(std::forward<ElementSelector2>(elesel2)), m_rstsel(std::forward<ResultSelector>(rstsel))
             {
-                for (; begin2 != end2; ++begin2)
-                {
-                    m_lookup[keysel2(*begin2)].emplace_back(elesel2(*begin2));
-                }
+                set_inner();
                 set_result();
             }
 
@@ -983,70 +3128,54 @@ namespace linq
 
             void move_next()
             {
-                ++m_begin;
+                ++m_inner;
+                if (m_inner == m_run.end())
+                {
+                    ++m_begin;
+                    set_inner();
+                }
                 set_result();
             }
 
             bool is_valid() const { return m_begin != m_end; }
         };
 
-        template <typename It, typename TKey, typename TElement, typename KeySelector, typename ResultSelector, typename Comparer>
-        using group_join_iterator = iterator_base<group_join_iterator_impl<It, TKey, TElement, KeySelector, ResultSelector, Comparer>>;
-    } // namespace impl
-
-    // Correlates the elements of two enumerable based on key comparer and groups the results.
-    template <typename Comparer = std::less<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
-    constexpr auto group_join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using TKey = std::remove_reference_t<decltype(keysel2(*std::begin(c2)))>;
-            using TElement = std::remove_reference_t<decltype(elesel2(*std::begin(c2)))>;
-            return impl::iterable{ impl::group_join_iterator<It, TKey, TElement, KeySelector, ResultSelector, Comparer>{
-                impl::iterator_ctor, std::begin(container), std::end(container),
-                std::begin(c2), std::end(c2),
-                std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2),
-                std::forward<ResultSelector>(rstsel) } };
-        };
-    }
+        template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector, typename Comparer>
+        using merge_join_iterator = iterator_base<merge_join_iterator_impl<It, It2, KeySelector, KeySelector2, ElementSelector2, ResultSelector, Comparer>>;
 
-    namespace impl
-    {
-        template <typename It, typename TKey, typename TElement, typename KeySelector, typename ResultSelector, typename Comparer>
-        class join_iterator_impl
+        template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector, typename Comparer>
+        class merge_group_join_iterator_impl
         {
         private:
             It m_begin, m_end;
-            std::map<TKey, std::vector<TElement>, Comparer> m_lookup;
-            typename std::vector<TElement>::iterator m_inner_begin, m_inner_end;
-            KeySelector m_keysel;
-            ResultSelector m_rstsel;
+            std::decay_t<KeySelector> m_keysel;
+            merge_join_run<It2, std::decay_t<decltype(m_keysel(*m_begin))>, KeySelector2, Comparer> m_run;
+            std::decay_t<ElementSelector2> m_elesel2;
+            std::decay_t<ResultSelector> m_rstsel;
 
-            using result_type = decltype(m_rstsel(*m_begin, *m_inner_begin));
+            // Each group owns a copy of the element selector, so that it outlives the iterator.
+            using group_type = iterable<select_iterator<It2, std::decay_t<ElementSelector2>>>;
+            using result_type = decltype(m_rstsel(*m_begin, std::declval<group_type>()));
             std::optional<result_type> m_result;
 
             void set_result()
             {
                 if (m_begin != m_end)
                 {
-                    auto& vec = m_lookup[m_keysel(*m_begin)];
-                    m_inner_begin = vec.begin();
-                    m_inner_end = vec.end();
-                    m_result = m_rstsel(*m_begin, *m_inner_begin);
+                    auto&& item = *m_begin;
+                    m_run.seek(m_keysel(item));
+                    m_result = m_rstsel(item, group_type{ select_iterator<It2, std::decay_t<ElementSelector2>>{ iterator_ctor, m_run.begin(), m_run.end(), std::decay_t<ElementSelector2>{ m_elesel2 } }, m_run.size() });
                 }
             }
 
         public:
             using traits_type = iterator_impl_traits<result_type>;
 
-            template <typename It2, typename KeySelector2, typename ElementSelector2>
-            join_iterator_impl(It begin, It end, It2 begin2, It2 end2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
-                : m_begin(begin), m_end(end), m_keysel(std::forward<KeySelector>(keysel)), m_rstsel(std::forward<ResultSelector>(rstsel))
+            merge_group_join_iterator_impl(It begin, It end, It2 begin2, It2 end2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_keysel(std::forward<KeySelector>(keysel)),
+                  m_run(std::move(begin2), std::move(end2), std::forward<KeySelector2>(keysel2)),
+                  m_elesel2(std::forward<ElementSelector2>(elesel2)), m_rstsel(std::forward<ResultSelector>(rstsel))
             {
-                for (; begin2 != end2; ++begin2)
-                {
-                    m_lookup[keysel2(*begin2)].emplace_back(elesel2(*begin2));
-                }
                 set_result();
             }
 
@@ -1054,35 +3183,51 @@ namespace linq
 
             void move_next()
             {
-                ++m_inner_begin;
-                if (m_inner_begin == m_inner_end)
-                {
-                    ++m_begin;
-                    set_result();
-                }
+                ++m_begin;
+                set_result();
             }
 
-            bool is_valid() const { return m_begin != m_end || m_inner_begin != m_inner_end; }
+            bool is_valid() const { return m_begin != m_end; }
         };
 
-        template <typename It, typename TKey, typename TElement, typename KeySelector, typename ResultSelector, typename Comparer>
-        using join_iterator = iterator_base<join_iterator_impl<It, TKey, TElement, KeySelector, ResultSelector, Comparer>>;
+        template <typename It, typename It2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector, typename Comparer>
+        using merge_group_join_iterator = iterator_base<merge_group_join_iterator_impl<It, It2, KeySelector, KeySelector2, ElementSelector2, ResultSelector, Comparer>>;
     } // namespace impl
 
-    // Correlates the elements of two enumerable based on matching keys.
+    // Correlates the elements of two enumerable sorted by their keys, like join, but in one pass over both with O(1) memory.
+    // Both should be sorted in the order of the comparer; it throws not_sorted when it meets an element out of order.
     template <typename Comparer = std::less<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
-    constexpr auto join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+    constexpr auto merge_join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            using TKey = std::remove_reference_t<decltype(keysel2(*std::begin(c2)))>;
-            using TElement = std::remove_reference_t<decltype(elesel2(*std::begin(c2)))>;
-            return impl::iterable{ impl::join_iterator<It, TKey, TElement, KeySelector, ResultSelector, Comparer>{
-                impl::iterator_ctor, std::begin(container), std::end(container),
-                std::begin(c2), std::end(c2),
-                std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2),
-                std::forward<ResultSelector>(rstsel) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& captured2, auto&& keysel, auto&& keysel2, auto&& elesel2, auto&& rstsel) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                using It2 = decltype(std::begin(c2));
+                return impl::iterable{ impl::merge_join_iterator<It, It2, decltype(keysel), decltype(keysel2), decltype(elesel2), decltype(rstsel), Comparer>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(keysel2)>(keysel2), std::forward<decltype(elesel2)>(elesel2),
+                    std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)), std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2), std::forward<ResultSelector>(rstsel));
+    }
+
+    // Correlates the elements of two enumerable sorted by their keys and groups the results, like group_join, but in one pass over both with O(1) memory.
+    // The groups are lazy ranges over the second enumerable.
+    template <typename Comparer = std::less<void>, typename C2, typename KeySelector, typename KeySelector2, typename ElementSelector2, typename ResultSelector>
+    constexpr auto merge_group_join(C2&& c2, KeySelector&& keysel, KeySelector2&& keysel2, ElementSelector2&& elesel2, ResultSelector&& rstsel)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& captured2, auto&& keysel, auto&& keysel2, auto&& elesel2, auto&& rstsel) {
+                auto&& c2 = impl::unwrap_container(captured2);
+                using It = decltype(std::begin(container));
+                using It2 = decltype(std::begin(c2));
+                return impl::iterable{ impl::merge_group_join_iterator<It, It2, decltype(keysel), decltype(keysel2), decltype(elesel2), decltype(rstsel), Comparer>{
+                    impl::iterator_ctor, std::begin(container), std::end(container), std::begin(c2), std::end(c2),
+                    std::forward<decltype(keysel)>(keysel), std::forward<decltype(keysel2)>(keysel2), std::forward<decltype(elesel2)>(elesel2),
+                    std::forward<decltype(rstsel)>(rstsel) } };
+            },
+            impl::capture_container(std::forward<C2>(c2)), std::forward<KeySelector>(keysel), std::forward<KeySelector2>(keysel2), std::forward<ElementSelector2>(elesel2), std::forward<ResultSelector>(rstsel));
     }
 } // namespace linq
 
@@ -26,12 +26,33 @@
 #ifndef LINQ_CORE_HPP
 #define LINQ_CORE_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <functional>
+#include <numeric>
 #include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef __cpp_lib_ranges
+#include <ranges>
+#endif // __cpp_lib_ranges
 
 namespace linq
 {
+    // Marks the natural end of an enumerable, so that an iterator could be checked without an end iterator.
+    // The end iterator of a forward enumerable is a copy of its stages moved to the end, while the sentinel is empty.
+    struct sentinel_t
+    {
+    };
+
+    inline constexpr sentinel_t sentinel{};
+
     namespace impl
     {
         template <typename T, typename Ref = const T&, typename Ptr = const T*>
@@ -42,20 +63,342 @@ namespace linq
             using pointer = Ptr;
         };
 
+        // The pointer of an iterator which returns values, holding the value for operator->.
+        template <typename T>
+        class arrow_proxy
+        {
+        private:
+            T m_value;
+
+        public:
+            explicit arrow_proxy(T&& value) : m_value(std::move(value)) {}
+
+            T* operator->() noexcept { return std::addressof(m_value); }
+        };
+
+        // Traits for the implementations which return the result of a function directly.
+        template <typename R>
+        using result_impl_traits = iterator_impl_traits<
+            std::remove_cv_t<std::remove_reference_t<R>>,
+            R,
+            std::conditional_t<std::is_reference_v<R>, std::add_pointer_t<std::remove_reference_t<R>>, arrow_proxy<std::remove_cv_t<R>>>>;
+
+        // Traits for the implementations which return an element from one of several sources.
+        // They return references only if all sources return lvalues of the value type.
+        template <typename T, typename... Refs>
+        using common_impl_traits = std::conditional_t<
+            (std::is_lvalue_reference_v<Refs> && ...) && (std::is_same_v<std::remove_cv_t<std::remove_reference_t<Refs>>, T> && ...),
+            iterator_impl_traits<T>,
+            result_impl_traits<T>>;
+
+        // Gets the weaker one of two iterator categories.
+        template <typename C1, typename C2>
+        using min_iterator_category_t = std::conditional_t<std::is_base_of_v<C1, C2>, C1, C2>;
+
+        // Determines whether the category of an iterator is at least the specified one.
+        template <typename It, typename Category>
+        inline constexpr bool is_iterator_category_v{ std::is_base_of_v<Category, typename std::iterator_traits<It>::iterator_category> };
+
+        // The storage of a cached value, which is empty or holds a value like std::optional.
+        // A trivially copyable value is stored directly with a flag, so that its bytes are always initialized when it is copied.
+        template <typename T, bool Direct = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> && std::is_copy_assignable_v<T>>
+        class cached_value
+        {
+        private:
+            std::optional<T> m_value{};
+
+        public:
+            bool has_value() const noexcept { return m_value.has_value(); }
+
+            template <typename... Args>
+            void emplace(Args&&... args)
+            {
+                m_value.emplace(std::forward<Args>(args)...);
+            }
+
+            T& get() noexcept { return *m_value; }
+
+            void reset() noexcept { m_value.reset(); }
+        };
+
+        template <typename T>
+        class cached_value<T, true>
+        {
+        private:
+            T m_value{};
+            bool m_has_value{ false };
+
+        public:
+            bool has_value() const noexcept { return m_has_value; }
+
+            template <typename... Args>
+            void emplace(Args&&... args)
+            {
+                m_value = T(std::forward<Args>(args)...);
+                m_has_value = true;
+            }
+
+            T& get() noexcept { return m_value; }
+
+            void reset() noexcept { m_has_value = false; }
+        };
+
+        // Caches the result of a function at the current position, so that the function runs once for each element.
+        // The result is returned by copy, so that no reference outlives the iterator.
+        // A result which could not be copied is not cached, and neither is a disabled cache.
+        template <typename R, bool Enabled = true>
+        class result_cache
+        {
+        private:
+            using stored_type = std::conditional_t<std::is_reference_v<R>, std::remove_reference_t<R>*, std::remove_cv_t<R>>;
+
+            static constexpr bool is_cached{ Enabled && std::is_copy_constructible_v<stored_type> };
+
+            cached_value<std::conditional_t<is_cached, stored_type, std::tuple<>>> m_value{};
+
+        public:
+            template <typename Func>
+            R get(Func&& func)
+            {
+                if constexpr (!is_cached)
+                {
+                    return func();
+                }
+                else
+                {
+                    if (!m_value.has_value())
+                    {
+                        if constexpr (std::is_reference_v<R>)
+                        {
+                            R result = func();
+                            m_value.emplace(std::addressof(result));
+                        }
+                        else
+                        {
+                            m_value.emplace(func());
+                        }
+                    }
+                    if constexpr (std::is_reference_v<R>)
+                        return static_cast<R>(*m_value.get());
+                    else
+                        return m_value.get();
+                }
+            }
+
+            void reset() noexcept { m_value.reset(); }
+        };
+
+        // An implementation should provide traits_type, value(), move_next() and is_valid().
+        // It could also declare a stronger iterator_category, and provide:
+        //   forward:       equals(const Impl&), seek_end()
+        //   bidirectional: move_prev()
+        //   random access: advance(difference_type), distance_to(const Impl&)
+        template <typename Impl, typename = void>
+        struct impl_iterator_category
+        {
+            using type = std::input_iterator_tag;
+        };
+
+        template <typename Impl>
+        struct impl_iterator_category<Impl, std::void_t<typename Impl::iterator_category>>
+        {
+            using type = typename Impl::iterator_category;
+        };
+
+        template <typename Impl>
+        using impl_iterator_category_t = typename impl_iterator_category<Impl>::type;
+
+        // A positional implementation keeps its state at the end,
+        // so that it could be compared with, or moved back from the end.
+        // It should be copyable, otherwise the iterator falls back to an input one.
+        template <typename Impl>
+        inline constexpr bool is_positional_impl_v{ std::is_base_of_v<std::forward_iterator_tag, impl_iterator_category_t<Impl>> && std::is_copy_constructible_v<Impl> };
+
+        // An implementation could also provide push(Sink&&), which feeds the rest of the elements to the sink,
+        // until the sink returns false. It returns false if the sink stops it early.
+        struct push_probe
+        {
+            template <typename T>
+            bool operator()(T&&) const;
+        };
+
+        template <typename Impl, typename = void>
+        inline constexpr bool has_push_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool has_push_v<Impl, std::void_t<decltype(std::declval<Impl&>().push(std::declval<push_probe&>()))>>{ true };
+
+        // An implementation could also provide fill(OutIt first, OutIt last), which writes the next elements at once.
+        template <typename Impl, typename OutIt, typename = void>
+        inline constexpr bool has_fill_v{ false };
+
+        template <typename Impl, typename OutIt>
+        inline constexpr bool has_fill_v<Impl, OutIt, std::void_t<decltype(std::declval<const Impl&>().fill(std::declval<OutIt>(), std::declval<OutIt>()))>>{ true };
+
+        // A segmented implementation could also provide push_segments(Sink&&), which feeds the rest of the elements
+        // to the sink as ranges of the underlying iterators, by sink(It& begin, const It& end).
+        struct push_segments_probe
+        {
+            template <typename It>
+            bool operator()(It&, const It&) const;
+        };
+
+        template <typename Impl, typename = void>
+        inline constexpr bool has_push_segments_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool has_push_segments_v<Impl, std::void_t<decltype(std::declval<Impl&>().push_segments(std::declval<push_segments_probe&>()))>>{ true };
+
+        // An implementation could also be constructed unseeked, without seeking its first element,
+        // and provide seek_first(), which seeks it later.
+        template <typename Impl, typename = void>
+        inline constexpr bool has_seek_first_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool has_seek_first_v<Impl, std::void_t<decltype(std::declval<Impl&>().seek_first())>>{ true };
+
+        struct unseeked_t
+        {
+        };
+
+        inline constexpr unseeked_t unseeked{};
+
         struct iterator_ctor_t
         {
         };
 
         inline constexpr iterator_ctor_t iterator_ctor{};
 
+        template <typename It>
+        class iterable;
+
+        struct iterable_access;
+
+        // The inline storage of an implementation, which is empty or holds one like std::optional.
+        // A storage constructed empty is zero filled, and an implementation is only copied when it is held,
+        // so that the compiler never sees the bytes of an implementation copied uninitialized.
         template <typename Impl>
-        class iterator_base
+        class impl_storage
         {
         private:
-            std::shared_ptr<Impl> m_impl{};
+            union
+            {
+                unsigned char m_empty[sizeof(Impl)];
+                Impl m_impl;
+            };
+            bool m_has_value;
 
         public:
-            using iterator_category = std::input_iterator_tag;
+            impl_storage() noexcept : m_empty{}, m_has_value(false) {}
+            template <typename... Args>
+            explicit impl_storage(std::in_place_t, Args&&... args) : m_impl(std::forward<Args>(args)...), m_has_value(true)
+            {
+            }
+            impl_storage(const impl_storage& s) : m_has_value(false)
+            {
+                if (s.m_has_value)
+                    emplace(s.m_impl);
+                else
+                    std::fill(std::begin(m_empty), std::end(m_empty), static_cast<unsigned char>(0));
+            }
+            impl_storage(impl_storage&& s) noexcept(std::is_nothrow_move_constructible_v<Impl>) : m_has_value(false)
+            {
+                if (s.m_has_value)
+                    emplace(std::move(s.m_impl));
+                else
+                    std::fill(std::begin(m_empty), std::end(m_empty), static_cast<unsigned char>(0));
+            }
+            ~impl_storage() { reset(); }
+
+            // The implementations usually contain lambdas, which are not assignable,
+            // so we destroy and reconstruct them instead.
+            impl_storage& operator=(const impl_storage& s)
+            {
+                if (this != std::addressof(s))
+                {
+                    reset();
+                    if (s.m_has_value) emplace(s.m_impl);
+                }
+                return *this;
+            }
+            impl_storage& operator=(impl_storage&& s) noexcept(std::is_nothrow_move_constructible_v<Impl>)
+            {
+                if (this != std::addressof(s))
+                {
+                    reset();
+                    if (s.m_has_value) emplace(std::move(s.m_impl));
+                }
+                return *this;
+            }
+
+            template <typename... Args>
+            void emplace(Args&&... args)
+            {
+                reset();
+                ::new (static_cast<void*>(std::addressof(m_impl))) Impl(std::forward<Args>(args)...);
+                m_has_value = true;
+            }
+
+            void reset() noexcept
+            {
+                if (m_has_value)
+                {
+                    m_impl.~Impl();
+                    m_has_value = false;
+                }
+            }
+
+            bool has_value() const noexcept { return m_has_value; }
+            explicit operator bool() const noexcept { return m_has_value; }
+
+            Impl& operator*() noexcept { return m_impl; }
+            const Impl& operator*() const noexcept { return m_impl; }
+            Impl* operator->() noexcept { return std::addressof(m_impl); }
+            const Impl* operator->() const noexcept { return std::addressof(m_impl); }
+        };
+
+        // Deletes the copy operations of a derived class, if the implementation is move only.
+        template <bool Copyable>
+        struct copy_control
+        {
+        };
+
+        template <>
+        struct copy_control<false>
+        {
+            copy_control() noexcept = default;
+            copy_control(const copy_control&) = delete;
+            copy_control(copy_control&&) noexcept = default;
+            copy_control& operator=(const copy_control&) = delete;
+            copy_control& operator=(copy_control&&) noexcept = default;
+        };
+
+        template <typename Impl>
+        class iterator_base : private copy_control<std::is_copy_constructible_v<Impl>>
+        {
+        private:
+            // The implementation is stored inline, and an empty state means the end.
+            // It is mutable because some implementations calculate the value lazily.
+            mutable impl_storage<Impl> m_impl{};
+
+            static constexpr bool is_positional{ is_positional_impl_v<Impl> };
+
+            bool is_valid() const { return m_impl && m_impl->is_valid(); }
+
+            iterator_base end_iterator() const
+            {
+                iterator_base it{ *this };
+                if (it.m_impl) it.m_impl->seek_end();
+                return it;
+            }
+
+            template <typename It>
+            friend class iterable;
+
+            friend struct iterable_access;
+
+        public:
+            using iterator_category = std::conditional_t<is_positional, impl_iterator_category_t<Impl>, std::input_iterator_tag>;
             using difference_type = std::ptrdiff_t;
             using __traits_type = typename Impl::traits_type;
             using value_type = typename __traits_type::value_type;
@@ -64,56 +407,623 @@ namespace linq
 
             iterator_base() noexcept = default;
             template <typename... Args>
-            iterator_base(iterator_ctor_t, Args&&... args) : m_impl(std::make_shared<Impl>(std::forward<Args>(args)...))
+            iterator_base(iterator_ctor_t, Args&&... args) : m_impl(std::in_place, std::forward<Args>(args)...)
             {
-                if (!(m_impl->is_valid())) m_impl = nullptr;
+                if constexpr (!is_positional)
+                {
+                    if (!(m_impl->is_valid())) m_impl.reset();
+                }
             }
-            iterator_base(const iterator_base&) noexcept(std::is_nothrow_copy_constructible_v<std::shared_ptr<Impl>>) = default;
-            iterator_base& operator=(const iterator_base&) noexcept(std::is_nothrow_copy_assignable_v<std::shared_ptr<Impl>>) = default;
+            iterator_base(const iterator_base&) = default;
+            iterator_base(iterator_base&&) = default;
+            iterator_base& operator=(const iterator_base&) = default;
+            iterator_base& operator=(iterator_base&&) = default;
 
             reference operator*() const { return m_impl->value(); }
-            pointer operator->() const { return std::pointer_traits<pointer>::pointer_to(m_impl->value()); }
+            pointer operator->() const
+            {
+                if constexpr (std::is_reference_v<reference>)
+                {
+                    auto&& value = m_impl->value();
+                    return std::addressof(value);
+                }
+                else
+                    return pointer{ m_impl->value() };
+            }
 
-            constexpr operator bool() const noexcept { return static_cast<bool>(m_impl); }
+            constexpr operator bool() const noexcept
+            {
+                if constexpr (is_positional)
+                    return is_valid();
+                else
+                    return m_impl.has_value();
+            }
 
-            bool operator==(const iterator_base& it) const noexcept
+            bool operator==(const iterator_base& it) const
             {
-                return this == std::addressof(it) || (!m_impl && !it.m_impl);
+                if constexpr (is_positional)
+                {
+                    if (m_impl && it.m_impl)
+                        return m_impl->equals(*it.m_impl);
+                    else
+                        return !is_valid() && !it.is_valid();
+                }
+                else
+                {
+                    return this == std::addressof(it) || (!m_impl && !it.m_impl);
+                }
             }
-            bool operator!=(const iterator_base& it) const noexcept { return !operator==(it); }
+            bool operator!=(const iterator_base& it) const { return !operator==(it); }
+
+            friend bool operator==(const iterator_base& it, sentinel_t) { return !it.is_valid(); }
+            friend bool operator==(sentinel_t, const iterator_base& it) { return !it.is_valid(); }
+            friend bool operator!=(const iterator_base& it, sentinel_t) { return it.is_valid(); }
+            friend bool operator!=(sentinel_t, const iterator_base& it) { return it.is_valid(); }
 
             iterator_base& operator++()
             {
                 m_impl->move_next();
-                if (!(m_impl->is_valid())) m_impl = nullptr;
+                if constexpr (!is_positional)
+                {
+                    if (!(m_impl->is_valid())) m_impl.reset();
+                }
                 return *this;
             }
             iterator_base operator++(int)
             {
-                iterator_base it = this;
+                iterator_base it = *this;
                 operator++();
                 return it;
             }
+
+            iterator_base& operator--()
+            {
+                m_impl->move_prev();
+                return *this;
+            }
+            iterator_base operator--(int)
+            {
+                iterator_base it = *this;
+                operator--();
+                return it;
+            }
+
+            iterator_base& operator+=(difference_type n)
+            {
+                m_impl->advance(n);
+                return *this;
+            }
+            iterator_base& operator-=(difference_type n)
+            {
+                m_impl->advance(-n);
+                return *this;
+            }
+
+            // The offsets are any integers, so that the iterator is not converted to bool for the built-in arithmetic.
+            template <typename N, std::enable_if_t<std::is_integral_v<N>, int> = 0>
+            friend iterator_base operator+(iterator_base it, N n)
+            {
+                it += static_cast<difference_type>(n);
+                return it;
+            }
+            template <typename N, std::enable_if_t<std::is_integral_v<N>, int> = 0>
+            friend iterator_base operator+(N n, iterator_base it)
+            {
+                it += static_cast<difference_type>(n);
+                return it;
+            }
+            template <typename N, std::enable_if_t<std::is_integral_v<N>, int> = 0>
+            friend iterator_base operator-(iterator_base it, N n)
+            {
+                it -= static_cast<difference_type>(n);
+                return it;
+            }
+            // It is only declared for random access iterators, so that the distance is not assumed to be known.
+            template <typename I = Impl, std::enable_if_t<is_positional_impl_v<I> && std::is_base_of_v<std::random_access_iterator_tag, impl_iterator_category_t<I>>, int> = 0>
+            friend difference_type operator-(const iterator_base& it1, const iterator_base& it2)
+            {
+                return it2.m_impl->distance_to(*it1.m_impl);
+            }
+
+            // The random access iterators are ordered by the distance, rather than compared as bool.
+            template <typename I = Impl, std::enable_if_t<is_positional_impl_v<I> && std::is_base_of_v<std::random_access_iterator_tag, impl_iterator_category_t<I>>, int> = 0>
+            friend bool operator<(const iterator_base& it1, const iterator_base& it2)
+            {
+                return it1.m_impl->distance_to(*it2.m_impl) > 0;
+            }
+            template <typename I = Impl, std::enable_if_t<is_positional_impl_v<I> && std::is_base_of_v<std::random_access_iterator_tag, impl_iterator_category_t<I>>, int> = 0>
+            friend bool operator>(const iterator_base& it1, const iterator_base& it2)
+            {
+                return it2 < it1;
+            }
+            template <typename I = Impl, std::enable_if_t<is_positional_impl_v<I> && std::is_base_of_v<std::random_access_iterator_tag, impl_iterator_category_t<I>>, int> = 0>
+            friend bool operator<=(const iterator_base& it1, const iterator_base& it2)
+            {
+                return !(it2 < it1);
+            }
+            template <typename I = Impl, std::enable_if_t<is_positional_impl_v<I> && std::is_base_of_v<std::random_access_iterator_tag, impl_iterator_category_t<I>>, int> = 0>
+            friend bool operator>=(const iterator_base& it1, const iterator_base& it2)
+            {
+                return !(it1 < it2);
+            }
+
+            reference operator[](difference_type n) const { return *(*this + n); }
+
+            // Feeds the elements until the end to the sink, and consumes the iterator.
+            template <typename Sink>
+            bool push(const iterator_base& end, Sink&& sink)
+            {
+                if constexpr (has_push_v<Impl>)
+                {
+                    if (!m_impl) return true;
+                    // The implementation stops itself at an invalid end.
+                    if (!end.is_valid()) return m_impl->push(sink);
+                    if constexpr (is_positional && std::is_base_of_v<std::random_access_iterator_tag, iterator_category>)
+                    {
+                        difference_type n = m_impl->distance_to(*end.m_impl);
+                        bool result{ true };
+                        if (n > 0)
+                        {
+                            m_impl->push([&](auto&& item) {
+                                result = sink(std::forward<decltype(item)>(item));
+                                return result && --n > 0;
+                            });
+                        }
+                        return result;
+                    }
+                }
+                for (; *this != end; ++*this)
+                {
+                    if (!sink(**this)) return false;
+                }
+                return true;
+            }
+
+            // Feeds the segments until the end to the sink, or the whole range if the implementation is not segmented.
+            template <typename Sink>
+            bool push_segments(const iterator_base& end, Sink&& sink)
+            {
+                if constexpr (has_push_segments_v<Impl>)
+                {
+                    if (!m_impl) return true;
+                    if (!end.is_valid()) return m_impl->push_segments(sink);
+                }
+                return sink(*this, end);
+            }
+
+            friend bool operator<(const iterator_base& it1, const iterator_base& it2) { return it1 - it2 < 0; }
+            friend bool operator>(const iterator_base& it1, const iterator_base& it2) { return it2 < it1; }
+            friend bool operator<=(const iterator_base& it1, const iterator_base& it2) { return !(it2 < it1); }
+            friend bool operator>=(const iterator_base& it1, const iterator_base& it2) { return !(it1 < it2); }
         };
 
+        template <typename It>
+        inline constexpr bool is_positional_iterator_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool is_positional_iterator_v<iterator_base<Impl>>{ is_positional_impl_v<Impl> };
+
+        // Whether the iterator is a stage of a query, whose elements are computed when they are read.
+        template <typename It>
+        inline constexpr bool is_stage_iterator_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool is_stage_iterator_v<iterator_base<Impl>>{ true };
+
         template <typename It>
         class iterable
         {
         private:
             It m_begin{}, m_end{};
+            // The exact count of the elements, if it could be known without enumerating.
+            std::optional<std::size_t> m_size{};
+
+            friend struct iterable_access;
 
         public:
-            iterable(It&& begin) noexcept(std::is_nothrow_move_constructible_v<It>&& std::is_nothrow_constructible_v<It>)
-                : m_begin(std::move(begin)), m_end()
+            iterable(It&& begin, std::optional<std::size_t> size = std::nullopt) noexcept(std::is_nothrow_move_constructible_v<It>&& std::is_nothrow_constructible_v<It>)
+                : m_begin(std::move(begin)), m_end(), m_size(size)
+            {
+                if constexpr (is_positional_iterator_v<It>)
+                    m_end = m_begin.end_iterator();
+            }
+            iterable(It&& begin, It&& end, std::optional<std::size_t> size = std::nullopt) noexcept(std::is_nothrow_move_constructible_v<It>)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_size(size)
             {
             }
 
+            template <typename I = It, std::enable_if_t<std::is_copy_constructible_v<I>, int> = 0>
             It begin() const noexcept(std::is_nothrow_copy_constructible_v<It>) { return m_begin; }
+            template <typename I = It, std::enable_if_t<std::is_copy_constructible_v<I>, int> = 0>
             It end() const noexcept(std::is_nothrow_copy_constructible_v<It>) { return m_end; }
+
+            // A move-only iterator could only be enumerated once.
+            template <typename I = It, std::enable_if_t<!std::is_copy_constructible_v<I>, int> = 0>
+            It begin() noexcept(std::is_nothrow_move_constructible_v<It>) { return std::move(m_begin); }
+            template <typename I = It, std::enable_if_t<!std::is_copy_constructible_v<I>, int> = 0>
+            It end() const noexcept(std::is_nothrow_default_constructible_v<It>) { return {}; }
+
+            std::optional<std::size_t> known_size() const
+            {
+                if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag>)
+                    return static_cast<std::size_t>(m_end - m_begin);
+                else
+                    return m_size;
+            }
         };
 
         template <typename It>
         iterable(It &&) -> iterable<It>;
+
+        template <typename It>
+        iterable(It&&, std::optional<std::size_t>) -> iterable<std::decay_t<It>>;
+
+        template <typename It>
+        iterable(It, It) -> iterable<It>;
+
+        template <typename It>
+        iterable(It, It, std::optional<std::size_t>) -> iterable<It>;
+
+        // An iterable only holds iterators, so its iterators are still valid after it is destroyed.
+        template <typename T>
+        inline constexpr bool is_iterable_v{ false };
+
+        template <typename It>
+        inline constexpr bool is_iterable_v<iterable<It>>{ true };
+
+        // Exposes the implementations of an iterable, so that adjacent stages could be fused.
+        struct iterable_access
+        {
+            template <typename Impl>
+            static const Impl* begin_impl(const iterable<iterator_base<Impl>>& e) noexcept
+            {
+                return e.m_begin.m_impl ? std::addressof(*e.m_begin.m_impl) : nullptr;
+            }
+
+            template <typename Impl>
+            static const Impl* end_impl(const iterable<iterator_base<Impl>>& e) noexcept
+            {
+                return e.m_end.m_impl ? std::addressof(*e.m_end.m_impl) : nullptr;
+            }
+
+            template <typename Impl>
+            static const Impl* get_impl(const iterator_base<Impl>& it) noexcept
+            {
+                return it.m_impl ? std::addressof(*it.m_impl) : nullptr;
+            }
+
+            // Gets the natural end of the iterator.
+            template <typename Impl>
+            static iterator_base<Impl> end_of(const iterator_base<Impl>& it)
+            {
+                if constexpr (is_positional_impl_v<Impl>)
+                    return it.end_iterator();
+                else
+                    return {};
+            }
+
+            // Seeks the first element of an iterator whose implementation was constructed unseeked.
+            template <typename It>
+            static void seek_first(It&) noexcept
+            {
+            }
+
+            template <typename Impl>
+            static void seek_first(iterator_base<Impl>& it)
+            {
+                if constexpr (has_seek_first_v<Impl>)
+                {
+                    if (!it.m_impl) return;
+                    it.m_impl->seek_first();
+                    if constexpr (!is_positional_impl_v<Impl>)
+                    {
+                        if (!(it.m_impl->is_valid())) it.m_impl.reset();
+                    }
+                }
+            }
+        };
+
+        // Replaces the last stage of an iterable with a fused one.
+        // The fused stage is constructed by fuse(begin, end, impl) over the source range of the last stage,
+        // whose implementation should provide source_begin() and source_end().
+        template <typename It, typename Impl, typename Fuse>
+        auto fuse_stage(const iterable<iterator_base<Impl>>& e, Fuse&& fuse, std::optional<std::size_t> size = std::nullopt)
+        {
+            const Impl* begin = iterable_access::begin_impl(e);
+            if (!begin) return iterable<It>{ It{}, size };
+            // The end of a subrange is the source position of its last iterator.
+            const Impl* end = iterable_access::end_impl(e);
+            return iterable<It>{ fuse(begin->source_begin(), end ? end->source_begin() : begin->source_end(), *begin), size };
+        }
+
+        // Feeds the elements to the sink until it returns false.
+        // Returns false if the sink stops it early.
+        template <typename It, typename Sink>
+        bool push_range(It& begin, const It& end, Sink&& sink)
+        {
+            for (; begin != end; ++begin)
+            {
+                if (!sink(*begin)) return false;
+            }
+            return true;
+        }
+
+        template <typename Impl, typename Sink>
+        bool push_range(iterator_base<Impl>& begin, const iterator_base<Impl>& end, Sink&& sink)
+        {
+            return begin.push(end, std::forward<Sink>(sink));
+        }
+
+        // Feeds the range to the sink, segment by segment if it is concatenated from several ranges.
+        template <typename It, typename Sink>
+        bool push_segments(It& begin, const It& end, Sink&& sink)
+        {
+            return sink(begin, end);
+        }
+
+        template <typename Impl, typename Sink>
+        bool push_segments(iterator_base<Impl>& begin, const iterator_base<Impl>& end, Sink&& sink)
+        {
+            return begin.push_segments(end, std::forward<Sink>(sink));
+        }
+
+        // Drives the enumerable by the source, rather than pulling the elements one by one.
+        template <typename Container, typename Sink>
+        bool push_each(Container&& container, Sink&& sink)
+        {
+            auto begin = std::begin(container);
+            return push_range(begin, std::end(container), std::forward<Sink>(sink));
+        }
+
+        template <typename T, typename = void>
+        inline constexpr bool has_known_size_v{ false };
+
+        template <typename T>
+        inline constexpr bool has_known_size_v<T, std::void_t<decltype(std::declval<const T&>().known_size())>>{ true };
+
+        template <typename T, typename = void>
+        inline constexpr bool has_size_v{ false };
+
+        template <typename T>
+        inline constexpr bool has_size_v<T, std::void_t<decltype(std::declval<const T&>().size())>>{ true };
+
+        // Gets the current count of the elements if it could be known without enumerating.
+        template <typename Container>
+        constexpr std::optional<std::size_t> known_size(const Container& container)
+        {
+            if constexpr (has_known_size_v<Container>)
+                return container.known_size();
+            else if constexpr (has_size_v<Container>)
+                return static_cast<std::size_t>(container.size());
+            else if constexpr (std::is_array_v<Container>)
+                return std::extent_v<Container>;
+            else if constexpr (is_iterator_category_v<decltype(std::begin(container)), std::random_access_iterator_tag>)
+                return static_cast<std::size_t>(std::end(container) - std::begin(container));
+            else
+                return std::nullopt;
+        }
+
+        // Gets the count of the elements which an enumerable built on the container could store.
+        // It is only known if it stays valid as long as the iterators do, because the enumerable is not notified
+        // when a node-based container grows without invalidating its iterators.
+        template <typename Container>
+        constexpr std::optional<std::size_t> fixed_size(const Container& container)
+        {
+            if constexpr (has_known_size_v<Container>)
+                return container.known_size();
+            else if constexpr (std::is_array_v<Container>)
+                return std::extent_v<Container>;
+            else if constexpr (is_iterator_category_v<decltype(std::begin(container)), std::random_access_iterator_tag>)
+                return static_cast<std::size_t>(std::end(container) - std::begin(container));
+            else
+                return std::nullopt;
+        }
+
+        // Gets the sum of the counts if all of them are known.
+        template <typename... Sizes>
+        constexpr std::optional<std::size_t> add_known_size(Sizes... sizes)
+        {
+            if ((sizes && ...))
+                return (*sizes + ...);
+            else
+                return std::nullopt;
+        }
+
+        // Gets the minimum of the counts if all of them are known.
+        template <typename... Sizes>
+        constexpr std::optional<std::size_t> min_known_size(Sizes... sizes)
+        {
+            if ((sizes && ...))
+                return (std::min)({ *sizes... });
+            else
+                return std::nullopt;
+        }
+
+        template <typename Container, typename OutIt>
+        inline constexpr bool is_fillable_v{ false };
+
+        template <typename Impl, typename OutIt>
+        inline constexpr bool is_fillable_v<iterable<iterator_base<Impl>>, OutIt>{ is_iterator_category_v<iterator_base<Impl>, std::random_access_iterator_tag> && has_fill_v<Impl, OutIt> };
+
+        // Copies the elements into a vector, which is reserved with the known count.
+        template <typename T, typename Allocator = std::allocator<T>, typename Container>
+        std::vector<T, Allocator> make_vector(Container&& container, const Allocator& alloc = {})
+        {
+            using It = decltype(std::begin(container));
+            if constexpr (is_fillable_v<std::decay_t<Container>, typename std::vector<T, Allocator>::iterator> && std::is_default_constructible_v<T>)
+            {
+                // The generated elements are written in place, without enumerating.
+                std::vector<T, Allocator> result(static_cast<std::size_t>(std::end(container) - std::begin(container)), alloc);
+                if (auto impl = iterable_access::begin_impl(container)) impl->fill(result.begin(), result.end());
+                return result;
+            }
+            else if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag>)
+            {
+                return std::vector<T, Allocator>(std::begin(container), std::end(container), alloc);
+            }
+            else
+            {
+                std::vector<T, Allocator> result(alloc);
+                if (auto size = known_size(container)) result.reserve(*size);
+                auto begin = std::begin(container);
+                // Random access segments are copied in bulk.
+                push_segments(begin, std::end(container), [&](auto& first, const auto& last) {
+                    if constexpr (is_iterator_category_v<std::decay_t<decltype(first)>, std::random_access_iterator_tag>)
+                    {
+                        result.insert(result.end(), first, last);
+                        return true;
+                    }
+                    else
+                    {
+                        return push_range(first, last, [&](auto&& item) {
+                            result.emplace_back(std::forward<decltype(item)>(item));
+                            return true;
+                        });
+                    }
+                });
+                return result;
+            }
+        }
+
+        // Advances the iterator by n steps, but not beyond the end.
+        template <typename It>
+        constexpr It advance_bounded(It begin, const It& end, std::size_t n)
+        {
+            if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag>)
+            {
+                auto size = static_cast<std::size_t>(end - begin);
+                return begin + static_cast<std::ptrdiff_t>(n < size ? n : size);
+            }
+            else
+            {
+                for (; begin != end && n; ++begin, --n)
+                    ;
+                return begin;
+            }
+        }
+    } // namespace impl
+
+    namespace impl
+    {
+        // A query owns its arguments, and applies them to the enumerables.
+        // The arguments are copied when an lvalue query is applied, and moved when a temporary one is applied.
+        template <typename Func, typename... Args>
+        class query
+        {
+        private:
+            Func m_func;
+            std::tuple<Args...> m_args;
+
+        public:
+            template <typename... As>
+            constexpr query(Func func, As&&... args) : m_func(std::move(func)), m_args(std::forward<As>(args)...) {}
+
+            template <typename Container>
+            constexpr decltype(auto) operator()(Container&& container) const&
+            {
+                return std::apply([&](const Args&... args) -> decltype(auto) { return m_func(std::forward<Container>(container), args...); }, m_args);
+            }
+
+            template <typename Container>
+            constexpr decltype(auto) operator()(Container&& container) &&
+            {
+                return std::apply([&](Args&... args) -> decltype(auto) { return m_func(std::forward<Container>(container), std::move(args)...); }, m_args);
+            }
+
+            // Gets the arguments, so that a query could fuse with the following one.
+            constexpr const std::tuple<Args...>& args() const& noexcept { return m_args; }
+            constexpr std::tuple<Args...>&& args() && noexcept { return std::move(m_args); }
+        };
+
+        // The function should accept the enumerable and the arguments.
+        template <typename Func, typename... Args>
+        constexpr auto make_query(Func&& func, Args&&... args)
+        {
+            return query<std::decay_t<Func>, std::decay_t<Args>...>{ std::forward<Func>(func), std::forward<Args>(args)... };
+        }
+
+        // Enumerates a container shared by the iterators, so that it lives as long as any of them.
+        template <typename Container>
+        class shared_container_iterator_impl
+        {
+        private:
+            using It = decltype(std::begin(std::declval<const Container&>()));
+
+            std::shared_ptr<const Container> m_container;
+            It m_begin, m_end;
+
+        public:
+            using traits_type = std::iterator_traits<It>;
+            using iterator_category = typename traits_type::iterator_category;
+
+            shared_container_iterator_impl(std::shared_ptr<const Container> container)
+                : m_container(std::move(container)), m_begin(std::begin(*m_container)), m_end(std::end(*m_container)) {}
+
+            typename traits_type::reference value() const { return *m_begin; }
+
+            void move_next() { ++m_begin; }
+
+            bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const shared_container_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end() { m_begin = m_end; }
+
+            void move_prev() { --m_begin; }
+
+            void advance(std::ptrdiff_t n) { m_begin += n; }
+
+            std::ptrdiff_t distance_to(const shared_container_iterator_impl& it) const { return it.m_begin - m_begin; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, std::forward<Sink>(sink));
+            }
+
+            template <typename Sink>
+            bool push_segments(Sink&& sink)
+            {
+                return sink(m_begin, m_end);
+            }
+        };
+
+        template <typename Container>
+        using shared_container_iterator = iterator_base<shared_container_iterator_impl<Container>>;
+
+        // Captures an lvalue enumerable by reference. An rvalue iterable is moved into the query, because its iterators outlive it;
+        // other rvalue containers are moved into a shared container, which the enumerables built on it keep alive.
+        template <typename Container>
+        constexpr auto capture_container(Container&& container)
+        {
+            using C = std::remove_cv_t<std::remove_reference_t<Container>>;
+            if constexpr (std::is_lvalue_reference_v<Container>)
+                return std::ref(container);
+            else if constexpr (is_iterable_v<C>)
+                return C{ std::move(container) };
+            else
+                return std::shared_ptr<const C>{ std::make_shared<C>(std::move(container)) };
+        }
+
+        template <typename T>
+        constexpr T& unwrap_container(std::reference_wrapper<T> container) noexcept
+        {
+            return container.get();
+        }
+
+        // The shared container is enumerated by an iterable which holds it.
+        template <typename Container>
+        auto unwrap_container(std::shared_ptr<const Container> container)
+        {
+            auto size = known_size(*container);
+            return iterable{ shared_container_iterator<Container>{ iterator_ctor, std::move(container) }, size };
+        }
+
+        template <typename Container>
+        constexpr Container&& unwrap_container(Container&& container) noexcept
+        {
+            return std::forward<Container>(container);
+        }
     } // namespace impl
 
     template <typename Container, typename Query, typename = decltype(std::begin(std::declval<Container>())), typename = decltype(std::end(std::declval<Container>()))>
@@ -122,6 +1032,17 @@ namespace linq
         return std::forward<Query>(query)(std::forward<Container>(container));
     }
 
+    // Composes a query with the following one, without a source.
+    template <typename Func, typename... Args, typename Query>
+    constexpr auto operator>>(impl::query<Func, Args...> q1, Query&& q2)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& q1, auto&& q2) {
+                return std::forward<decltype(q2)>(q2)(std::forward<decltype(q1)>(q1)(std::forward<decltype(container)>(container)));
+            },
+            std::move(q1), std::forward<Query>(q2));
+    }
+
     namespace impl
     {
         template <typename T>
@@ -148,44 +1069,213 @@ namespace linq
             void move_next() { m_current = m_func(m_current); }
 
             bool is_valid() const noexcept { return m_current < m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                for (; m_current < m_end; m_current = m_func(m_current))
+                {
+                    if (!sink(std::as_const(m_current))) return false;
+                }
+                return true;
+            }
         };
 
         template <typename T, typename Func>
         using range_iterator = iterator_base<range_iterator_impl<T, Func>>;
     } // namespace impl
 
+    namespace impl
+    {
+        // Gets the count of an arithmetic range.
+        template <typename T>
+        constexpr std::optional<std::size_t> range_size(const T& begin, const T& end, const T& step)
+        {
+            if constexpr (std::is_arithmetic_v<T>)
+            {
+                if (!(begin < end) || !(step > 0)) return 0;
+                if constexpr (std::is_integral_v<T>)
+                {
+                    // The distance may not fit in a signed type.
+                    using U = std::make_unsigned_t<T>;
+                    U distance = static_cast<U>(static_cast<U>(end) - static_cast<U>(begin));
+                    return static_cast<std::size_t>(static_cast<U>(distance - 1) / static_cast<U>(step)) + 1;
+                }
+                else
+                {
+                    T count = std::ceil((end - begin) / step);
+                    if (!(count < static_cast<T>((std::numeric_limits<std::size_t>::max)()))) throw std::length_error("The range is too long.");
+                    return static_cast<std::size_t>(count);
+                }
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+
+        template <typename T>
+        inline constexpr bool is_arithmetic_range_v{ std::is_arithmetic_v<T> && !std::is_same_v<T, bool> };
+
+        // An arithmetic progression, whose elements are calculated from the index.
+        template <typename T>
+        class arithmetic_range_iterator_impl
+        {
+        private:
+            T m_begin{}, m_step{};
+            std::size_t m_index{ 0 }, m_count{ 0 };
+
+        public:
+            using traits_type = result_impl_traits<T>;
+            using iterator_category = std::random_access_iterator_tag;
+
+            constexpr arithmetic_range_iterator_impl(T begin, T step, std::size_t count) noexcept
+                : m_begin(begin), m_step(step), m_count(count) {}
+
+            T value() const noexcept { return at(m_index); }
+
+            void move_next() noexcept { ++m_index; }
+
+            bool is_valid() const noexcept { return m_index < m_count; }
+
+            bool equals(const arithmetic_range_iterator_impl& it) const noexcept { return m_index == it.m_index; }
+
+            void seek_end() noexcept { m_index = m_count; }
+
+            void move_prev() noexcept { --m_index; }
+
+            void advance(std::ptrdiff_t n) noexcept { m_index += static_cast<std::size_t>(n); }
+
+            std::ptrdiff_t distance_to(const arithmetic_range_iterator_impl& it) const noexcept
+            {
+                return static_cast<std::ptrdiff_t>(it.m_index) - static_cast<std::ptrdiff_t>(m_index);
+            }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                for (; m_index < m_count; ++m_index)
+                {
+                    if (!sink(at(m_index))) return false;
+                }
+                return true;
+            }
+
+            template <typename OutIt>
+            void fill(OutIt first, OutIt last) const
+            {
+                if constexpr (std::is_integral_v<T>)
+                {
+                    if (m_step == 1)
+                    {
+                        std::iota(first, last, value());
+                        return;
+                    }
+                }
+                for (std::size_t index = m_index; first != last; ++first, ++index)
+                    *first = at(index);
+            }
+
+        private:
+            T at(std::size_t index) const noexcept
+            {
+                // An integral element is calculated in the unsigned type, because the offset may overflow the signed one.
+                if constexpr (std::is_integral_v<T>)
+                {
+                    using U = std::make_unsigned_t<T>;
+                    return static_cast<T>(static_cast<U>(static_cast<U>(m_begin) + static_cast<U>(static_cast<U>(index) * static_cast<U>(m_step))));
+                }
+                else
+                {
+                    return static_cast<T>(m_begin + static_cast<T>(index) * m_step);
+                }
+            }
+        };
+
+        template <typename T>
+        using arithmetic_range_iterator = iterator_base<arithmetic_range_iterator_impl<T>>;
+    } // namespace impl
+
     template <typename T, typename Func = impl::increase<T>>
     constexpr auto range(T begin, T end, Func&& func = {})
     {
-        return impl::iterable{ impl::range_iterator<T, Func>{ impl::iterator_ctor, std::move(begin), std::move(end), std::forward<Func>(func) } };
+        if constexpr (std::is_same_v<std::decay_t<Func>, impl::increase<T>> && impl::is_arithmetic_range_v<T>)
+        {
+            std::size_t count = *impl::range_size<T>(begin, end, 1);
+            return impl::iterable{ impl::arithmetic_range_iterator<T>{ impl::iterator_ctor, begin, T{ 1 }, count } };
+        }
+        else
+        {
+            return impl::iterable{ impl::range_iterator<T, Func>{ impl::iterator_ctor, std::move(begin), std::move(end), std::forward<Func>(func) } };
+        }
     }
 
     template <typename T>
     constexpr auto range(T begin, T end, T step)
     {
-        return range<T>(std::move(begin), std::move(end), [step = std::move(step)](const T& value) { return value + step; });
+        if constexpr (impl::is_arithmetic_range_v<T>)
+        {
+            std::size_t count = *impl::range_size<T>(begin, end, step);
+            return impl::iterable{ impl::arithmetic_range_iterator<T>{ impl::iterator_ctor, begin, step, count } };
+        }
+        else
+        {
+            auto func = [step = std::move(step)](const T& value) { return value + step; };
+            return impl::iterable{ impl::range_iterator<T, decltype(func)>{ impl::iterator_ctor, std::move(begin), std::move(end), std::move(func) } };
+        }
     }
 
     namespace impl
     {
+        // The value is shared by the copies, so that a reference outlives the iterator it comes from.
         template <typename T>
         class repeat_iterator_impl
         {
         private:
-            T m_value;
-            std::size_t m_count{ 0 };
+            std::shared_ptr<const T> m_value;
+            std::size_t m_index{ 0 }, m_count{ 0 };
 
         public:
             using traits_type = iterator_impl_traits<T>;
+            using iterator_category = std::random_access_iterator_tag;
+
+            repeat_iterator_impl(T&& value, std::size_t count)
+                : m_value(std::make_shared<const T>(std::move(value))), m_count(count) {}
 
-            constexpr repeat_iterator_impl(T&& value, std::size_t count) noexcept(std::is_nothrow_move_constructible_v<T>)
-                : m_value(std::move(value)), m_count(count) {}
+            typename traits_type::reference value() const noexcept { return *m_value; }
 
-            typename traits_type::reference value() const noexcept { return m_value; }
+            void move_next() noexcept { ++m_index; }
 
-            void move_next() { --m_count; }
+            bool is_valid() const noexcept { return m_index < m_count; }
 
-            bool is_valid() const noexcept { return m_count > 0; }
+            bool equals(const repeat_iterator_impl& it) const noexcept { return m_index == it.m_index; }
+
+            void seek_end() noexcept { m_index = m_count; }
+
+            void move_prev() noexcept { --m_index; }
+
+            void advance(std::ptrdiff_t n) noexcept { m_index += static_cast<std::size_t>(n); }
+
+            std::ptrdiff_t distance_to(const repeat_iterator_impl& it) const noexcept
+            {
+                return static_cast<std::ptrdiff_t>(it.m_index) - static_cast<std::ptrdiff_t>(m_index);
+            }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                for (; m_index < m_count; ++m_index)
+                {
+                    if (!sink(*m_value)) return false;
+                }
+                return true;
+            }
+
+            template <typename OutIt>
+            void fill(OutIt first, OutIt last) const
+            {
+                std::fill(first, last, *m_value);
+            }
         };
 
         template <typename T>
@@ -195,7 +1285,7 @@ namespace linq
     template <typename T>
     constexpr auto repeat(T value, std::size_t count)
     {
-        return impl::iterable{ impl::repeat_iterator<T>{ impl::iterator_ctor, std::move(value), count } };
+        return impl::iterable{ impl::repeat_iterator<T>{ impl::iterator_ctor, std::move(value), count }, count };
     }
 
     namespace impl
@@ -208,9 +1298,9 @@ namespace linq
             It m_begin, m_end;
 
         public:
-            using traits_type = iterator_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>>;
+            using traits_type = common_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>, const T&, typename std::iterator_traits<It>::reference>;
 
-            append_iterator_impl(T value, It begin, It end) : m_value(std::move(value)), m_begin(begin), m_end(end) {}
+            append_iterator_impl(T value, It begin, It end) : m_value(std::move(value)), m_begin(std::move(begin)), m_end(std::move(end)) {}
 
             typename traits_type::reference value() const noexcept
             {
@@ -229,6 +1319,14 @@ namespace linq
             }
 
             bool is_valid() const { return m_begin != m_end || m_value; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                if (!push_range(m_begin, m_end, [&](auto&& item) { return sink(static_cast<typename traits_type::reference>(std::forward<decltype(item)>(item))); }))
+                    return false;
+                return !m_value || sink(static_cast<typename traits_type::reference>(*m_value));
+            }
         };
 
         template <typename T, typename It>
@@ -239,10 +1337,13 @@ namespace linq
     template <typename T>
     constexpr auto append(T&& value)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::append_iterator<std::remove_reference_t<T>, It>{ impl::iterator_ctor, std::forward<T>(value), std::begin(container), std::end(container) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                using It = decltype(std::begin(container));
+                using V = std::decay_t<decltype(value)>;
+                return impl::iterable{ impl::append_iterator<V, It>{ impl::iterator_ctor, std::forward<decltype(value)>(value), std::begin(container), std::end(container) }, impl::add_known_size(impl::fixed_size(container), std::optional<std::size_t>{ 1 }) };
+            },
+            std::forward<T>(value));
     }
 
     namespace impl
@@ -255,9 +1356,9 @@ namespace linq
             It m_begin, m_end;
 
         public:
-            using traits_type = iterator_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>>;
+            using traits_type = common_impl_traits<std::common_type_t<T, typename std::iterator_traits<It>::value_type>, const T&, typename std::iterator_traits<It>::reference>;
 
-            prepend_iterator_impl(T value, It begin, It end) : m_value(std::move(value)), m_begin(begin), m_end(end) {}
+            prepend_iterator_impl(T value, It begin, It end) : m_value(std::move(value)), m_begin(std::move(begin)), m_end(std::move(end)) {}
 
             typename traits_type::reference value() const noexcept
             {
@@ -276,6 +1377,14 @@ namespace linq
             }
 
             bool is_valid() const { return m_value || m_begin != m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                if (m_value && !sink(static_cast<typename traits_type::reference>(*m_value)))
+                    return false;
+                return push_range(m_begin, m_end, [&](auto&& item) { return sink(static_cast<typename traits_type::reference>(std::forward<decltype(item)>(item))); });
+            }
         };
 
         template <typename T, typename It>
@@ -286,63 +1395,149 @@ namespace linq
     template <typename T>
     constexpr auto prepend(T&& value)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::prepend_iterator<std::remove_reference_t<T>, It>{ impl::iterator_ctor, std::forward<T>(value), std::begin(container), std::end(container) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                using It = decltype(std::begin(container));
+                using V = std::decay_t<decltype(value)>;
+                return impl::iterable{ impl::prepend_iterator<V, It>{ impl::iterator_ctor, std::forward<decltype(value)>(value), std::begin(container), std::end(container) }, impl::add_known_size(impl::fixed_size(container), std::optional<std::size_t>{ 1 }) };
+            },
+            std::forward<T>(value));
     }
 
     namespace impl
     {
-        template <typename It1, typename It2>
+        // Enumerates the ranges one by one. Only the current segment is checked when moving,
+        // and the pushing loop runs over each segment directly.
+        template <typename... Its>
         class concat_iterator_impl
         {
         private:
-            It1 m_begin1, m_end1;
-            It2 m_begin2, m_end2;
+            static constexpr std::size_t segment_count{ sizeof...(Its) };
+
+            std::tuple<std::pair<Its, Its>...> m_segments;
+            std::size_t m_index{ 0 };
+
+            // Calls func with the index of the current segment as a constant.
+            template <std::size_t I = 0, typename Func>
+            decltype(auto) visit(Func&& func) const
+            {
+                if constexpr (I + 1 < segment_count)
+                {
+                    if (m_index != I) return visit<I + 1>(std::forward<Func>(func));
+                }
+                return func(std::integral_constant<std::size_t, I>{});
+            }
+
+            void seek_segment()
+            {
+                for (; m_index < segment_count; ++m_index)
+                {
+                    if (visit([this](auto i) { return std::get<decltype(i)::value>(m_segments).first != std::get<decltype(i)::value>(m_segments).second; })) break;
+                }
+            }
+
+            template <std::size_t I, typename Sink>
+            bool push_segment(Sink& sink)
+            {
+                if (m_index > I) return true;
+                auto& [begin, end] = std::get<I>(m_segments);
+                if (!push_range(begin, end, [&](auto&& item) { return sink(static_cast<typename traits_type::reference>(std::forward<decltype(item)>(item))); }))
+                    return false;
+                m_index = I + 1;
+                return true;
+            }
+
+            template <std::size_t I, typename Sink>
+            bool push_segments_from(Sink& sink)
+            {
+                if (m_index > I) return true;
+                auto& [begin, end] = std::get<I>(m_segments);
+                if (!impl::push_segments(begin, end, sink)) return false;
+                m_index = I + 1;
+                return true;
+            }
+
+            template <typename Sink, std::size_t... Is>
+            bool push_impl(Sink& sink, std::index_sequence<Is...>)
+            {
+                return (push_segment<Is>(sink) && ...);
+            }
+
+            template <typename Sink, std::size_t... Is>
+            bool push_segments_impl(Sink& sink, std::index_sequence<Is...>)
+            {
+                return (push_segments_from<Is>(sink) && ...);
+            }
 
         public:
-            using traits_type = iterator_impl_traits<std::common_type_t<
-                typename std::iterator_traits<It1>::value_type,
-                typename std::iterator_traits<It2>::value_type>>;
+            using traits_type = common_impl_traits<
+                std::common_type_t<typename std::iterator_traits<Its>::value_type...>,
+                typename std::iterator_traits<Its>::reference...>;
 
-            concat_iterator_impl(It1 begin1, It1 end1, It2 begin2, It2 end2)
-                : m_begin1(begin1), m_end1(end1), m_begin2(begin2), m_end2(end2) {}
+            concat_iterator_impl(std::pair<Its, Its>... segments) : m_segments(std::move(segments)...) { seek_segment(); }
 
-            typename traits_type::reference value() const noexcept
+            typename traits_type::reference value() const
             {
-                if (m_begin1 != m_end1)
-                    return *m_begin1;
-                else
-                    return *m_begin2;
+                return visit([this](auto i) -> typename traits_type::reference { return *std::get<decltype(i)::value>(m_segments).first; });
             }
 
             void move_next()
             {
-                if (m_begin1 != m_end1)
-                    ++m_begin1;
-                else
-                    ++m_begin2;
+                if (visit([this](auto i) { return ++std::get<decltype(i)::value>(m_segments).first == std::get<decltype(i)::value>(m_segments).second; }))
+                {
+                    ++m_index;
+                    seek_segment();
+                }
             }
 
-            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+            bool is_valid() const noexcept { return m_index < segment_count; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_impl(sink, std::index_sequence_for<Its...>{});
+            }
+
+            template <typename Sink>
+            bool push_segments(Sink&& sink)
+            {
+                return push_segments_impl(sink, std::index_sequence_for<Its...>{});
+            }
         };
 
-        template <typename It1, typename It2>
-        using concat_iterator = iterator_base<concat_iterator_impl<It1, It2>>;
+        template <typename... Its>
+        using concat_iterator = iterator_base<concat_iterator_impl<Its...>>;
+
+        template <typename Container>
+        constexpr auto make_segment(Container&& container)
+        {
+            return std::pair{ std::begin(container), std::end(container) };
+        }
     } // namespace impl
 
-    // Concatenates two enumerable.
-    template <typename Container2>
-    constexpr auto concat(Container2&& container2)
+    // Concatenates the enumerables.
+    template <typename Container2, typename... Containers>
+    constexpr auto concat(Container2&& container2, Containers&&... containers)
     {
-        return [&](auto&& container) {
-            using It1 = decltype(std::begin(container));
-            using It2 = decltype(std::begin(container2));
-            return impl::iterable{ impl::concat_iterator<It1, It2>{
-                impl::iterator_ctor, std::begin(container), std::end(container), std::begin(container2), std::end(container2) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&&... captured) {
+                return [&](auto&&... cs) {
+                    return impl::iterable{ impl::concat_iterator<decltype(std::begin(container)), decltype(std::begin(cs))...>{
+                                               impl::iterator_ctor, impl::make_segment(container), impl::make_segment(cs)... },
+                                           impl::add_known_size(impl::fixed_size(container), impl::fixed_size(cs)...) };
+                }(impl::unwrap_container(captured)...);
+            },
+            impl::capture_container(std::forward<Container2>(container2)), impl::capture_container(std::forward<Containers>(containers))...);
     }
 } // namespace linq
 
+#ifdef __cpp_lib_ranges
+// The enumerables only hold iterators, so they could be passed to the standard views and algorithms as views.
+namespace std::ranges
+{
+    template <typename It>
+    inline constexpr bool enable_view<linq::impl::iterable<It>>{ true };
+} // namespace std::ranges
+#endif // __cpp_lib_ranges
+
 #endif // !LINQ_CORE_HPP
@@ -0,0 +1,452 @@
+/**CppLinq hash.hpp
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2019-2020 Berrysoft
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+#ifndef LINQ_HASH_HPP
+#define LINQ_HASH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <linq/core.hpp>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace linq
+{
+    namespace impl
+    {
+        // Whether default_hash could hash the type: by std::hash, or by the elements of pairs and tuples.
+        template <typename T>
+        inline constexpr bool is_default_hashable_v{ std::is_default_constructible_v<std::hash<T>> };
+
+        template <typename T1, typename T2>
+        inline constexpr bool is_default_hashable_v<std::pair<T1, T2>>{ is_default_hashable_v<T1> && is_default_hashable_v<T2> };
+
+        template <typename... T>
+        inline constexpr bool is_default_hashable_v<std::tuple<T...>>{ (is_default_hashable_v<T> && ...) };
+
+        constexpr std::size_t hash_combine(std::size_t seed, std::size_t hash) noexcept
+        {
+            return seed ^ (hash + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2));
+        }
+
+        template <typename T>
+        std::size_t default_hash_value(const T& t);
+
+        template <typename T1, typename T2>
+        std::size_t default_hash_value(const std::pair<T1, T2>& p);
+
+        template <typename... T>
+        std::size_t default_hash_value(const std::tuple<T...>& t);
+
+        template <typename T>
+        std::size_t default_hash_value(const T& t)
+        {
+            return std::hash<T>{}(t);
+        }
+
+        template <typename T1, typename T2>
+        std::size_t default_hash_value(const std::pair<T1, T2>& p)
+        {
+            return hash_combine(default_hash_value(p.first), default_hash_value(p.second));
+        }
+
+        template <typename... T>
+        std::size_t default_hash_value(const std::tuple<T...>& t)
+        {
+            return std::apply(
+                [](const auto&... items) {
+                    std::size_t seed{ 0 };
+                    ((seed = hash_combine(seed, default_hash_value(items))), ...);
+                    return seed;
+                },
+                t);
+        }
+    } // namespace impl
+
+    // Hashes the keys with std::hash of their own types, and the pairs and tuples by their elements.
+    struct default_hash
+    {
+        template <typename T, typename = std::enable_if_t<impl::is_default_hashable_v<T>>>
+        std::size_t operator()(const T& t) const
+        {
+            return impl::default_hash_value(t);
+        }
+    };
+
+    namespace impl
+    {
+        template <typename T, typename = void>
+        inline constexpr bool is_transparent_v{ false };
+
+        template <typename T>
+        inline constexpr bool is_transparent_v<T, std::void_t<typename T::is_transparent>>{ true };
+
+        template <typename T>
+        struct string_view_of
+        {
+            using type = void;
+        };
+
+        template <typename Char>
+        struct string_view_of<std::basic_string<Char>>
+        {
+            using type = std::basic_string_view<Char>;
+        };
+
+        template <typename Char>
+        struct string_view_of<std::basic_string_view<Char>>
+        {
+            using type = std::basic_string_view<Char>;
+        };
+
+        // Whether a key of type K is hashed and compared as it is, instead of being converted to the stored key type first.
+        // It is only if the hasher and the equality are both transparent, or for the strings and the string views of the same characters,
+        // which std::hash hashes the same.
+        template <typename Key, typename K, typename Hash, typename KeyEq>
+        inline constexpr bool is_direct_key_v{
+            std::is_same_v<Key, K> || (is_transparent_v<Hash> && is_transparent_v<KeyEq>) ||
+            (std::is_same_v<Hash, default_hash> && is_transparent_v<KeyEq> && !std::is_void_v<typename string_view_of<Key>::type> &&
+             std::is_same_v<typename string_view_of<Key>::type, typename string_view_of<K>::type>)
+        };
+
+        // An open addressing hash table, which maps the keys to dense indices in the order of insertion.
+        // The slots hold the indices and the hashes only, and the keys are stored contiguously.
+        // The keys of other types are converted to the key type, unless they are direct keys.
+        template <typename Key, typename Hash = default_hash, typename KeyEq = std::equal_to<void>>
+        class flat_hash_index
+        {
+        public:
+            static constexpr std::size_t npos{ (std::numeric_limits<std::size_t>::max)() };
+
+        private:
+            struct slot
+            {
+                std::size_t index{ npos };
+                std::size_t hash{ 0 };
+            };
+
+            std::vector<Key> m_keys;
+            std::vector<slot> m_slots;
+            std::size_t m_shift{ 64 };
+            Hash m_hash;
+            KeyEq m_eq;
+
+            // Fibonacci hashing spreads the weak hashes, like the identity hash of integers, over the slots.
+            std::size_t home(std::size_t hash) const noexcept
+            {
+                return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> m_shift);
+            }
+
+            void rehash(std::size_t slots)
+            {
+                std::vector<slot> old{ std::move(m_slots) };
+                m_slots.assign(slots, slot{});
+                m_shift = 64;
+                for (; slots > 1; slots >>= 1)
+                    m_shift--;
+                for (auto& s : old)
+                {
+                    if (s.index != npos)
+                    {
+                        std::size_t mask = m_slots.size() - 1;
+                        std::size_t i = home(s.hash);
+                        while (m_slots[i].index != npos)
+                            i = (i + 1) & mask;
+                        m_slots[i] = s;
+                    }
+                }
+            }
+
+            // Finds the slot of the key, or the empty slot where it should be inserted.
+            template <typename K>
+            std::size_t probe(const K& key, std::size_t hash) const
+            {
+                std::size_t mask = m_slots.size() - 1;
+                std::size_t i = home(hash);
+                while (m_slots[i].index != npos && !(m_slots[i].hash == hash && m_eq(m_keys[m_slots[i].index], key)))
+                    i = (i + 1) & mask;
+                return i;
+            }
+
+        public:
+            explicit flat_hash_index(std::size_t capacity = 0, Hash hash = {}, KeyEq eq = {}) : m_hash(std::move(hash)), m_eq(std::move(eq))
+            {
+                reserve(capacity);
+            }
+
+            std::size_t size() const noexcept { return m_keys.size(); }
+
+            const std::vector<Key>& keys() const noexcept { return m_keys; }
+
+            // Moves the keys out, and leaves the table empty.
+            std::vector<Key> extract_keys() &&
+            {
+                m_slots.assign(m_slots.size(), slot{});
+                return std::move(m_keys);
+            }
+
+            // Reserves the slots, so that the count of the keys could be inserted without rehashing.
+            // The table keeps at most 3/4 of the slots used.
+            void reserve(std::size_t count)
+            {
+                std::size_t slots{ 8 };
+                while (slots * 3 < count * 4 + 4)
+                    slots <<= 1;
+                if (slots > m_slots.size()) rehash(slots);
+                m_keys.reserve(count);
+            }
+
+            // Gets the index of the key, or npos if it is not found.
+            template <typename K>
+            std::size_t find(const K& key) const
+            {
+                if constexpr (!is_direct_key_v<Key, K, Hash, KeyEq>)
+                    return find(Key(key));
+                else
+                {
+                    if (m_keys.empty()) return npos;
+                    return m_slots[probe(key, m_hash(key))].index;
+                }
+            }
+
+            // Inserts the key if it is not found, and gets its index and whether it is inserted.
+            template <typename K>
+            std::pair<std::size_t, bool> insert(K&& key)
+            {
+                if constexpr (!is_direct_key_v<Key, std::decay_t<K>, Hash, KeyEq>)
+                    return insert(Key(std::forward<K>(key)));
+                else
+                {
+                    std::size_t hash = m_hash(key);
+                    std::size_t i = probe(key, hash);
+                    if (m_slots[i].index != npos) return { m_slots[i].index, false };
+                    if ((m_keys.size() + 1) * 4 > m_slots.size() * 3)
+                    {
+                        rehash(m_slots.size() * 2);
+                        i = probe(key, hash);
+                    }
+                    m_slots[i] = { m_keys.size(), hash };
+                    m_keys.emplace_back(std::forward<K>(key));
+                    return { m_slots[i].index, true };
+                }
+            }
+        };
+
+        // A key stored by a pointer to a stable element, so that it is not copied.
+        template <typename T>
+        struct key_ref
+        {
+            const T* ptr;
+        };
+
+        template <typename T>
+        constexpr const T& unref_key(const T& key) noexcept
+        {
+            return key;
+        }
+
+        template <typename T>
+        constexpr const T& unref_key(const key_ref<T>& key) noexcept
+        {
+            return *key.ptr;
+        }
+
+        // Hashes and compares the keys stored by pointers as the keys they point to.
+        // They are transparent to the table, and flat_hash_set decides which keys are probed as they are.
+        template <typename Hash>
+        struct ref_hash
+        {
+            using is_transparent = void;
+
+            Hash hash;
+
+            template <typename T>
+            std::size_t operator()(const T& key) const
+            {
+                return hash(unref_key(key));
+            }
+        };
+
+        template <typename KeyEq>
+        struct ref_equal
+        {
+            using is_transparent = void;
+
+            KeyEq eq;
+
+            template <typename T, typename U>
+            bool operator()(const T& lhs, const U& rhs) const
+            {
+                return eq(unref_key(lhs), unref_key(rhs));
+            }
+        };
+
+        // A set on the flat hash index. The elements are stored by pointers if ByRef is true,
+        // which requires them to stay alive and unchanged while the set is used.
+        // It could be probed by the keys of other types, like a string_view for strings, if the hasher and the equality accept them.
+        template <typename T, typename Hash = default_hash, typename KeyEq = std::equal_to<void>, bool ByRef = false>
+        class flat_hash_set
+        {
+        private:
+            using stored_type = std::conditional_t<ByRef, key_ref<T>, T>;
+
+            flat_hash_index<stored_type, ref_hash<Hash>, ref_equal<KeyEq>> m_index;
+
+        public:
+            explicit flat_hash_set(std::size_t capacity = 0) : m_index(capacity) {}
+
+            template <typename It>
+            flat_hash_set(It begin, It end, std::optional<std::size_t> capacity = std::nullopt) : m_index(capacity.value_or(0))
+            {
+                for (; begin != end; ++begin)
+                    insert(*begin);
+            }
+
+            std::size_t size() const noexcept { return m_index.size(); }
+
+            // Inserts the element if it is not found, and returns whether it is inserted.
+            template <typename U>
+            bool insert(U&& value)
+            {
+                if constexpr (ByRef)
+                    return m_index.insert(key_ref<T>{ std::addressof(value) }).second;
+                else if constexpr (std::is_same_v<std::decay_t<U>, T>)
+                    return m_index.insert(std::forward<U>(value)).second;
+                else
+                    return m_index.insert(T(std::forward<U>(value))).second;
+            }
+
+            // The key of another type is converted to T, unless it is a direct key of the hasher and the equality.
+            template <typename K>
+            bool contains(const K& key) const
+            {
+                if constexpr (!is_direct_key_v<T, K, Hash, KeyEq>)
+                    return contains(T(key));
+                else
+                    return m_index.find(key) != m_index.npos;
+            }
+        };
+
+        // Whether the references of the iterator are to the elements stored elsewhere, which stay at their addresses.
+        template <typename It, typename T = typename std::iterator_traits<It>::value_type>
+        inline constexpr bool is_stable_reference_v{
+            std::is_lvalue_reference_v<typename std::iterator_traits<It>::reference> &&
+            std::is_same_v<std::decay_t<typename std::iterator_traits<It>::reference>, T> &&
+            std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>
+        };
+
+        struct accept_all_keys
+        {
+            template <typename K>
+            constexpr bool operator()(const K&) const noexcept
+            {
+                return true;
+            }
+        };
+
+        // The groups of the elements by their keys, stored in one arena.
+        // The elements of a group are contiguous, and the groups are in the order of the first appearance of their keys.
+        template <typename Key, typename Element, typename Hash = default_hash, typename KeyEq = std::equal_to<void>>
+        class flat_lookup
+        {
+        private:
+            flat_hash_index<Key, Hash, KeyEq> m_index;
+            std::vector<Element> m_arena;
+            // The group i is [m_offsets[i], m_offsets[i + 1]) of the arena.
+            std::vector<std::size_t> m_offsets;
+
+        public:
+            static constexpr std::size_t npos{ flat_hash_index<Key, Hash, KeyEq>::npos };
+
+            using group_type = iterable<const Element*>;
+
+            // Only the elements whose keys are accepted are kept.
+            template <typename It, typename KeySelector, typename ElementSelector, typename Accept = accept_all_keys>
+            flat_lookup(It begin, It end, KeySelector& keysel, ElementSelector& elesel, std::optional<std::size_t> capacity = std::nullopt, Hash hash = {}, KeyEq eq = {}, Accept accept = {})
+                : m_index(capacity.value_or(0), std::move(hash), std::move(eq))
+            {
+                // The elements are collected with their groups first, and then placed into the arena by counting.
+                std::vector<Element> elements;
+                std::vector<std::size_t> groups;
+                if (capacity)
+                {
+                    elements.reserve(*capacity);
+                    groups.reserve(*capacity);
+                }
+                for (; begin != end; ++begin)
+                {
+                    auto&& item = *begin;
+                    auto&& key = keysel(item);
+                    if (!accept(std::as_const(key))) continue;
+                    groups.push_back(m_index.insert(std::forward<decltype(key)>(key)).first);
+                    elements.emplace_back(elesel(item));
+                }
+                m_offsets.assign(m_index.size() + 1, 0);
+                for (std::size_t g : groups)
+                    m_offsets[g + 1]++;
+                for (std::size_t i = 1; i < m_offsets.size(); i++)
+                    m_offsets[i] += m_offsets[i - 1];
+                std::vector<std::size_t> order(elements.size());
+                {
+                    std::vector<std::size_t> next(m_offsets.begin(), m_offsets.end() - 1);
+                    for (std::size_t i = 0; i < groups.size(); i++)
+                        order[next[groups[i]]++] = i;
+                }
+                m_arena.reserve(elements.size());
+                for (std::size_t i : order)
+                    m_arena.emplace_back(std::move(elements[i]));
+            }
+
+            std::size_t size() const noexcept { return m_index.size(); }
+
+            const Key& key(std::size_t i) const { return m_index.keys()[i]; }
+
+            const std::vector<Key>& keys() const noexcept { return m_index.keys(); }
+
+            group_type group(std::size_t i) const
+            {
+                const Element* data = m_arena.data();
+                return group_type{ data + m_offsets[i], data + m_offsets[i + 1], m_offsets[i + 1] - m_offsets[i] };
+            }
+
+            // Gets the index of the group of the key, or npos if it is not found.
+            template <typename K>
+            std::size_t find(const K& key) const
+            {
+                return m_index.find(key);
+            }
+        };
+    } // namespace impl
+} // namespace linq
+
+#endif // !LINQ_HASH_HPP
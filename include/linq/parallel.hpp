@@ -0,0 +1,722 @@
+/**CppLinq parallel.hpp
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2019-2020 Berrysoft
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+#ifndef LINQ_PARALLEL_HPP
+#define LINQ_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <linq/core.hpp>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace linq
+{
+    // Runs the tasks of the parallel queries.
+    // All parallel queries share one executor, which could be replaced by set_executor.
+    class executor
+    {
+    public:
+        virtual ~executor() = default;
+
+        // Runs the task later on any thread.
+        virtual void submit(std::function<void()> task) = 0;
+
+        // The count of the threads running the tasks, not including the submitting one.
+        virtual std::size_t concurrency() const noexcept = 0;
+
+        // Runs a pending task on the calling thread while it waits, and returns false if there is none.
+        virtual bool try_run_one() { return false; }
+    };
+
+    namespace impl
+    {
+        // A double-ended queue of tasks. The owner pushes and pops at the bottom, and the thieves steal from the top without locks.
+        // It is the deque of Chase and Lev, with sequentially consistent indices.
+        template <typename T>
+        class work_deque
+        {
+        private:
+            struct buffer
+            {
+                std::size_t capacity;
+                std::unique_ptr<std::atomic<T*>[]> items;
+
+                explicit buffer(std::size_t capacity) : capacity(capacity), items(new std::atomic<T*>[capacity]) {}
+
+                T* get(std::ptrdiff_t i) const noexcept { return items[static_cast<std::size_t>(i) & (capacity - 1)].load(std::memory_order_relaxed); }
+                void put(std::ptrdiff_t i, T* item) noexcept { items[static_cast<std::size_t>(i) & (capacity - 1)].store(item, std::memory_order_relaxed); }
+            };
+
+            std::atomic<std::ptrdiff_t> m_top{ 0 }, m_bottom{ 0 };
+            std::atomic<buffer*> m_buffer;
+            // The replaced buffers are kept, because a thief may still read them.
+            std::vector<std::unique_ptr<buffer>> m_buffers;
+
+        public:
+            explicit work_deque(std::size_t capacity = 256)
+            {
+                m_buffers.push_back(std::make_unique<buffer>(capacity));
+                m_buffer.store(m_buffers.back().get());
+            }
+
+            // Only the owner could push.
+            void push(T* item)
+            {
+                std::ptrdiff_t b = m_bottom.load();
+                std::ptrdiff_t t = m_top.load();
+                buffer* a = m_buffer.load();
+                if (b - t >= static_cast<std::ptrdiff_t>(a->capacity))
+                {
+                    auto grown = std::make_unique<buffer>(a->capacity * 2);
+                    for (std::ptrdiff_t i = t; i < b; i++)
+                        grown->put(i, a->get(i));
+                    a = grown.get();
+                    m_buffers.push_back(std::move(grown));
+                    m_buffer.store(a);
+                }
+                a->put(b, item);
+                m_bottom.store(b + 1);
+            }
+
+            // Only the owner could pop.
+            T* pop()
+            {
+                std::ptrdiff_t b = m_bottom.load() - 1;
+                buffer* a = m_buffer.load();
+                m_bottom.store(b);
+                std::ptrdiff_t t = m_top.load();
+                if (t > b)
+                {
+                    m_bottom.store(b + 1);
+                    return nullptr;
+                }
+                T* item = a->get(b);
+                if (t == b)
+                {
+                    // The last item is raced with the thieves.
+                    if (!m_top.compare_exchange_strong(t, t + 1)) item = nullptr;
+                    m_bottom.store(b + 1);
+                }
+                return item;
+            }
+
+            T* steal()
+            {
+                std::ptrdiff_t t = m_top.load();
+                std::ptrdiff_t b = m_bottom.load();
+                if (t >= b) return nullptr;
+                T* item = m_buffer.load()->get(t);
+                if (!m_top.compare_exchange_strong(t, t + 1)) return nullptr;
+                return item;
+            }
+
+            bool empty() const noexcept { return m_top.load() >= m_bottom.load(); }
+        };
+
+        // The default executor. Each worker owns a deque, and steals from the others when it runs out of tasks.
+        // A task submitted by a worker is pushed to its own deque, so that nested queries stay local;
+        // a task submitted by another thread is queued in a shared list.
+        class work_stealing_executor : public executor
+        {
+        private:
+            using task_type = std::function<void()>;
+
+            std::vector<std::unique_ptr<work_deque<task_type>>> m_deques;
+            std::vector<std::thread> m_threads;
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::deque<task_type*> m_injected;
+            // The count of the submitted tasks which are not taken yet.
+            std::atomic<std::size_t> m_pending{ 0 };
+            bool m_stop{ false };
+
+            inline static thread_local work_stealing_executor* t_owner{ nullptr };
+            inline static thread_local std::size_t t_index{ 0 };
+
+            task_type* take_injected()
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                if (m_injected.empty()) return nullptr;
+                task_type* task = m_injected.front();
+                m_injected.pop_front();
+                return task;
+            }
+
+            // Finds a task from the own deque, the shared list, or the deques of the others in turn.
+            task_type* find_task(std::size_t index)
+            {
+                bool is_worker = index < m_deques.size();
+                task_type* task = is_worker ? m_deques[index]->pop() : nullptr;
+                if (!task) task = take_injected();
+                for (std::size_t i = 1; !task && i <= m_deques.size(); i++)
+                    task = m_deques[(index + i) % m_deques.size()]->steal();
+                if (task) m_pending.fetch_sub(1);
+                return task;
+            }
+
+            static void run_task(task_type* task)
+            {
+                std::unique_ptr<task_type> holder{ task };
+                (*holder)();
+            }
+
+            void run(std::size_t index)
+            {
+                t_owner = this;
+                t_index = index;
+                for (;;)
+                {
+                    if (task_type* task = find_task(index))
+                    {
+                        run_task(task);
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock{ m_mutex };
+                    m_cond.wait(lock, [this] { return m_stop || m_pending.load() > 0; });
+                    if (m_stop) return;
+                }
+            }
+
+        public:
+            explicit work_stealing_executor(std::size_t count)
+            {
+                for (std::size_t i = 0; i < count; i++)
+                    m_deques.push_back(std::make_unique<work_deque<task_type>>());
+                for (std::size_t i = 0; i < count; i++)
+                    m_threads.emplace_back([this, i] { run(i); });
+            }
+
+            ~work_stealing_executor() override
+            {
+                {
+                    std::lock_guard<std::mutex> lock{ m_mutex };
+                    m_stop = true;
+                }
+                m_cond.notify_all();
+                for (auto& thread : m_threads)
+                    thread.join();
+                for (task_type* task : m_injected)
+                    delete task;
+                for (auto& deque : m_deques)
+                {
+                    while (task_type* task = deque->pop())
+                        delete task;
+                }
+            }
+
+            void submit(std::function<void()> task) override
+            {
+                auto item = std::make_unique<task_type>(std::move(task));
+                // The count goes up before the task is published, so that a thief taking it at once could not wrap the count below zero.
+                m_pending.fetch_add(1);
+                try
+                {
+                    if (t_owner == this)
+                    {
+                        m_deques[t_index]->push(item.get());
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> lock{ m_mutex };
+                        m_injected.push_back(item.get());
+                    }
+                }
+                catch (...)
+                {
+                    m_pending.fetch_sub(1);
+                    throw;
+                }
+                item.release();
+                // Locks the mutex so that a worker could not miss the notification between its check and its wait.
+                {
+                    std::lock_guard<std::mutex> lock{ m_mutex };
+                }
+                m_cond.notify_one();
+            }
+
+            std::size_t concurrency() const noexcept override { return m_threads.size(); }
+
+            bool try_run_one() override
+            {
+                task_type* task = find_task(t_owner == this ? t_index : m_deques.size());
+                if (!task) return false;
+                run_task(task);
+                return true;
+            }
+        };
+
+        struct executor_storage
+        {
+            std::mutex mutex;
+            std::shared_ptr<executor> current;
+
+            static executor_storage& instance()
+            {
+                static executor_storage storage;
+                return storage;
+            }
+        };
+
+        inline std::shared_ptr<executor> make_default_executor()
+        {
+            // The calling thread works too, so there is one worker less than the cores.
+            static std::shared_ptr<executor> default_executor = std::make_shared<work_stealing_executor>((std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+            return default_executor;
+        }
+    } // namespace impl
+
+    // Gets the executor of the parallel queries.
+    inline std::shared_ptr<executor> get_executor()
+    {
+        auto& storage = impl::executor_storage::instance();
+        std::lock_guard<std::mutex> lock{ storage.mutex };
+        if (!storage.current) storage.current = impl::make_default_executor();
+        return storage.current;
+    }
+
+    // Replaces the executor of the parallel queries, or restores the default one with nullptr.
+    // The running queries keep the executor they started with.
+    inline void set_executor(std::shared_ptr<executor> exec)
+    {
+        auto& storage = impl::executor_storage::instance();
+        std::lock_guard<std::mutex> lock{ storage.mutex };
+        storage.current = std::move(exec);
+    }
+
+    namespace impl
+    {
+        inline std::size_t default_thread_count() { return get_executor()->concurrency() + 1; }
+
+        // Runs func(i) for each i in [0, count), with at most the specified count of threads including the calling one.
+        // The calling thread waits for the indices rather than the helpers,
+        // so that a helper which starts late finds nothing to do, and a nested call never waits for a queued task.
+        // It runs the other pending tasks while waiting.
+        template <typename Func>
+        void parallel_for(std::size_t count, std::size_t threads, Func&& func)
+        {
+            struct state_type
+            {
+                std::atomic<std::size_t> next{ 0 }, done{ 0 };
+                std::mutex mutex;
+                std::condition_variable cond;
+                std::exception_ptr error;
+            };
+            auto state = std::make_shared<state_type>();
+            auto work = [state, count, f = std::addressof(func)]() {
+                for (std::size_t i; (i = state->next.fetch_add(1)) < count;)
+                {
+                    try
+                    {
+                        (*f)(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock{ state->mutex };
+                        if (!state->error) state->error = std::current_exception();
+                    }
+                    if (state->done.fetch_add(1) + 1 == count)
+                    {
+                        std::lock_guard<std::mutex> lock{ state->mutex };
+                        state->cond.notify_all();
+                    }
+                }
+            };
+            auto exec = get_executor();
+            std::size_t helpers = (std::min)({ count, threads, exec->concurrency() + 1 });
+            for (std::size_t i = 1; i < helpers; i++)
+                exec->submit(work);
+            work();
+            while (state->done.load() != count)
+            {
+                if (!exec->try_run_one())
+                {
+                    std::unique_lock<std::mutex> lock{ state->mutex };
+                    state->cond.wait(lock, [&] { return state->done.load() == count; });
+                }
+            }
+            if (state->error) std::rethrow_exception(state->error);
+        }
+
+        inline constexpr std::size_t default_grain_size{ 1024 };
+
+        struct parallel_options
+        {
+            // The count of the threads, including the calling one.
+            std::size_t threads;
+            // The minimum count of the source elements in a chunk.
+            std::size_t grain;
+        };
+
+        // A stage which provides rebase(begin, end) creates the same stage over a part of its source,
+        // so that it could be split by its source. The rebased stage could be unseeked,
+        // and it is sought by the thread which runs the part.
+        template <typename Impl, typename = void>
+        inline constexpr bool has_rebase_v{ false };
+
+        template <typename Impl>
+        inline constexpr bool has_rebase_v<Impl, std::void_t<decltype(std::declval<const Impl&>().rebase(std::declval<const Impl&>().source_begin(), std::declval<const Impl&>().source_end()))>>{ true };
+
+        // A random access range could be split directly, and a rebased stage could be split by its source.
+        template <typename It>
+        struct is_splittable : std::bool_constant<is_iterator_category_v<It, std::random_access_iterator_tag>>
+        {
+        };
+
+        template <typename Impl>
+        struct is_source_splittable : is_splittable<std::decay_t<decltype(std::declval<const Impl&>().source_begin())>>
+        {
+        };
+
+        template <typename Impl>
+        struct is_splittable<iterator_base<Impl>> : std::disjunction<
+                                                        std::bool_constant<is_iterator_category_v<iterator_base<Impl>, std::random_access_iterator_tag>>,
+                                                        std::conjunction<std::bool_constant<has_rebase_v<Impl>>, is_source_splittable<Impl>>>
+        {
+        };
+
+        template <typename It>
+        inline constexpr bool is_splittable_v{ is_splittable<It>::value };
+
+        // Splits a range into at most the specified count of chunks, each of which has at least grain elements of the innermost source.
+        template <typename It>
+        std::vector<std::pair<It, It>> split_range(const It& begin, const It& end, std::size_t count, std::size_t grain)
+        {
+            std::vector<std::pair<It, It>> result;
+            if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag>)
+            {
+                auto size = static_cast<std::size_t>(end - begin);
+                std::size_t chunks = (std::max)(std::size_t{ 1 }, (std::min)(count, size / (std::max)(grain, std::size_t{ 1 })));
+                result.reserve(chunks);
+                for (std::size_t i = 0; i < chunks; i++)
+                    result.emplace_back(begin + static_cast<std::ptrdiff_t>(size * i / chunks), begin + static_cast<std::ptrdiff_t>(size * (i + 1) / chunks));
+            }
+            else
+            {
+                auto impl = iterable_access::get_impl(begin);
+                if (!impl || begin == end) return result;
+                auto end_impl = iterable_access::get_impl(end);
+                // An empty end means the end of the source, otherwise it is the end of a subrange.
+                auto sources = split_range(impl->source_begin(), end_impl && end != sentinel ? end_impl->source_begin() : impl->source_end(), count, grain);
+                result.reserve(sources.size());
+                for (auto& [source_begin, source_end] : sources)
+                {
+                    It chunk{ iterator_ctor, impl->rebase(std::move(source_begin), std::move(source_end)) };
+                    It chunk_end = iterable_access::end_of(chunk);
+                    result.emplace_back(std::move(chunk), std::move(chunk_end));
+                }
+            }
+            return result;
+        }
+
+        // An enumerable whose terminal queries run by chunks on the thread pool.
+        template <typename It>
+        class parallel_iterable : public iterable<It>
+        {
+        private:
+            parallel_options m_options;
+
+        public:
+            parallel_iterable(iterable<It>&& e, parallel_options options) : iterable<It>(std::move(e)), m_options(options) {}
+
+            const parallel_options& options() const noexcept { return m_options; }
+
+            // Splits the enumerable into chunks, or returns the whole range if it could not be split.
+            std::vector<std::pair<It, It>> split() const
+            {
+                if constexpr (is_splittable_v<It>)
+                {
+                    // More chunks than threads balance the work when the stages filter the elements unevenly.
+                    return split_range(this->begin(), this->end(), m_options.threads * 4, m_options.grain);
+                }
+                else
+                {
+                    std::vector<std::pair<It, It>> result;
+                    result.emplace_back(this->begin(), this->end());
+                    return result;
+                }
+            }
+        };
+
+        template <typename T>
+        inline constexpr bool is_parallel_v{ false };
+
+        template <typename It>
+        inline constexpr bool is_parallel_v<parallel_iterable<It>>{ true };
+
+        inline constexpr std::size_t cache_line_size{ 64 };
+
+        // A partial result of a chunk. It owns a whole cache line, so that the threads writing the neighbours do not share it.
+        template <typename T>
+        struct alignas(cache_line_size) padded_partial
+        {
+            std::optional<T> value{};
+        };
+
+        // Runs func(begin, end, index) over the chunks in parallel.
+        template <typename It, typename Func>
+        void for_each_chunk(const std::vector<std::pair<It, It>>& chunks, std::size_t threads, Func&& func)
+        {
+            parallel_for(chunks.size(), threads, [&](std::size_t i) {
+                It begin{ chunks[i].first };
+                iterable_access::seek_first(begin);
+                func(begin, chunks[i].second, i);
+            });
+        }
+
+        template <typename It, typename Func>
+        void for_each_chunk(const parallel_iterable<It>& e, Func&& func)
+        {
+            for_each_chunk(e.split(), e.options().threads, std::forward<Func>(func));
+        }
+
+        // Runs func(begin, end, index) over the chunks in parallel, and collects the results in order.
+        template <typename It, typename Func>
+        auto map_chunks(const parallel_iterable<It>& e, Func&& func)
+        {
+            using result_type = std::decay_t<decltype(func(std::declval<It&>(), std::declval<const It&>(), std::size_t{}))>;
+            auto chunks = e.split();
+            std::vector<padded_partial<result_type>> results(chunks.size());
+            for_each_chunk(chunks, e.options().threads, [&](It& begin, const It& end, std::size_t i) { results[i].value.emplace(func(begin, end, i)); });
+            return results;
+        }
+
+        // Folds an element into a partial result. The fold could return false once the result is decided.
+        template <typename T, typename Fold, typename Item>
+        bool fold_item(T& result, Fold& fold, Item& item)
+        {
+            if constexpr (std::is_void_v<decltype(fold(result, item))>)
+            {
+                fold(result, item);
+                return true;
+            }
+            else
+            {
+                return static_cast<bool>(fold(result, item));
+            }
+        }
+
+        // Reduces the enumerable from the identity.
+        // A parallel enumerable is folded by chunks, and the partial results are combined in order.
+        // Once a fold decides the result, all chunks stop.
+        template <typename Container, typename T, typename Fold, typename Combine>
+        T reduce(Container&& container, const T& identity, Fold&& fold, Combine&& combine)
+        {
+            if constexpr (is_parallel_v<std::decay_t<Container>>)
+            {
+                std::atomic<bool> decided{ false };
+                auto partials = map_chunks(container, [&](auto& begin, const auto& end, std::size_t) {
+                    T result{ identity };
+                    push_range(begin, end, [&](auto&& item) {
+                        if constexpr (std::is_void_v<decltype(fold(result, item))>)
+                        {
+                            fold(result, item);
+                            return true;
+                        }
+                        else
+                        {
+                            if (decided.load(std::memory_order_relaxed)) return false;
+                            if (fold(result, item)) return true;
+                            decided.store(true, std::memory_order_relaxed);
+                            return false;
+                        }
+                    });
+                    return result;
+                });
+                T result{ identity };
+                for (auto& partial : partials)
+                    result = combine(result, *partial.value);
+                return result;
+            }
+            else
+            {
+                T result{ identity };
+                push_each(container, [&](auto&& item) { return fold_item(result, fold, item); });
+                return result;
+            }
+        }
+
+        // Copies the chunks into a vector. The chunks of a random access enumerable are copied to their places directly.
+        template <typename T, typename Allocator, typename It>
+        std::vector<T, Allocator> parallel_make_vector(const parallel_iterable<It>& e, const Allocator& alloc)
+        {
+            if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag> && std::is_default_constructible_v<T>)
+            {
+                auto begin = e.begin();
+                std::vector<T, Allocator> result(static_cast<std::size_t>(e.end() - begin), alloc);
+                for_each_chunk(e, [&](It& first, const It& last, std::size_t) { std::copy(first, last, result.begin() + (first - begin)); });
+                return result;
+            }
+            else
+            {
+                auto parts = map_chunks(e, [&](It& first, const It& last, std::size_t) {
+                    std::vector<T, Allocator> result(alloc);
+                    push_range(first, last, [&](auto&& item) {
+                        result.emplace_back(std::forward<decltype(item)>(item));
+                        return true;
+                    });
+                    return result;
+                });
+                std::size_t size{ 0 };
+                for (auto& part : parts)
+                    size += part.value->size();
+                std::vector<T, Allocator> result(alloc);
+                result.reserve(size);
+                for (auto& part : parts)
+                    result.insert(result.end(), std::make_move_iterator(part.value->begin()), std::make_move_iterator(part.value->end()));
+                return result;
+            }
+        }
+
+        // Sorts a range, stably if specified.
+        template <bool Stable, typename RandomIt, typename Compare>
+        void sort_range(RandomIt first, RandomIt last, Compare&& comp)
+        {
+            if constexpr (Stable)
+                std::stable_sort(first, last, comp);
+            else
+                std::sort(first, last, comp);
+        }
+
+        // Gets the count of the elements taken from the first run, when the first k elements of two merged runs are taken.
+        // The elements of the first run go before the equivalent ones of the second run.
+        template <typename RandomIt, typename Compare>
+        std::size_t merge_split(RandomIt first1, std::size_t size1, RandomIt first2, std::size_t size2, std::size_t k, Compare& comp)
+        {
+            std::size_t lo = k > size2 ? k - size2 : 0;
+            std::size_t hi = (std::min)(k, size1);
+            while (lo < hi)
+            {
+                std::size_t i = lo + (hi - lo) / 2;
+                if (!comp(first2[k - i - 1], first1[i]))
+                    lo = i + 1;
+                else
+                    hi = i;
+            }
+            return lo;
+        }
+
+        // Sorts the vector by chunks in parallel, and merges the sorted runs pairwise in rounds.
+        // Each round is split into pieces of the output, so that all threads work until the last round.
+        // A merge keeps the order of the runs, so the sort is stable if the chunks are sorted stably.
+        template <bool Stable, typename T, typename Allocator, typename Compare>
+        void parallel_sort(std::vector<T, Allocator>& v, Compare& comp, const parallel_options& options)
+        {
+            std::size_t size = v.size();
+            std::size_t grain = (std::max)(options.grain, std::size_t{ 1 });
+            std::size_t runs = (std::min)(options.threads, size / grain);
+            if (runs <= 1)
+            {
+                sort_range<Stable>(v.begin(), v.end(), comp);
+                return;
+            }
+            std::vector<std::size_t> bounds(runs + 1);
+            for (std::size_t i = 0; i <= runs; i++)
+                bounds[i] = size * i / runs;
+            parallel_for(runs, options.threads, [&](std::size_t i) { sort_range<Stable>(v.begin() + bounds[i], v.begin() + bounds[i + 1], comp); });
+            if constexpr (std::is_default_constructible_v<T>)
+            {
+                struct piece
+                {
+                    std::size_t first1, last1, first2, last2, out;
+                };
+                std::size_t piece_size = (std::max)(grain, (size + options.threads - 1) / options.threads);
+                std::vector<T, Allocator> buffer(size, v.get_allocator());
+                auto* from = &v;
+                auto* to = &buffer;
+                for (std::size_t width = 1; width < runs; width *= 2)
+                {
+                    // The pieces are split before merging, because the merges move the elements away.
+                    std::vector<piece> pieces;
+                    for (std::size_t lo = 0; lo < runs; lo += width * 2)
+                    {
+                        std::size_t begin = bounds[lo];
+                        std::size_t mid = bounds[(std::min)(lo + width, runs)];
+                        std::size_t end = bounds[(std::min)(lo + width * 2, runs)];
+                        auto src = from->begin();
+                        std::size_t i = 0;
+                        for (std::size_t k = 0; k < end - begin;)
+                        {
+                            std::size_t next = (std::min)(k + piece_size, end - begin);
+                            std::size_t inext = merge_split(src + begin, mid - begin, src + mid, end - mid, next, comp);
+                            pieces.push_back({ begin + i, begin + inext, mid + (k - i), mid + (next - inext), begin + k });
+                            i = inext;
+                            k = next;
+                        }
+                    }
+                    parallel_for(pieces.size(), options.threads, [&](std::size_t i) {
+                        auto& p = pieces[i];
+                        auto src = from->begin();
+                        std::merge(std::make_move_iterator(src + p.first1), std::make_move_iterator(src + p.last1),
+                                   std::make_move_iterator(src + p.first2), std::make_move_iterator(src + p.last2),
+                                   to->begin() + p.out, comp);
+                    });
+                    std::swap(from, to);
+                }
+                if (from != &v) v.swap(buffer);
+            }
+            else
+            {
+                // Without a buffer, the runs are merged in place, and only the pairs run in parallel.
+                for (std::size_t width = 1; width < runs; width *= 2)
+                {
+                    parallel_for((runs + width * 2 - 1) / (width * 2), options.threads, [&](std::size_t i) {
+                        std::size_t lo = i * width * 2;
+                        std::inplace_merge(v.begin() + bounds[lo], v.begin() + bounds[(std::min)(lo + width, runs)], v.begin() + bounds[(std::min)(lo + width * 2, runs)], comp);
+                    });
+                }
+            }
+        }
+    } // namespace impl
+
+    // Runs the terminal query by chunks on the thread pool.
+    // The stages before it are split with the source, if the source is random access,
+    // and they are where, select or random access stages.
+    // The thread count includes the calling thread, and defaults to the count of the cores.
+    // The grain size is the minimum count of the source elements in a chunk.
+    constexpr auto parallel(std::size_t threads = 0, std::size_t grain = impl::default_grain_size)
+    {
+        return impl::make_query(
+            [](auto&& container, impl::parallel_options options) {
+                if (!options.threads) options.threads = impl::default_thread_count();
+                using It = decltype(std::begin(container));
+                // A move-only iterator could not be split, so the query runs sequentially.
+                if constexpr (std::is_copy_constructible_v<It>)
+                    return impl::parallel_iterable<It>{ impl::iterable<It>{ std::begin(container), std::end(container), impl::fixed_size(container) }, options };
+                else
+                    return impl::iterable<It>{ std::begin(container), std::end(container), impl::fixed_size(container) };
+            },
+            impl::parallel_options{ threads, grain });
+    }
+} // namespace linq
+
+#endif // !LINQ_PARALLEL_HPP
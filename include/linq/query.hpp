@@ -26,6 +26,7 @@
 #ifndef LINQ_QUERY_HPP
 #define LINQ_QUERY_HPP
 
+#include <algorithm>
 #include <linq/core.hpp>
 #include <tuple>
 
@@ -50,9 +51,18 @@ namespace linq
 
         public:
             using traits_type = std::iterator_traits<It>;
+            using iterator_category = min_iterator_category_t<std::bidirectional_iterator_tag, typename traits_type::iterator_category>;
 
             where_iterator_impl(It begin, It end, Pred&& pred)
-                : m_begin(begin), m_end(end), m_pred(std::forward<Pred>(pred)) { move_next_impl(); }
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)) { move_next_impl(); }
+            where_iterator_impl(unseeked_t, It begin, It end, Pred&& pred)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)) {}
+
+            void seek_first()
+            {
+                iterable_access::seek_first(m_begin);
+                move_next_impl();
+            }
 
             typename traits_type::reference value() const noexcept { return *m_begin; }
 
@@ -63,21 +73,70 @@ namespace linq
             }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const where_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end() { m_begin = m_end; }
+
+            void move_prev()
+            {
+                do
+                {
+                    --m_begin;
+                } while (!m_pred(*m_begin));
+            }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                // The current element has been tested.
+                if (m_begin == m_end) return true;
+                if (!sink(*m_begin)) return false;
+                ++m_begin;
+                return push_range(m_begin, m_end, [&](auto&& item) { return !m_pred(item) || sink(std::forward<decltype(item)>(item)); });
+            }
+
+            const It& source_begin() const noexcept { return m_begin; }
+            const It& source_end() const noexcept { return m_end; }
+            const std::decay_t<Pred>& pred() const noexcept { return m_pred; }
+
+            // Creates the same stage over a part of the source.
+            // It is unseeked, so that the first element is sought by the thread which runs the part.
+            where_iterator_impl rebase(It begin, It end) const { return { unseeked, std::move(begin), std::move(end), std::decay_t<Pred>{ m_pred } }; }
         };
 
         template <typename It, typename Pred>
         using where_iterator = iterator_base<where_iterator_impl<It, Pred>>;
-    } // namespace impl
 
-    // Filters an enumerable based on a predicate.
-    template <typename Pred>
-    constexpr auto where(Pred&& pred)
-    {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::where_iterator<It, Pred>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
+        // Combines the predicates of adjacent where stages.
+        template <typename Pred1, typename Pred2>
+        struct and_pred
+        {
+            Pred1 m_pred1;
+            Pred2 m_pred2;
+
+            template <typename T>
+            bool operator()(T&& t)
+            {
+                return m_pred1(t) && m_pred2(t);
+            }
         };
-    }
+
+        template <typename T>
+        inline constexpr bool is_where_iterable_v{ false };
+
+        template <typename It, typename Pred>
+        inline constexpr bool is_where_iterable_v<iterable<where_iterator<It, Pred>>>{ std::is_copy_constructible_v<where_iterator_impl<It, Pred>> };
+
+        template <typename It, typename Pred1, typename Pred2>
+        auto fuse_where(const iterable<where_iterator<It, Pred1>>& e, Pred2&& pred)
+        {
+            using pred_type = and_pred<std::decay_t<Pred1>, std::decay_t<Pred2>>;
+            return fuse_stage<where_iterator<It, pred_type>>(e, [&](const It& begin, const It& end, const auto& impl) {
+                return where_iterator<It, pred_type>{ iterator_ctor, begin, end, pred_type{ impl.pred(), std::forward<Pred2>(pred) } };
+            });
+        }
+    } // namespace impl
 
     namespace impl
     {
@@ -101,7 +160,7 @@ namespace linq
             using traits_type = std::iterator_traits<It>;
 
             where_index_iterator_impl(It begin, It end, Pred&& pred)
-                : m_begin(begin), m_end(end), m_pred(std::forward<Pred>(pred)) { move_next_impl(); }
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)) { move_next_impl(); }
 
             typename traits_type::reference value() const noexcept { return *m_begin; }
 
@@ -113,6 +172,15 @@ namespace linq
             }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                if (m_begin == m_end) return true;
+                if (!sink(*m_begin)) return false;
+                ++m_begin;
+                return push_range(m_begin, m_end, [&](auto&& item) { return !m_pred(item, ++m_index) || sink(std::forward<decltype(item)>(item)); });
+            }
         };
 
         template <typename It, typename Pred>
@@ -123,10 +191,12 @@ namespace linq
     template <typename Pred>
     constexpr auto where_index(Pred&& pred)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::where_index_iterator<It, Pred>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::where_index_iterator<It, decltype(pred)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -138,45 +208,380 @@ namespace linq
             It m_begin, m_end;
             std::decay_t<Selector> m_selector;
 
-            using result_type = std::remove_cv_t<decltype(std::declval<Selector>()(std::declval<typename std::iterator_traits<It>::reference>()))>;
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<It>::reference>()));
 
-            std::optional<result_type> m_result{};
+            // A random access iterator is usually read once at each position, so the result is not cached.
+            result_cache<result_type, !is_iterator_category_v<It, std::random_access_iterator_tag>> m_result{};
 
-            void set_result()
+        public:
+            using traits_type = result_impl_traits<result_type>;
+            using iterator_category = typename std::iterator_traits<It>::iterator_category;
+
+            select_iterator_impl(It begin, It end, Selector&& selector)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_selector(std::forward<Selector>(selector)) {}
+
+            // The result is calculated lazily, so that no buffer is needed.
+            typename traits_type::reference value()
+            {
+                return m_result.get([this]() -> result_type { return m_selector(*m_begin); });
+            }
+
+            void move_next()
+            {
+                ++m_begin;
+                m_result.reset();
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const select_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end()
             {
-                if (m_begin != m_end)
-                    m_result = m_selector(*m_begin);
+                m_begin = m_end;
+                m_result.reset();
+            }
+
+            void move_prev()
+            {
+                --m_begin;
+                m_result.reset();
+            }
+
+            void advance(std::ptrdiff_t n)
+            {
+                m_begin += n;
+                m_result.reset();
+            }
+
+            std::ptrdiff_t distance_to(const select_iterator_impl& it) const { return it.m_begin - m_begin; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, [&](auto&& item) { return sink(m_selector(std::forward<decltype(item)>(item))); });
+            }
+
+            const It& source_begin() const noexcept { return m_begin; }
+            const It& source_end() const noexcept { return m_end; }
+            const std::decay_t<Selector>& selector() const noexcept { return m_selector; }
+
+            void seek_first() { iterable_access::seek_first(m_begin); }
+
+            select_iterator_impl rebase(It begin, It end) const { return { std::move(begin), std::move(end), std::decay_t<Selector>{ m_selector } }; }
+        };
+
+        template <typename It, typename Selector>
+        using select_iterator = iterator_base<select_iterator_impl<It, Selector>>;
+
+        // Filters the elements and projects them in one stage.
+        template <typename It, typename Pred, typename Selector>
+        class where_select_iterator_impl
+        {
+        private:
+            It m_begin, m_end;
+            std::decay_t<Pred> m_pred;
+            std::decay_t<Selector> m_selector;
+
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<It>::reference>()));
+
+            result_cache<result_type> m_result{};
+
+            void move_next_impl()
+            {
+                for (; m_begin != m_end; ++m_begin)
+                {
+                    if (m_pred(*m_begin)) break;
+                }
             }
 
         public:
-            using traits_type = iterator_impl_traits<result_type>;
+            using traits_type = result_impl_traits<result_type>;
+            using iterator_category = min_iterator_category_t<std::bidirectional_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
 
-            select_iterator_impl(It begin, It end, Selector&& selector)
-                : m_begin(begin), m_end(end), m_selector(std::forward<Selector>(selector)) { set_result(); }
+            where_select_iterator_impl(It begin, It end, Pred&& pred, Selector&& selector)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)), m_selector(std::forward<Selector>(selector)) { move_next_impl(); }
+            where_select_iterator_impl(unseeked_t, It begin, It end, Pred&& pred, Selector&& selector)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)), m_selector(std::forward<Selector>(selector)) {}
 
-            typename traits_type::reference value() const noexcept { return *m_result; }
+            void seek_first()
+            {
+                iterable_access::seek_first(m_begin);
+                move_next_impl();
+            }
+
+            typename traits_type::reference value()
+            {
+                return m_result.get([this]() -> result_type { return m_selector(*m_begin); });
+            }
 
             void move_next()
             {
                 ++m_begin;
-                set_result();
+                m_result.reset();
+                move_next_impl();
             }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const where_select_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end()
+            {
+                m_begin = m_end;
+                m_result.reset();
+            }
+
+            void move_prev()
+            {
+                m_result.reset();
+                do
+                {
+                    --m_begin;
+                } while (!m_pred(*m_begin));
+            }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                if (m_begin == m_end) return true;
+                if (!sink(m_selector(*m_begin))) return false;
+                ++m_begin;
+                return push_range(m_begin, m_end, [&](auto&& item) { return !m_pred(item) || sink(m_selector(std::forward<decltype(item)>(item))); });
+            }
+
+            const It& source_begin() const noexcept { return m_begin; }
+            const It& source_end() const noexcept { return m_end; }
+            const std::decay_t<Pred>& pred() const noexcept { return m_pred; }
+            const std::decay_t<Selector>& selector() const noexcept { return m_selector; }
+
+            where_select_iterator_impl rebase(It begin, It end) const { return { unseeked, std::move(begin), std::move(end), std::decay_t<Pred>{ m_pred }, std::decay_t<Selector>{ m_selector } }; }
+        };
+
+        template <typename It, typename Pred, typename Selector>
+        using where_select_iterator = iterator_base<where_select_iterator_impl<It, Pred, Selector>>;
+
+        // Composes the selectors of adjacent select stages.
+        template <typename Selector1, typename Selector2>
+        struct compose_selector
+        {
+            Selector1 m_selector1;
+            Selector2 m_selector2;
+
+            template <typename T>
+            decltype(auto) operator()(T&& t)
+            {
+                return m_selector2(m_selector1(std::forward<T>(t)));
+            }
         };
 
+        template <typename T>
+        inline constexpr bool is_select_iterable_v{ false };
+
         template <typename It, typename Selector>
-        using select_iterator = iterator_base<select_iterator_impl<It, Selector>>;
+        inline constexpr bool is_select_iterable_v<iterable<select_iterator<It, Selector>>>{ std::is_copy_constructible_v<select_iterator_impl<It, Selector>> };
+
+        template <typename T>
+        inline constexpr bool is_where_select_iterable_v{ false };
+
+        template <typename It, typename Pred, typename Selector>
+        inline constexpr bool is_where_select_iterable_v<iterable<where_select_iterator<It, Pred, Selector>>>{ std::is_copy_constructible_v<where_select_iterator_impl<It, Pred, Selector>> };
+
+        template <typename It, typename Selector1, typename Selector2>
+        auto fuse_select(const iterable<select_iterator<It, Selector1>>& e, Selector2&& selector)
+        {
+            using selector_type = compose_selector<std::decay_t<Selector1>, std::decay_t<Selector2>>;
+            return fuse_stage<select_iterator<It, selector_type>>(
+                e, [&](const It& begin, const It& end, const auto& impl) {
+                    return select_iterator<It, selector_type>{ iterator_ctor, begin, end, selector_type{ impl.selector(), std::forward<Selector2>(selector) } };
+                },
+                e.known_size());
+        }
+
+        template <typename It, typename Pred, typename Selector>
+        auto fuse_select(const iterable<where_iterator<It, Pred>>& e, Selector&& selector)
+        {
+            using pred_type = std::decay_t<Pred>;
+            using selector_type = std::decay_t<Selector>;
+            return fuse_stage<where_select_iterator<It, pred_type, selector_type>>(e, [&](const It& begin, const It& end, const auto& impl) {
+                return where_select_iterator<It, pred_type, selector_type>{ iterator_ctor, begin, end, pred_type{ impl.pred() }, selector_type{ std::forward<Selector>(selector) } };
+            });
+        }
+
+        template <typename It, typename Pred, typename Selector1, typename Selector2>
+        auto fuse_select(const iterable<where_select_iterator<It, Pred, Selector1>>& e, Selector2&& selector)
+        {
+            using pred_type = std::decay_t<Pred>;
+            using selector_type = compose_selector<std::decay_t<Selector1>, std::decay_t<Selector2>>;
+            return fuse_stage<where_select_iterator<It, pred_type, selector_type>>(e, [&](const It& begin, const It& end, const auto& impl) {
+                return where_select_iterator<It, pred_type, selector_type>{ iterator_ctor, begin, end, pred_type{ impl.pred() }, selector_type{ impl.selector(), std::forward<Selector2>(selector) } };
+            });
+        }
     } // namespace impl
 
     // Projects each element into a new form.
     template <typename Selector>
     constexpr auto select(Selector&& selector)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::select_iterator<It, Selector>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Selector>(selector) } };
+        return impl::make_query(
+            [](auto&& container, auto&& selector) {
+                using Container = std::decay_t<decltype(container)>;
+                if constexpr (impl::is_select_iterable_v<Container> || impl::is_where_iterable_v<Container> || impl::is_where_select_iterable_v<Container>)
+                {
+                    // A select stage is merged into the previous where or select stage.
+                    return impl::fuse_select(container, std::forward<decltype(selector)>(selector));
+                }
+                else
+                {
+                    using It = decltype(std::begin(container));
+                    return impl::iterable{ impl::select_iterator<It, decltype(selector)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(selector)>(selector) }, impl::fixed_size(container) };
+                }
+            },
+            std::forward<Selector>(selector));
+    }
+
+    namespace impl
+    {
+        // Projects the elements and filters the results in one stage.
+        // The result of each element is calculated once, and tested before it is returned.
+        template <typename It, typename Selector, typename Pred>
+        class select_where_iterator_impl
+        {
+        private:
+            It m_begin, m_end;
+            std::decay_t<Selector> m_selector;
+            std::decay_t<Pred> m_pred;
+
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<It>::reference>()));
+
+            result_cache<result_type> m_result{};
+
+            bool test() { return m_pred(m_result.get([this]() -> result_type { return m_selector(*m_begin); })); }
+
+            void move_next_impl()
+            {
+                for (; m_begin != m_end; ++m_begin, m_result.reset())
+                {
+                    if (test()) break;
+                }
+            }
+
+        public:
+            using traits_type = result_impl_traits<result_type>;
+            using iterator_category = min_iterator_category_t<std::bidirectional_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+            select_where_iterator_impl(It begin, It end, Selector&& selector, Pred&& pred)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_selector(std::forward<Selector>(selector)), m_pred(std::forward<Pred>(pred)) { move_next_impl(); }
+            select_where_iterator_impl(unseeked_t, It begin, It end, Selector&& selector, Pred&& pred)
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_selector(std::forward<Selector>(selector)), m_pred(std::forward<Pred>(pred)) {}
+
+            void seek_first()
+            {
+                iterable_access::seek_first(m_begin);
+                move_next_impl();
+            }
+
+            typename traits_type::reference value()
+            {
+                return m_result.get([this]() -> result_type { return m_selector(*m_begin); });
+            }
+
+            void move_next()
+            {
+                ++m_begin;
+                m_result.reset();
+                move_next_impl();
+            }
+
+            bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const select_where_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end()
+            {
+                m_begin = m_end;
+                m_result.reset();
+            }
+
+            void move_prev()
+            {
+                do
+                {
+                    --m_begin;
+                    m_result.reset();
+                } while (!test());
+            }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                // The current element has been tested.
+                if (m_begin == m_end) return true;
+                if (!sink(value())) return false;
+                ++m_begin;
+                return push_range(m_begin, m_end, [&](auto&& item) {
+                    decltype(auto) result = m_selector(std::forward<decltype(item)>(item));
+                    return !m_pred(result) || sink(std::forward<decltype(result)>(result));
+                });
+            }
+
+            const It& source_begin() const noexcept { return m_begin; }
+            const It& source_end() const noexcept { return m_end; }
+            const std::decay_t<Selector>& selector() const noexcept { return m_selector; }
+            const std::decay_t<Pred>& pred() const noexcept { return m_pred; }
+
+            select_where_iterator_impl rebase(It begin, It end) const { return { unseeked, std::move(begin), std::move(end), std::decay_t<Selector>{ m_selector }, std::decay_t<Pred>{ m_pred } }; }
         };
+
+        template <typename It, typename Selector, typename Pred>
+        using select_where_iterator = iterator_base<select_where_iterator_impl<It, Selector, Pred>>;
+
+        template <typename T>
+        inline constexpr bool is_select_where_iterable_v{ false };
+
+        template <typename It, typename Selector, typename Pred>
+        inline constexpr bool is_select_where_iterable_v<iterable<select_where_iterator<It, Selector, Pred>>>{ std::is_copy_constructible_v<select_where_iterator_impl<It, Selector, Pred>> };
+
+        template <typename It, typename Selector, typename Pred>
+        auto fuse_where(const iterable<select_iterator<It, Selector>>& e, Pred&& pred)
+        {
+            using selector_type = std::decay_t<Selector>;
+            using pred_type = std::decay_t<Pred>;
+            return fuse_stage<select_where_iterator<It, selector_type, pred_type>>(e, [&](const It& begin, const It& end, const auto& impl) {
+                return select_where_iterator<It, selector_type, pred_type>{ iterator_ctor, begin, end, selector_type{ impl.selector() }, pred_type{ std::forward<Pred>(pred) } };
+            });
+        }
+
+        template <typename It, typename Selector, typename Pred1, typename Pred2>
+        auto fuse_where(const iterable<select_where_iterator<It, Selector, Pred1>>& e, Pred2&& pred)
+        {
+            using selector_type = std::decay_t<Selector>;
+            using pred_type = and_pred<std::decay_t<Pred1>, std::decay_t<Pred2>>;
+            return fuse_stage<select_where_iterator<It, selector_type, pred_type>>(e, [&](const It& begin, const It& end, const auto& impl) {
+                return select_where_iterator<It, selector_type, pred_type>{ iterator_ctor, begin, end, selector_type{ impl.selector() }, pred_type{ impl.pred(), std::forward<Pred2>(pred) } };
+            });
+        }
+    } // namespace impl
+
+    // Filters an enumerable based on a predicate.
+    template <typename Pred>
+    constexpr auto where(Pred&& pred)
+    {
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using Container = std::decay_t<decltype(container)>;
+                if constexpr (impl::is_where_iterable_v<Container> || impl::is_select_iterable_v<Container> || impl::is_select_where_iterable_v<Container>)
+                {
+                    // A where stage is merged into the previous where or select stage.
+                    return impl::fuse_where(container, std::forward<decltype(pred)>(pred));
+                }
+                else
+                {
+                    using It = decltype(std::begin(container));
+                    return impl::iterable{ impl::where_iterator<It, decltype(pred)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+                }
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -189,32 +594,59 @@ namespace linq
             std::decay_t<Selector> m_selector;
             std::size_t m_index{ 0 };
 
-            using result_type = std::remove_cv_t<decltype(std::declval<Selector>()(std::declval<typename std::iterator_traits<It>::reference>(), m_index))>;
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<It>::reference>(), m_index));
 
-            std::optional<result_type> m_result{};
-
-            void set_result()
-            {
-                if (m_begin != m_end)
-                    m_result = m_selector(*m_begin, m_index);
-            }
+            static constexpr bool is_random_access{ is_iterator_category_v<It, std::random_access_iterator_tag> };
 
         public:
-            using traits_type = iterator_impl_traits<result_type>;
+            using traits_type = result_impl_traits<result_type>;
+            // The index at the end is unknown for bidirectional iterators.
+            using iterator_category = std::conditional_t<
+                is_random_access,
+                std::random_access_iterator_tag,
+                min_iterator_category_t<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>>;
 
             select_index_iterator_impl(It begin, It end, Selector&& selector)
-                : m_begin(begin), m_end(end), m_selector(std::forward<Selector>(selector)) { set_result(); }
+                : m_begin(std::move(begin)), m_end(std::move(end)), m_selector(std::forward<Selector>(selector)) {}
 
-            typename traits_type::reference value() const noexcept { return *m_result; }
+            typename traits_type::reference value() { return m_selector(*m_begin, m_index); }
 
             void move_next()
             {
                 ++m_begin;
                 ++m_index;
-                set_result();
             }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            bool equals(const select_index_iterator_impl& it) const { return m_begin == it.m_begin; }
+
+            void seek_end()
+            {
+                if constexpr (is_random_access)
+                    m_index += static_cast<std::size_t>(m_end - m_begin);
+                m_begin = m_end;
+            }
+
+            void move_prev()
+            {
+                --m_begin;
+                --m_index;
+            }
+
+            void advance(std::ptrdiff_t n)
+            {
+                m_begin += n;
+                m_index += n;
+            }
+
+            std::ptrdiff_t distance_to(const select_index_iterator_impl& it) const { return it.m_begin - m_begin; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, [&](auto&& item) { return sink(m_selector(std::forward<decltype(item)>(item), m_index++)); });
+            }
         };
 
         template <typename It, typename Selector>
@@ -225,10 +657,12 @@ namespace linq
     template <typename Selector>
     constexpr auto select_index(Selector&& selector)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::select_index_iterator<It, Selector>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Selector>(selector) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& selector) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::select_index_iterator<It, decltype(selector)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(selector)>(selector) }, impl::fixed_size(container) };
+            },
+            std::forward<Selector>(selector));
     }
 
     namespace impl
@@ -244,24 +678,50 @@ namespace linq
 
             using container_type = std::remove_reference_t<decltype(m_cselector(*m_begin1))>;
             std::optional<container_type> m_container{};
-
-            using result1_type = typename std::iterator_traits<It1>::pointer;
+            std::ptrdiff_t m_offset{ 0 };
+
+            using reference1_type = typename std::iterator_traits<It1>::reference;
+            // Stores the pointer to the outer element, or a copy of it if it is not an lvalue.
+            using result1_type = std::conditional_t<
+                std::is_lvalue_reference_v<reference1_type>,
+                std::add_pointer_t<std::remove_reference_t<reference1_type>>,
+                std::optional<typename std::iterator_traits<It1>::value_type>>;
             result1_type m_result1{};
+
+            void set_result1()
+            {
+                if constexpr (std::is_lvalue_reference_v<reference1_type>)
+                    m_result1 = std::addressof(*m_begin1);
+                else
+                    m_result1.emplace(*m_begin1);
+            }
             using result_type = decltype(m_rselector(*m_result1, *m_begin2));
             std::optional<result_type> m_result{};
 
+            // Empty inner sequences are skipped.
             void set_container()
             {
-                if (m_begin1 != m_end1)
+                for (; m_begin1 != m_end1; ++m_begin1)
                 {
-                    m_result1 = std::pointer_traits<result1_type>::pointer_to(*m_begin1);
+                    set_result1();
                     m_container.emplace(m_cselector(*m_result1));
                     m_begin2 = std::begin(*m_container);
                     m_end2 = std::end(*m_container);
+                    m_offset = 0;
+                    if (m_begin2 != m_end2) return;
                 }
-                else
+                m_container = std::nullopt;
+            }
+
+            // The inner iterators and the pointer to the outer element
+            // point into the copied or moved state, so they need to be rebased.
+            void rebase()
+            {
+                if (m_container)
                 {
-                    m_container = std::nullopt;
+                    set_result1();
+                    m_begin2 = std::next(std::begin(*m_container), m_offset);
+                    m_end2 = std::end(*m_container);
                 }
             }
 
@@ -275,18 +735,33 @@ namespace linq
             using traits_type = iterator_impl_traits<result_type>;
 
             select_many_iterator_impl(It1 begin, It1 end, CSelector&& cselector, RSelector&& rselector)
-                : m_begin1(begin), m_end1(end),
+                : m_begin1(std::move(begin)), m_end1(std::move(end)),
                   m_cselector(std::forward<CSelector>(cselector)), m_rselector(std::forward<RSelector>(rselector))
             {
                 set_container();
                 set_result();
             }
 
+            select_many_iterator_impl(const select_many_iterator_impl& it)
+                : m_begin1(it.m_begin1), m_end1(it.m_end1), m_cselector(it.m_cselector), m_rselector(it.m_rselector),
+                  m_container(it.m_container), m_offset(it.m_offset), m_result(it.m_result)
+            {
+                rebase();
+            }
+
+            select_many_iterator_impl(select_many_iterator_impl&& it)
+                : m_begin1(std::move(it.m_begin1)), m_end1(std::move(it.m_end1)), m_cselector(std::move(it.m_cselector)), m_rselector(std::move(it.m_rselector)),
+                  m_container(std::move(it.m_container)), m_offset(it.m_offset), m_result(std::move(it.m_result))
+            {
+                rebase();
+            }
+
             typename traits_type::reference value() const noexcept { return *m_result; }
 
             void move_next()
             {
                 ++m_begin2;
+                ++m_offset;
                 if (m_begin2 == m_end2)
                 {
                     ++m_begin1;
@@ -295,7 +770,7 @@ namespace linq
                 set_result();
             }
 
-            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+            bool is_valid() const { return m_begin1 != m_end1; }
         };
 
         template <typename It1, typename It2, typename CSelector, typename RSelector>
@@ -306,11 +781,13 @@ namespace linq
     template <typename CSelector, typename RSelector>
     constexpr auto select_many(CSelector&& cselector, RSelector&& rselector)
     {
-        return [&](auto&& container) {
-            using It1 = decltype(std::begin(container));
-            using It2 = decltype(std::begin(cselector(*std::begin(container))));
-            return impl::iterable{ impl::select_many_iterator<It1, It2, CSelector, RSelector>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<CSelector>(cselector), std::forward<RSelector>(rselector) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& cselector, auto&& rselector) {
+                using It1 = decltype(std::begin(container));
+                using It2 = decltype(std::begin(cselector(*std::begin(container))));
+                return impl::iterable{ impl::select_many_iterator<It1, It2, decltype(cselector), decltype(rselector)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(cselector)>(cselector), std::forward<decltype(rselector)>(rselector) } };
+            },
+            std::forward<CSelector>(cselector), std::forward<RSelector>(rselector));
     }
 
     namespace impl
@@ -327,25 +804,51 @@ namespace linq
 
             using container_type = std::remove_reference_t<decltype(m_cselector(*m_begin1, m_index))>;
             std::optional<container_type> m_container{};
-
-            using result1_type = typename std::iterator_traits<It1>::pointer;
+            std::ptrdiff_t m_offset{ 0 };
+
+            using reference1_type = typename std::iterator_traits<It1>::reference;
+            // Stores the pointer to the outer element, or a copy of it if it is not an lvalue.
+            using result1_type = std::conditional_t<
+                std::is_lvalue_reference_v<reference1_type>,
+                std::add_pointer_t<std::remove_reference_t<reference1_type>>,
+                std::optional<typename std::iterator_traits<It1>::value_type>>;
             result1_type m_result1{};
+
+            void set_result1()
+            {
+                if constexpr (std::is_lvalue_reference_v<reference1_type>)
+                    m_result1 = std::addressof(*m_begin1);
+                else
+                    m_result1.emplace(*m_begin1);
+            }
             using result_type = decltype(m_rselector(*m_result1, *m_begin2));
             std::optional<result_type> m_result{};
 
+            // Empty inner sequences are skipped.
             void set_container()
             {
-                if (m_begin1 != m_end1)
+                for (; m_begin1 != m_end1; ++m_begin1)
                 {
-                    m_result1 = std::pointer_traits<result1_type>::pointer_to(*m_begin1);
+                    set_result1();
                     m_container.emplace(m_cselector(*m_result1, m_index));
                     m_index++;
                     m_begin2 = std::begin(*m_container);
                     m_end2 = std::end(*m_container);
+                    m_offset = 0;
+                    if (m_begin2 != m_end2) return;
                 }
-                else
+                m_container = std::nullopt;
+            }
+
+            // The inner iterators and the pointer to the outer element
+            // point into the copied or moved state, so they need to be rebased.
+            void rebase()
+            {
+                if (m_container)
                 {
-                    m_container = std::nullopt;
+                    set_result1();
+                    m_begin2 = std::next(std::begin(*m_container), m_offset);
+                    m_end2 = std::end(*m_container);
                 }
             }
 
@@ -359,18 +862,33 @@ namespace linq
             using traits_type = iterator_impl_traits<result_type>;
 
             select_many_index_iterator_impl(It1 begin, It1 end, CSelector&& cselector, RSelector&& rselector)
-                : m_begin1(begin), m_end1(end),
+                : m_begin1(std::move(begin)), m_end1(std::move(end)),
                   m_cselector(std::forward<CSelector>(cselector)), m_rselector(std::forward<RSelector>(rselector))
             {
                 set_container();
                 set_result();
             }
 
+            select_many_index_iterator_impl(const select_many_index_iterator_impl& it)
+                : m_begin1(it.m_begin1), m_end1(it.m_end1), m_cselector(it.m_cselector), m_rselector(it.m_rselector), m_index(it.m_index),
+                  m_container(it.m_container), m_offset(it.m_offset), m_result(it.m_result)
+            {
+                rebase();
+            }
+
+            select_many_index_iterator_impl(select_many_index_iterator_impl&& it)
+                : m_begin1(std::move(it.m_begin1)), m_end1(std::move(it.m_end1)), m_cselector(std::move(it.m_cselector)), m_rselector(std::move(it.m_rselector)), m_index(it.m_index),
+                  m_container(std::move(it.m_container)), m_offset(it.m_offset), m_result(std::move(it.m_result))
+            {
+                rebase();
+            }
+
             typename traits_type::reference value() const noexcept { return *m_result; }
 
             void move_next()
             {
                 ++m_begin2;
+                ++m_offset;
                 if (m_begin2 == m_end2)
                 {
                     ++m_begin1;
@@ -379,7 +897,7 @@ namespace linq
                 set_result();
             }
 
-            bool is_valid() const { return m_begin1 != m_end1 || m_begin2 != m_end2; }
+            bool is_valid() const { return m_begin1 != m_end1; }
         };
 
         template <typename It1, typename It2, typename CSelector, typename RSelector>
@@ -390,11 +908,95 @@ namespace linq
     template <typename CSelector, typename RSelector>
     constexpr auto select_many_index(CSelector&& cselector, RSelector&& rselector)
     {
-        return [&](auto&& container) {
-            using It1 = decltype(std::begin(container));
-            using It2 = decltype(std::begin(cselector(*std::begin(container), std::size_t{})));
-            return impl::iterable{ impl::select_many_index_iterator<It1, It2, CSelector, RSelector>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<CSelector>(cselector), std::forward<RSelector>(rselector) } };
+        return impl::make_query(
+            [](auto&& container, auto&& cselector, auto&& rselector) {
+                using It1 = decltype(std::begin(container));
+                using It2 = decltype(std::begin(cselector(*std::begin(container), std::size_t{})));
+                return impl::iterable{ impl::select_many_index_iterator<It1, It2, decltype(cselector), decltype(rselector)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(cselector)>(cselector), std::forward<decltype(rselector)>(rselector) } };
+            },
+            std::forward<CSelector>(cselector), std::forward<RSelector>(rselector));
+    }
+
+    namespace impl
+    {
+        // Enumerates the inner ranges in place, segment by segment.
+        template <typename It1>
+        class concat_all_iterator_impl
+        {
+        private:
+            using It2 = decltype(std::begin(*std::declval<It1&>()));
+
+            It1 m_begin1, m_end1;
+            It2 m_begin2{}, m_end2{};
+
+            void seek_segment()
+            {
+                for (; m_begin1 != m_end1; ++m_begin1)
+                {
+                    m_begin2 = std::begin(*m_begin1);
+                    m_end2 = std::end(*m_begin1);
+                    if (m_begin2 != m_end2) break;
+                }
+            }
+
+        public:
+            using traits_type = common_impl_traits<typename std::iterator_traits<It2>::value_type, typename std::iterator_traits<It2>::reference>;
+
+            concat_all_iterator_impl(It1 begin, It1 end) : m_begin1(std::move(begin)), m_end1(std::move(end)) { seek_segment(); }
+
+            typename traits_type::reference value() const { return *m_begin2; }
+
+            void move_next()
+            {
+                if (++m_begin2 == m_end2)
+                {
+                    ++m_begin1;
+                    seek_segment();
+                }
+            }
+
+            bool is_valid() const { return m_begin1 != m_end1; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                for (; m_begin1 != m_end1; ++m_begin1, seek_segment())
+                {
+                    if (!push_range(m_begin2, m_end2, sink)) return false;
+                }
+                return true;
+            }
+
+            template <typename Sink>
+            bool push_segments(Sink&& sink)
+            {
+                for (; m_begin1 != m_end1; ++m_begin1, seek_segment())
+                {
+                    if (!impl::push_segments(m_begin2, m_end2, sink)) return false;
+                }
+                return true;
+            }
         };
+
+        template <typename It1>
+        using concat_all_iterator = iterator_base<concat_all_iterator_impl<It1>>;
+    } // namespace impl
+
+    // Concatenates the enumerables in the enumerable.
+    constexpr auto concat_all()
+    {
+        return impl::make_query([](auto&& container) {
+            using It1 = decltype(std::begin(container));
+            if constexpr (std::is_lvalue_reference_v<typename std::iterator_traits<It1>::reference>)
+            {
+                return impl::iterable{ impl::concat_all_iterator<It1>{ impl::iterator_ctor, std::begin(container), std::end(container) } };
+            }
+            else
+            {
+                // The inner enumerables are temporaries, so they are kept while enumerating.
+                return std::forward<decltype(container)>(container) >> select_many([](auto&& c) { return std::forward<decltype(c)>(c); }, [](auto&&, auto&& item) { return item; });
+            }
+        });
     }
 
     namespace impl
@@ -408,17 +1010,20 @@ namespace linq
         public:
             using traits_type = std::iterator_traits<It>;
 
-            skip_iterator_impl(It begin, It end, std::size_t skipn) : m_begin(begin), m_end(end)
-            {
-                for (; m_begin != m_end && skipn--; ++m_begin)
-                    ;
-            }
+            skip_iterator_impl(It begin, It end, std::size_t skipn)
+                : m_begin(advance_bounded(std::move(begin), end, skipn)), m_end(std::move(end)) {}
 
             typename traits_type::reference value() const noexcept { return *m_begin; }
 
             void move_next() { ++m_begin; }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, std::forward<Sink>(sink));
+            }
         };
 
         template <typename It>
@@ -428,10 +1033,23 @@ namespace linq
     // Bypasses a specified number of elements and then returns the remaining elements.
     constexpr auto skip(std::size_t skipn)
     {
-        return [=](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::skip_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), skipn } };
-        };
+        return impl::make_query(
+            [](auto&& container, std::size_t skipn) {
+                using It = decltype(std::begin(container));
+                auto size = impl::fixed_size(container);
+                if (size) *size -= (std::min)(*size, skipn);
+                if constexpr (impl::is_iterator_category_v<It, std::forward_iterator_tag>)
+                {
+                    // The rest of a forward enumerable keeps its category.
+                    auto end = std::end(container);
+                    return impl::iterable{ impl::advance_bounded(std::begin(container), end, skipn), std::move(end), size };
+                }
+                else
+                {
+                    return impl::iterable{ impl::skip_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), skipn }, size };
+                }
+            },
+            skipn);
     }
 
     namespace impl
@@ -446,7 +1064,7 @@ namespace linq
             using traits_type = std::iterator_traits<It>;
 
             template <typename Pred>
-            skip_while_iterator_impl(It begin, It end, Pred&& pred) : m_begin(begin), m_end(end)
+            skip_while_iterator_impl(It begin, It end, Pred&& pred) : m_begin(std::move(begin)), m_end(std::move(end))
             {
                 for (; m_begin != m_end && pred(*m_begin); ++m_begin)
                     ;
@@ -457,6 +1075,12 @@ namespace linq
             void move_next() { ++m_begin; }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, std::forward<Sink>(sink));
+            }
         };
 
         template <typename It>
@@ -467,10 +1091,23 @@ namespace linq
     template <typename Pred>
     constexpr auto skip_while(Pred&& pred)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::skip_while_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                if constexpr (impl::is_iterator_category_v<It, std::forward_iterator_tag>)
+                {
+                    auto begin = std::begin(container);
+                    auto end = std::end(container);
+                    for (; begin != end && pred(*begin); ++begin)
+                        ;
+                    return impl::iterable{ std::move(begin), std::move(end) };
+                }
+                else
+                {
+                    return impl::iterable{ impl::skip_while_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+                }
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -485,7 +1122,7 @@ namespace linq
             using traits_type = std::iterator_traits<It>;
 
             template <typename Pred>
-            skip_while_index_iterator_impl(It begin, It end, Pred&& pred) : m_begin(begin), m_end(end)
+            skip_while_index_iterator_impl(It begin, It end, Pred&& pred) : m_begin(std::move(begin)), m_end(std::move(end))
             {
                 for (std::size_t i = 0; m_begin != m_end && pred(*m_begin, i); ++m_begin, ++i)
                     ;
@@ -496,6 +1133,12 @@ namespace linq
             void move_next() { ++m_begin; }
 
             bool is_valid() const { return m_begin != m_end; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                return push_range(m_begin, m_end, std::forward<Sink>(sink));
+            }
         };
 
         template <typename It>
@@ -506,10 +1149,23 @@ namespace linq
     template <typename Pred>
     constexpr auto skip_while_index(Pred&& pred)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::skip_while_index_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                if constexpr (impl::is_iterator_category_v<It, std::forward_iterator_tag>)
+                {
+                    auto begin = std::begin(container);
+                    auto end = std::end(container);
+                    for (std::size_t i = 0; begin != end && pred(*begin, i); ++begin, ++i)
+                        ;
+                    return impl::iterable{ std::move(begin), std::move(end) };
+                }
+                else
+                {
+                    return impl::iterable{ impl::skip_while_index_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+                }
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -525,7 +1181,7 @@ namespace linq
         public:
             using traits_type = std::iterator_traits<It>;
 
-            take_iterator_impl(It begin, It end, std::size_t taken) : m_begin(begin), m_end(end), m_taken(taken) {}
+            take_iterator_impl(It begin, It end, std::size_t taken) : m_begin(std::move(begin)), m_end(std::move(end)), m_taken(taken) {}
 
             typename traits_type::reference value() { return *m_begin; }
 
@@ -536,19 +1192,80 @@ namespace linq
             }
 
             bool is_valid() const { return m_begin != m_end && m_taken; }
+
+            const It& source_begin() const noexcept { return m_begin; }
+            const It& source_end() const noexcept { return m_end; }
+            std::size_t taken() const noexcept { return m_taken; }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                // Stops right after the last element, without pulling one more.
+                bool result{ true };
+                if (m_taken)
+                {
+                    push_range(m_begin, m_end, [&](auto&& item) {
+                        result = sink(std::forward<decltype(item)>(item));
+                        return result && --m_taken > 0;
+                    });
+                }
+                return result;
+            }
         };
 
         template <typename It>
         using take_iterator = iterator_base<take_iterator_impl<It>>;
+
+        template <typename T>
+        inline constexpr bool is_take_iterable_v{ false };
+
+        template <typename It>
+        inline constexpr bool is_take_iterable_v<iterable<take_iterator<It>>>{ std::is_copy_constructible_v<It> };
+
+        template <typename It>
+        auto fuse_take(const iterable<take_iterator<It>>& e, std::size_t taken)
+        {
+            return fuse_stage<take_iterator<It>>(
+                e, [&](const It& begin, const It& end, const auto& impl) {
+                    return take_iterator<It>{ iterator_ctor, begin, end, (std::min)(impl.taken(), taken) };
+                },
+                min_known_size(e.known_size(), std::optional<std::size_t>{ taken }));
+        }
+
+        // The query of take is named, so that the queries before it could fuse with it.
+        struct take_query
+        {
+            template <typename Container>
+            auto operator()(Container&& container, std::size_t taken) const
+            {
+                using It = decltype(std::begin(container));
+                if constexpr (is_iterator_category_v<It, std::random_access_iterator_tag>)
+                {
+                    // The end of a random access enumerable could be calculated directly.
+                    auto begin = std::begin(container);
+                    auto end = advance_bounded(begin, std::end(container), taken);
+                    return iterable{ std::move(begin), std::move(end) };
+                }
+                else if constexpr (is_take_iterable_v<std::decay_t<Container>>)
+                {
+                    return fuse_take(container, taken);
+                }
+                else
+                {
+                    return iterable{ take_iterator<It>{ iterator_ctor, std::begin(container), std::end(container), taken },
+                                     min_known_size(fixed_size(container), std::optional<std::size_t>{ taken }) };
+                }
+            }
+        };
+
+        template <typename Query>
+        inline constexpr bool is_take_query_v{ std::is_same_v<std::decay_t<Query>, query<take_query, std::size_t>> };
     } // namespace impl
 
     // Returns a specified number of contiguous elements from the start.
     constexpr auto take(std::size_t taken)
     {
-        return [=](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::take_iterator<It>{ impl::iterator_ctor, std::begin(container), std::end(container), taken } };
-        };
+        return impl::make_query(impl::take_query{}, taken);
     }
 
     namespace impl
@@ -563,13 +1280,21 @@ namespace linq
         public:
             using traits_type = std::iterator_traits<It>;
 
-            take_while_iterator_impl(It begin, It end, Pred&& pred) : m_begin(begin), m_end(end), m_pred(std::forward<Pred>(pred)) {}
+            take_while_iterator_impl(It begin, It end, Pred&& pred) : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)) {}
 
             typename traits_type::reference value() { return *m_begin; }
 
             void move_next() { ++m_begin; }
 
             bool is_valid() const { return m_begin != m_end && m_pred(*m_begin); }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                bool result{ true };
+                push_range(m_begin, m_end, [&](auto&& item) { return m_pred(item) && (result = sink(std::forward<decltype(item)>(item))); });
+                return result;
+            }
         };
 
         template <typename It, typename Pred>
@@ -580,10 +1305,12 @@ namespace linq
     template <typename Pred>
     constexpr auto take_while(Pred&& pred)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::take_while_iterator<It, Pred>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::take_while_iterator<It, decltype(pred)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -599,7 +1326,7 @@ namespace linq
         public:
             using traits_type = std::iterator_traits<It>;
 
-            take_while_index_iterator_impl(It begin, It end, Pred&& pred) : m_begin(begin), m_end(end), m_pred(std::forward<Pred>(pred)) {}
+            take_while_index_iterator_impl(It begin, It end, Pred&& pred) : m_begin(std::move(begin)), m_end(std::move(end)), m_pred(std::forward<Pred>(pred)) {}
 
             typename traits_type::reference value() { return *m_begin; }
 
@@ -610,6 +1337,14 @@ namespace linq
             }
 
             bool is_valid() const { return m_begin != m_end && m_pred(*m_begin, m_index); }
+
+            template <typename Sink>
+            bool push(Sink&& sink)
+            {
+                bool result{ true };
+                push_range(m_begin, m_end, [&](auto&& item) { return m_pred(item, m_index++) && (result = sink(std::forward<decltype(item)>(item))); });
+                return result;
+            }
         };
 
         template <typename It, typename Pred>
@@ -620,10 +1355,12 @@ namespace linq
     template <typename Pred>
     constexpr auto take_while_index(Pred&& pred)
     {
-        return [&](auto&& container) {
-            using It = decltype(std::begin(container));
-            return impl::iterable{ impl::take_while_index_iterator<It, Pred>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<Pred>(pred) } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& pred) {
+                using It = decltype(std::begin(container));
+                return impl::iterable{ impl::take_while_index_iterator<It, decltype(pred)>{ impl::iterator_ctor, std::begin(container), std::end(container), std::forward<decltype(pred)>(pred) } };
+            },
+            std::forward<Pred>(pred));
     }
 
     namespace impl
@@ -659,32 +1396,50 @@ namespace linq
             std::decay_t<Selector> m_selector;
             std::tuple<iterator_pack<Its>...> m_its;
 
-            using result_type = std::common_type_t<typename std::iterator_traits<Its>::value_type...>;
-            std::optional<result_type> m_result{};
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<Its>::reference>()...));
 
-            void set_result()
-            {
-                if (is_valid())
-                    m_result.emplace(std::apply([this](auto&&... pack) { return m_selector((*pack.m_begin)...); }, m_its));
-            }
+            static constexpr bool is_random_access{ and_all(is_iterator_category_v<Its, std::random_access_iterator_tag>...) };
 
         public:
-            using traits_type = iterator_impl_traits<result_type>;
+            using traits_type = result_impl_traits<result_type>;
+            // The end of the shortest enumerable could only be calculated directly with random access iterators.
+            using iterator_category = std::conditional_t<is_random_access, std::random_access_iterator_tag, std::input_iterator_tag>;
 
-            zip_iterator_impl(Selector&& selector, iterator_pack<Its>... its) : m_selector(std::forward<Selector>(selector)), m_its(std::make_tuple(its...)) { set_result(); }
+            zip_iterator_impl(Selector&& selector, iterator_pack<Its>... its) : m_selector(std::forward<Selector>(selector)), m_its(std::move(its)...) {}
 
-            typename traits_type::reference value() const { return *m_result; }
+            typename traits_type::reference value()
+            {
+                return std::apply([this](auto&&... pack) -> typename traits_type::reference { return m_selector((*pack.m_begin)...); }, m_its);
+            }
 
             void move_next()
             {
                 std::apply([](auto&&... pack) { return expand_tuple((++pack.m_begin)...); }, m_its);
-                set_result();
             }
 
             bool is_valid() const
             {
                 return std::apply([](auto&&... pack) { return and_all((pack.m_begin != pack.m_end)...); }, m_its);
             }
+
+            bool equals(const zip_iterator_impl& it) const { return std::get<0>(m_its).m_begin == std::get<0>(it.m_its).m_begin; }
+
+            void seek_end()
+            {
+                advance(std::apply([](auto&&... pack) { return (std::min)({ static_cast<std::ptrdiff_t>(pack.m_end - pack.m_begin)... }); }, m_its));
+            }
+
+            void move_prev()
+            {
+                std::apply([](auto&&... pack) { return expand_tuple((--pack.m_begin)...); }, m_its);
+            }
+
+            void advance(std::ptrdiff_t n)
+            {
+                std::apply([n](auto&&... pack) { return expand_tuple((pack.m_begin += n)...); }, m_its);
+            }
+
+            std::ptrdiff_t distance_to(const zip_iterator_impl& it) const { return std::get<0>(it.m_its).m_begin - std::get<0>(m_its).m_begin; }
         };
 
         template <typename Selector, typename... Its>
@@ -695,17 +1450,23 @@ namespace linq
     template <typename Selector, typename... Containers>
     constexpr auto zip(Selector&& selector, Containers&&... cs)
     {
-        return [&](auto&& container) {
-            if constexpr (sizeof...(Containers) == 0)
-            {
-                return container;
-            }
-            else
-            {
-                using It = decltype(std::begin(container));
-                return impl::iterable{ impl::zip_iterator<Selector, It, decltype(std::begin(cs))...>{ impl::iterator_ctor, std::forward<Selector>(selector), impl::iterator_pack<It>{ std::begin(container), std::end(container) }, impl::iterator_pack<decltype(std::begin(cs))>{ std::begin(cs), std::end(cs) }... } };
-            }
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& selector, auto&&... cs) {
+                if constexpr (sizeof...(cs) == 0)
+                {
+                    return container;
+                }
+                else
+                {
+                    using It = decltype(std::begin(container));
+                    return impl::iterable{ impl::zip_iterator<decltype(selector), It, decltype(std::begin(impl::unwrap_container(cs)))...>{
+                                               impl::iterator_ctor, std::forward<decltype(selector)>(selector),
+                                               impl::iterator_pack<It>{ std::begin(container), std::end(container) },
+                                               impl::iterator_pack<decltype(std::begin(impl::unwrap_container(cs)))>{ std::begin(impl::unwrap_container(cs)), std::end(impl::unwrap_container(cs)) }... },
+                                           impl::min_known_size(impl::fixed_size(container), impl::fixed_size(impl::unwrap_container(cs))...) };
+                }
+            },
+            std::forward<Selector>(selector), impl::capture_container(std::forward<Containers>(cs))...);
     }
 
     namespace impl
@@ -718,33 +1479,53 @@ namespace linq
             std::tuple<iterator_pack<Its>...> m_its;
             std::size_t m_index{ 0 };
 
-            using result_type = std::common_type_t<typename std::iterator_traits<Its>::value_type...>;
-            std::optional<result_type> m_result{};
+            using result_type = decltype(std::declval<std::decay_t<Selector>&>()(std::declval<typename std::iterator_traits<Its>::reference>()..., m_index));
 
-            void set_result()
-            {
-                if (is_valid())
-                    m_result.emplace(std::apply([this](auto&&... pack) { return m_selector((*pack.m_begin)..., m_index); }, m_its));
-            }
+            static constexpr bool is_random_access{ and_all(is_iterator_category_v<Its, std::random_access_iterator_tag>...) };
 
         public:
-            using traits_type = iterator_impl_traits<result_type>;
+            using traits_type = result_impl_traits<result_type>;
+            // The end of the shortest enumerable could only be calculated directly with random access iterators.
+            using iterator_category = std::conditional_t<is_random_access, std::random_access_iterator_tag, std::input_iterator_tag>;
 
-            zip_index_iterator_impl(Selector&& selector, iterator_pack<Its>... its) : m_selector(std::move(selector)), m_its(std::make_tuple(its...)) { set_result(); }
+            zip_index_iterator_impl(Selector&& selector, iterator_pack<Its>... its) : m_selector(std::forward<Selector>(selector)), m_its(std::move(its)...) {}
 
-            typename traits_type::reference value() const { return *m_result; }
+            typename traits_type::reference value()
+            {
+                return std::apply([this](auto&&... pack) -> typename traits_type::reference { return m_selector((*pack.m_begin)..., m_index); }, m_its);
+            }
 
             void move_next()
             {
                 std::apply([](auto&&... pack) { return expand_tuple((++pack.m_begin)...); }, m_its);
                 ++m_index;
-                set_result();
             }
 
             bool is_valid() const
             {
                 return std::apply([](auto&&... pack) { return and_all((pack.m_begin != pack.m_end)...); }, m_its);
             }
+
+            bool equals(const zip_index_iterator_impl& it) const { return std::get<0>(m_its).m_begin == std::get<0>(it.m_its).m_begin; }
+
+            void seek_end()
+            {
+                advance(std::apply([](auto&&... pack) { return (std::min)({ static_cast<std::ptrdiff_t>(pack.m_end - pack.m_begin)... }); }, m_its));
+            }
+
+            void move_prev()
+            {
+                std::apply([](auto&&... pack) { return expand_tuple((--pack.m_begin)...); }, m_its);
+                --m_index;
+            }
+
+            void advance(std::ptrdiff_t n)
+            {
+                std::apply([n](auto&&... pack) { return expand_tuple((pack.m_begin += n)...); }, m_its);
+                m_index += n;
+            }
+
+            std::ptrdiff_t distance_to(const zip_index_iterator_impl& it) const { return std::get<0>(it.m_its).m_begin - std::get<0>(m_its).m_begin; }
         };
 
         template <typename Selector, typename... Its>
@@ -755,17 +1536,23 @@ namespace linq
     template <typename Selector, typename... Containers>
     constexpr auto zip_index(Selector&& selector, Containers&&... cs)
     {
-        return [&](auto&& container) {
-            if constexpr (sizeof...(Containers) == 0)
-            {
-                return container;
-            }
-            else
-            {
-                using It = decltype(std::begin(container));
-                return impl::iterable{ impl::zip_index_iterator<Selector, It, decltype(std::begin(cs))...>{ impl::iterator_ctor, std::forward<Selector>(selector), impl::iterator_pack<It>{ std::begin(container), std::end(container) }, impl::iterator_pack<decltype(std::begin(cs))>{ std::begin(cs), std::end(cs) }... } };
-            }
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& selector, auto&&... cs) {
+                if constexpr (sizeof...(cs) == 0)
+                {
+                    return container;
+                }
+                else
+                {
+                    using It = decltype(std::begin(container));
+                    return impl::iterable{ impl::zip_index_iterator<decltype(selector), It, decltype(std::begin(impl::unwrap_container(cs)))...>{
+                                               impl::iterator_ctor, std::forward<decltype(selector)>(selector),
+                                               impl::iterator_pack<It>{ std::begin(container), std::end(container) },
+                                               impl::iterator_pack<decltype(std::begin(impl::unwrap_container(cs)))>{ std::begin(impl::unwrap_container(cs)), std::end(impl::unwrap_container(cs)) }... },
+                                           impl::min_known_size(impl::fixed_size(container), impl::fixed_size(impl::unwrap_container(cs))...) };
+                }
+            },
+            std::forward<Selector>(selector), impl::capture_container(std::forward<Containers>(cs))...);
     }
 } // namespace linq
 
@@ -101,10 +101,12 @@ namespace linq
     template <typename Char, typename Traits = std::char_traits<Char>>
     constexpr auto split(Char split_char = (Char)' ')
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            return impl::iterable{ impl::split_iterator<Char, Traits>{ impl::iterator_ctor, view, split_char } };
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& split_char) {
+                std::basic_string_view<Char, Traits> view{ container };
+                return impl::iterable{ impl::split_iterator<Char, Traits>{ impl::iterator_ctor, view, split_char } };
+            },
+            split_char);
     }
 
     // Contacts the string elements into a new string.
@@ -112,34 +114,37 @@ namespace linq
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>>
     constexpr auto joinstr()
     {
-        return [](auto&& container) {
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            for (auto& item : container)
-            {
-                oss << item;
-            }
-            return oss.str();
-        };
+        return impl::make_query(
+            [](auto&& container) {
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                impl::push_each(container, [&](auto&& item) {
+                    oss << item;
+                    return true;
+                });
+                return oss.str();
+            });
     }
 
     // Inserts something between every two string elements when contacting.
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>, typename T>
     constexpr auto joinstr(T&& value)
     {
-        return [&](auto&& container) {
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            auto begin = std::begin(container);
-            auto end = std::end(container);
-            if (begin != end)
-            {
-                oss << *begin;
-                for (++begin; begin != end; ++begin)
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                auto begin = std::begin(container);
+                auto end = std::end(container);
+                if (begin != end)
                 {
-                    oss << value << *begin;
+                    oss << *begin;
+                    for (++begin; begin != end; ++begin)
+                    {
+                        oss << value << *begin;
+                    }
                 }
-            }
-            return oss.str();
-        };
+                return oss.str();
+            },
+            std::forward<T>(value));
     }
 
     // Determines whether a char or a string span is in the string.
@@ -147,195 +152,219 @@ namespace linq
     template <typename Char, typename Traits = std::char_traits<Char>, typename T>
     constexpr auto instr(T&& t)
     {
-        return [&](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            return view.find(std::forward<T>(t)) != std::basic_string_view<Char, Traits>::npos;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& t) {
+                std::basic_string_view<Char, Traits> view{ container };
+                return view.find(std::forward<decltype(t)>(t)) != std::basic_string_view<Char, Traits>::npos;
+            },
+            std::forward<T>(t));
     }
 
     // Determines whether a char is in the start of the string.
     template <typename Char, typename Traits = std::char_traits<Char>, typename = std::enable_if_t<is_char_v<Char>>>
     constexpr auto starts_with(Char value)
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            return view.front() == value;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                return view.front() == value;
+            },
+            value);
     }
 
     // Determines whether a string span is in the start of the string.
     template <typename Char, typename Traits = std::char_traits<Char>, typename T>
     constexpr auto starts_with(T&& t)
     {
-        return [&](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_string_view<Char, Traits> value{ std::forward<T>(t) };
-            if (view.length() < value.length())
-                return false;
-            return view.compare(0, value.length(), value) == 0;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& t) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_string_view<Char, Traits> value{ std::forward<decltype(t)>(t) };
+                if (view.length() < value.length())
+                    return false;
+                return view.compare(0, value.length(), value) == 0;
+            },
+            std::forward<T>(t));
     }
 
     // Determines whether a char is in the end of the string.
     template <typename Char, typename Traits = std::char_traits<Char>, typename = std::enable_if_t<is_char_v<Char>>>
     constexpr auto ends_with(Char value)
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            return view.back() == value;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                return view.back() == value;
+            },
+            value);
     }
 
     // Determines whether a string span is in the end of the string.
     template <typename Char, typename Traits = std::char_traits<Char>, typename T>
     constexpr auto ends_with(T&& t)
     {
-        return [&](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_string_view<Char, Traits> value{ std::forward<T>(t) };
-            if (view.length() < value.length())
-                return false;
-            return view.compare(view.length() - value.length(), value.length(), value) == 0;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& t) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_string_view<Char, Traits> value{ std::forward<decltype(t)>(t) };
+                if (view.length() < value.length())
+                    return false;
+                return view.compare(view.length() - value.length(), value.length(), value) == 0;
+            },
+            std::forward<T>(t));
     }
 
     // Returns a new string with no specified char.
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>>
     constexpr auto remove(Char value)
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            std::size_t offset{ 0 };
-            for (std::size_t i{ 0 }; i < view.length(); i++)
-            {
-                if (Traits::eq(view[i], value))
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                std::size_t offset{ 0 };
+                for (std::size_t i{ 0 }; i < view.length(); i++)
                 {
-                    oss << view.substr(offset, i - offset);
-                    offset = i + 1;
+                    if (Traits::eq(view[i], value))
+                    {
+                        oss << view.substr(offset, i - offset);
+                        offset = i + 1;
+                    }
                 }
-            }
-            if (offset < view.length())
-            {
-                oss << view.substr(offset);
-            }
-            return oss.str();
-        };
+                if (offset < view.length())
+                {
+                    oss << view.substr(offset);
+                }
+                return oss.str();
+            },
+            value);
     }
 
     // Returns a new string with no specified string span.
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>, typename T>
     constexpr auto remove(T&& t)
     {
-        return [&](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_string_view<Char, Traits> value{ std::forward<T>(t) };
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            std::size_t offset{ 0 };
-            for (std::size_t i{ 0 }; i <= view.length() - value.length(); i++)
-            {
-                if (view.compare(i, value.length(), value) == 0)
+        return impl::make_query(
+            [](auto&& container, auto&& t) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_string_view<Char, Traits> value{ std::forward<decltype(t)>(t) };
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                std::size_t offset{ 0 };
+                for (std::size_t i{ 0 }; i <= view.length() - value.length(); i++)
                 {
-                    oss << view.substr(offset, i - offset);
-                    offset = i + value.length();
-                    i = offset - 1;
+                    if (view.compare(i, value.length(), value) == 0)
+                    {
+                        oss << view.substr(offset, i - offset);
+                        offset = i + value.length();
+                        i = offset - 1;
+                    }
                 }
-            }
-            if (offset < view.length())
-            {
-                oss << view.substr(offset);
-            }
-            return oss.str();
-        };
+                if (offset < view.length())
+                {
+                    oss << view.substr(offset);
+                }
+                return oss.str();
+            },
+            std::forward<T>(t));
     }
 
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>, typename TNew>
     constexpr auto replace(Char oldc, TNew&& news)
     {
-        return [oldc, &news](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            std::size_t offset{ 0 };
-            for (std::size_t i{ 0 }; i < view.length(); i++)
-            {
-                if (Traits::eq(view[i], oldc))
+        return impl::make_query(
+            [](auto&& container, auto&& oldc, auto&& news) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                std::size_t offset{ 0 };
+                for (std::size_t i{ 0 }; i < view.length(); i++)
                 {
-                    oss << view.substr(offset, i - offset) << news;
-                    offset = i + 1;
+                    if (Traits::eq(view[i], oldc))
+                    {
+                        oss << view.substr(offset, i - offset) << news;
+                        offset = i + 1;
+                    }
                 }
-            }
-            if (offset < view.length())
-            {
-                oss << view.substr(offset);
-            }
-            return oss.str();
-        };
+                if (offset < view.length())
+                {
+                    oss << view.substr(offset);
+                }
+                return oss.str();
+            },
+            oldc, std::forward<TNew>(news));
     }
 
     // Returns a new string which the specified string span is replaced by the new one.
     template <typename Char, typename Traits = std::char_traits<Char>, typename Allocator = std::allocator<Char>, typename TOld, typename TNew>
     constexpr auto replace(TOld&& olds, TNew&& news)
     {
-        return [&](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            std::basic_string_view<Char, Traits> value{ std::forward<TOld>(olds) };
-            std::basic_ostringstream<Char, Traits, Allocator> oss;
-            std::size_t offset{ 0 };
-            for (std::size_t i{ 0 }; i <= view.length() - value.length(); i++)
-            {
-                if (view.compare(i, value.length(), value) == 0)
+        return impl::make_query(
+            [](auto&& container, auto&& olds, auto&& news) {
+                std::basic_string_view<Char, Traits> view{ container };
+                std::basic_string_view<Char, Traits> value{ std::forward<decltype(olds)>(olds) };
+                std::basic_ostringstream<Char, Traits, Allocator> oss;
+                std::size_t offset{ 0 };
+                for (std::size_t i{ 0 }; i <= view.length() - value.length(); i++)
                 {
-                    oss << view.substr(offset, i - offset) << news;
-                    offset = i + value.length();
-                    i = offset - 1;
+                    if (view.compare(i, value.length(), value) == 0)
+                    {
+                        oss << view.substr(offset, i - offset) << news;
+                        offset = i + value.length();
+                        i = offset - 1;
+                    }
                 }
-            }
-            if (offset < view.length())
-            {
-                oss << view.substr(offset);
-            }
-            return oss.str();
-        };
+                if (offset < view.length())
+                {
+                    oss << view.substr(offset);
+                }
+                return oss.str();
+            },
+            std::forward<TOld>(olds), std::forward<TNew>(news));
     }
 
     template <typename Char, typename Traits = std::char_traits<Char>>
     constexpr auto trim(Char value = (Char)' ')
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            auto begin{ view.find_first_not_of(value) };
-            auto end{ view.find_last_not_of(value) };
-            if (begin == std::basic_string_view<Char, Traits>::npos)
-                return std::basic_string_view<Char, Traits>{};
-            else
-                return view.substr(begin, end - begin + 1);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                auto begin{ view.find_first_not_of(value) };
+                auto end{ view.find_last_not_of(value) };
+                if (begin == std::basic_string_view<Char, Traits>::npos)
+                    return std::basic_string_view<Char, Traits>{};
+                else
+                    return view.substr(begin, end - begin + 1);
+            },
+            value);
     }
 
     template <typename Char, typename Traits = std::char_traits<Char>>
     constexpr auto trim_left(Char value = (Char)' ')
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            auto begin{ view.find_first_not_of(value) };
-            if (begin == std::basic_string_view<Char, Traits>::npos)
-                return std::basic_string_view<Char, Traits>{};
-            else
-                return view.substr(begin);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                auto begin{ view.find_first_not_of(value) };
+                if (begin == std::basic_string_view<Char, Traits>::npos)
+                    return std::basic_string_view<Char, Traits>{};
+                else
+                    return view.substr(begin);
+            },
+            value);
     }
 
     template <typename Char, typename Traits = std::char_traits<Char>>
     constexpr auto trim_right(Char value = (Char)' ')
     {
-        return [=](auto&& container) {
-            std::basic_string_view<Char, Traits> view{ container };
-            auto end{ view.find_last_not_of(value) };
-            if (end == std::basic_string_view<Char, Traits>::npos)
-                return std::basic_string_view<Char, Traits>{};
-            else
-                return view.substr(0, end + 1);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& value) {
+                std::basic_string_view<Char, Traits> view{ container };
+                auto end{ view.find_last_not_of(value) };
+                if (end == std::basic_string_view<Char, Traits>::npos)
+                    return std::basic_string_view<Char, Traits>{};
+                else
+                    return view.substr(0, end + 1);
+            },
+            value);
     }
 
     namespace impl
@@ -384,7 +413,7 @@ namespace linq
     template <typename Char, typename Traits = std::char_traits<Char>, typename C>
     constexpr decltype(auto) write_lines(std::basic_ostream<Char, Traits>& stream, C&& c)
     {
-        for (auto& item : c)
+        for (auto&& item : c)
         {
             stream << item << stream.widen('\n');
         }
@@ -28,6 +28,7 @@
 
 #include <deque>
 #include <linq/core.hpp>
+#include <linq/parallel.hpp>
 #include <list>
 #include <map>
 #include <set>
@@ -40,109 +41,136 @@ namespace linq
     template <typename T, typename Allocator = std::allocator<T>>
     constexpr auto to_list(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::list<T, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::list<T, Allocator>(std::begin(container), std::end(container), alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Comparer = std::less<T>, typename Allocator = std::allocator<T>>
     constexpr auto to_set(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::set<T, Comparer, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::set<T, Comparer, Allocator>(std::begin(container), std::end(container), alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Comparer = std::less<T>, typename Allocator = std::allocator<T>>
     constexpr auto to_multiset(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::multiset<T, Comparer, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::multiset<T, Comparer, Allocator>(std::begin(container), std::end(container), alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Hash = std::hash<T>, typename KeyEq = std::equal_to<T>, typename Allocator = std::allocator<T>>
     constexpr auto to_unordered_set(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::unordered_set<T, Hash, KeyEq, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::unordered_set<T, Hash, KeyEq, Allocator>(std::begin(container), std::end(container), impl::known_size(container).value_or(0), Hash{}, KeyEq{}, alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Hash = std::hash<T>, typename KeyEq = std::equal_to<T>, typename Allocator = std::allocator<T>>
     constexpr auto to_unordered_multiset(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::unordered_multiset<T, Hash, KeyEq, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::unordered_multiset<T, Hash, KeyEq, Allocator>(std::begin(container), std::end(container), impl::known_size(container).value_or(0), Hash{}, KeyEq{}, alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Allocator = std::allocator<T>>
     constexpr auto to_vector(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::vector<T, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                if constexpr (impl::is_parallel_v<std::decay_t<decltype(container)>>)
+                    return impl::parallel_make_vector<T, Allocator>(container, alloc);
+                else
+                    return impl::make_vector<T, Allocator>(container, alloc);
+            },
+            alloc);
     }
 
     template <typename T, typename Allocator = std::allocator<T>>
     constexpr auto to_deque(const Allocator& alloc = {})
     {
-        return [alloc](auto&& container) {
-            return std::deque<T, Allocator>(std::begin(container), std::end(container), alloc);
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& alloc) {
+                return std::deque<T, Allocator>(std::begin(container), std::end(container), alloc);
+            },
+            alloc);
     }
 
     template <typename TKey, typename TElem, typename KeySelector, typename ElementSelector, typename Comparer = std::less<TKey>, typename Allocator = std::allocator<std::pair<const TKey, TElem>>>
     constexpr auto to_map(KeySelector&& keysel, ElementSelector&& elesel, const Allocator& alloc = {})
     {
-        return [&, alloc](auto&& container) {
-            std::map<TKey, TElem, Comparer, Allocator> result{ alloc };
-            for (auto& item : container)
-            {
-                result.emplace(keysel(item), elesel(item));
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& alloc) {
+                std::map<TKey, TElem, Comparer, Allocator> result{ alloc };
+                impl::push_each(container, [&](auto&& item) {
+                    result.emplace(keysel(item), elesel(item));
+                    return true;
+                });
+                return result;
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), alloc);
     }
 
     template <typename TKey, typename TElem, typename KeySelector, typename ElementSelector, typename Hash = std::hash<TKey>, typename KeyEq = std::equal_to<TKey>, typename Allocator = std::allocator<std::pair<const TKey, TElem>>>
     constexpr auto to_unordered_map(KeySelector&& keysel, ElementSelector&& elesel, const Allocator& alloc = {})
     {
-        return [&, alloc](auto&& container) {
-            std::unordered_map<TKey, TElem, Hash, KeyEq, Allocator> result{ alloc };
-            for (auto& item : container)
-            {
-                result.emplace(keysel(item), elesel(item));
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& alloc) {
+                std::unordered_map<TKey, TElem, Hash, KeyEq, Allocator> result{ alloc };
+                if (auto size = impl::known_size(container)) result.reserve(*size);
+                impl::push_each(container, [&](auto&& item) {
+                    result.emplace(keysel(item), elesel(item));
+                    return true;
+                });
+                return result;
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), alloc);
     }
 
     template <typename TKey, typename TElem, typename KeySelector, typename ElementSelector, typename Comparer = std::less<TKey>, typename Allocator = std::allocator<std::pair<const TKey, TElem>>>
     constexpr auto to_multimap(KeySelector&& keysel, ElementSelector&& elesel, const Allocator& alloc = {})
     {
-        return [&, alloc](auto&& container) {
-            std::multimap<TKey, TElem, Comparer, Allocator> result{ alloc };
-            for (auto& item : container)
-            {
-                result.emplace(keysel(item), elesel(item));
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& alloc) {
+                std::multimap<TKey, TElem, Comparer, Allocator> result{ alloc };
+                impl::push_each(container, [&](auto&& item) {
+                    result.emplace(keysel(item), elesel(item));
+                    return true;
+                });
+                return result;
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), alloc);
     }
 
     template <typename TKey, typename TElem, typename KeySelector, typename ElementSelector, typename Hash = std::hash<TKey>, typename KeyEq = std::equal_to<TKey>, typename Allocator = std::allocator<std::pair<const TKey, TElem>>>
     constexpr auto to_unordered_multimap(KeySelector&& keysel, ElementSelector&& elesel, const Allocator& alloc = {})
     {
-        return [&, alloc](auto&& container) {
-            std::unordered_multimap<TKey, TElem, Hash, KeyEq, Allocator> result{ alloc };
-            for (auto& item : container)
-            {
-                result.emplace(keysel(item), elesel(item));
-            }
-            return result;
-        };
+        return impl::make_query(
+            [](auto&& container, auto&& keysel, auto&& elesel, auto&& alloc) {
+                std::unordered_multimap<TKey, TElem, Hash, KeyEq, Allocator> result{ alloc };
+                if (auto size = impl::known_size(container)) result.reserve(*size);
+                impl::push_each(container, [&](auto&& item) {
+                    result.emplace(keysel(item), elesel(item));
+                    return true;
+                });
+                return result;
+            },
+            std::forward<KeySelector>(keysel), std::forward<ElementSelector>(elesel), alloc);
     }
 } // namespace linq
 
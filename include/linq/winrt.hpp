@@ -54,7 +54,7 @@ namespace linq
         public:
             using traits_type = iterator_impl_traits<result_type>;
 
-            winrt_iterator_impl(It begin, It end) : m_begin(begin), m_end(end) { set_result(); }
+            winrt_iterator_impl(It begin, It end) : m_begin(std::move(begin)), m_end(std::move(end)) { set_result(); }
 
             typename traits_type::reference value() { return *m_result; }
 
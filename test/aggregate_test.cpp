@@ -1,10 +1,14 @@
 #define BOOST_TEST_MODULE AggregateTest
 
 #include "test_utility.hpp"
+#include <algorithm>
 #include <array>
 #include <linq/aggregate.hpp>
 #include <linq/query.hpp>
 #include <linq/to_container.hpp>
+#include <list>
+#include <memory>
+#include <thread>
 
 using namespace std;
 using namespace linq;
@@ -36,6 +40,13 @@ BOOST_AUTO_TEST_CASE(aggregate_aggregate_method_test)
     BOOST_CHECK_EQUAL(15, i2);
     auto i3{ a1 >> aggregate(0, [](int i1, int i2) { return i1 + i2 * i2; }) };
     BOOST_CHECK_EQUAL(55, i3);
+    auto i4{ a1 >> reduce(1, [](int& r, int a) { r *= a; }, std::multiplies<int>{}) };
+    BOOST_CHECK_EQUAL(120, i4);
+    // The fold stops once the result is decided.
+    int folded{ 0 };
+    auto i5{ a1 >> reduce(0, [&](int& r, int a) { ++folded; r = max(r, a); return a < 3; }, [](int a, int b) { return max(a, b); }) };
+    BOOST_CHECK_EQUAL(3, i5);
+    BOOST_CHECK_EQUAL(3, folded);
 }
 
 BOOST_AUTO_TEST_CASE(aggregate_reverse_test)
@@ -46,6 +57,9 @@ BOOST_AUTO_TEST_CASE(aggregate_reverse_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e1);
     auto e2{ a1 >> reverse() >> reverse() };
     LINQ_CHECK_EQUAL_COLLECTIONS(a1, e2);
+    // A temporary container is copied, because it dies with the query.
+    auto e3{ vector<int>{ 1, 2, 3, 4, 5, 6 } >> reverse() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e3);
 }
 
 BOOST_AUTO_TEST_CASE(aggregate_sort_test)
@@ -83,6 +97,160 @@ BOOST_AUTO_TEST_CASE(aggregate_sort_custom_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
 
+BOOST_AUTO_TEST_CASE(aggregate_stable_sort_test)
+{
+    aggregate_test_pack a1[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Jobs", 78 }, { "Gates", 85 } };
+    aggregate_test_pack a2[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Gates", 85 }, { "Jobs", 78 } };
+    auto e{ a1 >> stable_sort(make_comparer([](const aggregate_test_pack& p) { return p.score; }, descending{})) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_radix_sort_test)
+{
+    auto e1{ range(0, 5000) >> select([](int a) { return (a * 7919) % 10007 - 5000; }) };
+    auto v1{ e1 >> to_vector<int>() };
+    std::sort(v1.begin(), v1.end());
+    auto r1{ e1 >> sort() };
+    BOOST_CHECK(v1 == r1);
+    vector<double> zeros{ -0.0, 0.0, -0.0 };
+    auto e2{ e1 >> select([](int a) { return a / 7.0; }) >> concat(zeros) };
+    auto v2{ e2 >> to_vector<double>() };
+    std::stable_sort(v2.begin(), v2.end(), greater<double>{});
+    auto r2{ e2 >> sort(make_comparer(linq::identity{}, descending{})) };
+    BOOST_CHECK(v2 == r2);
+    // The packed keys sort the groups ascending, and the scores descending.
+    auto e3{ e1 >> select([](int a) { return aggregate_test_pack{ to_string(a), a }; }) };
+    auto group{ [](const aggregate_test_pack& p) { return static_cast<short>(p.score % 10); } };
+    auto score{ [](const aggregate_test_pack& p) { return static_cast<float>(p.score); } };
+    auto v3{ e3 >> to_vector<aggregate_test_pack>() };
+    std::stable_sort(v3.begin(), v3.end(), [&](const aggregate_test_pack& a, const aggregate_test_pack& b) { return group(a) != group(b) ? group(a) < group(b) : score(a) > score(b); });
+    auto r3{ e3 >> sort(make_comparer(group), make_comparer(score, descending{})) };
+    BOOST_CHECK(v3 == r3);
+    // The strings are sorted by bytes, and the equivalent ones keep their order.
+    auto name{ [](const aggregate_test_pack& p) -> const string& { return p.name; } };
+    auto e4{ e3 >> select([](aggregate_test_pack p) { p.name = "key" + p.name.substr(0, 2); return p; }) };
+    auto v4{ e4 >> to_vector<aggregate_test_pack>() };
+    std::stable_sort(v4.begin(), v4.end(), [](const aggregate_test_pack& a, const aggregate_test_pack& b) { return a.name > b.name; });
+    auto r4{ e4 >> sort(make_comparer(name, string_descending<char>{})) };
+    BOOST_CHECK(v4 == r4);
+    auto v5{ e1 >> select([](int a) { return to_string(a); }) >> to_vector<string>() };
+    auto r5{ v5 >> sort() };
+    std::sort(v5.begin(), v5.end());
+    BOOST_CHECK(v5 == r5);
+    // The nested prefixes do not recurse once for each string.
+    auto v6{ range(0, 5000) >> select([](int a) { return string((a * 7919) % 5000 + 1, 'a'); }) >> to_vector<string>() };
+    auto r6{ v6 >> sort(make_comparer([](const string& s) { return s; }, descending{})) };
+    std::sort(v6.begin(), v6.end(), greater<string>{});
+    BOOST_CHECK(v6 == r6);
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_stateful_sort_test)
+{
+    // A mutable selector falls back to the comparison sort.
+    auto v1{ range(0, 1000) >> select([](int a) { return (a * 7919) % 1009; }) >> to_vector<int>() };
+    size_t n{ 0 };
+    auto r1{ v1 >> sort(make_comparer([n](int a) mutable { ++n; return a; })) };
+    auto r2{ v1 >> sort(make_comparer([n](int a) mutable { ++n; return to_string(a); }, string_descending<char>{})) };
+    std::sort(v1.begin(), v1.end());
+    BOOST_CHECK(v1 == r1);
+    std::sort(v1.begin(), v1.end(), [](int a, int b) { return to_string(a) > to_string(b); });
+    BOOST_CHECK(v1 == r2);
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_cached_sort_test)
+{
+    auto e1{ range(0, 1000) >> select([](int a) { return aggregate_test_pack{ to_string(a % 97), a % 13 }; }) };
+    auto v1{ e1 >> to_vector<aggregate_test_pack>() };
+    std::stable_sort(v1.begin(), v1.end(), [](const aggregate_test_pack& a, const aggregate_test_pack& b) { return a.score != b.score ? a.score > b.score : a.name + "!" < b.name + "!"; });
+    // The selectors run once for each element.
+    size_t selected{ 0 };
+    auto name{ make_comparer([&](const aggregate_test_pack& p) { ++selected; return p.name + "!"; }, string_ascending<char>{}) };
+    auto score{ make_comparer([](const aggregate_test_pack& p) { return p.score; }, descending{}) };
+    auto r1{ e1 >> sort(score, name) };
+    BOOST_CHECK(v1 == r1);
+    BOOST_CHECK_EQUAL(1000ULL, selected);
+    selected = 0;
+    auto r2{ e1 >> cached_sort(score, name) };
+    BOOST_CHECK(v1 == r2);
+    BOOST_CHECK_EQUAL(1000ULL, selected);
+    int a3[]{ 3, 1, 2 };
+    int a4[]{ 3, 2, 1 };
+    auto r3{ a3 >> cached_sort([](int a, int b) { return b - a; }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, r3);
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_order_by_test)
+{
+    aggregate_test_pack a1[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Jobs", 78 }, { "Gates", 85 } };
+    aggregate_test_pack a2[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Gates", 85 }, { "Jobs", 78 } };
+    // The elements are sorted when they are enumerated.
+    size_t compared{ 0 };
+    auto score{ make_comparer([&](const aggregate_test_pack& p) { ++compared; return p.score; }, descending{}) };
+    auto e1{ a1 >> order_by(score) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e1);
+    auto e2{ range(0, 10000) >> select([](int a) { return (a * 7919) % 10007; }) };
+    compared = 0;
+    auto e3{ e2 >> order_by(make_comparer([&](int a) { ++compared; return a; })) };
+    size_t heapified{ compared };
+    BOOST_CHECK_EQUAL(0, e3 >> front());
+    BOOST_CHECK_LT(compared - heapified, 1000ULL);
+    auto v3{ e3 >> to_vector<int>() };
+    auto s3{ e2 >> sort() };
+    BOOST_CHECK(s3 == v3);
+    int a4[]{ 3, 1, 2 };
+    int a5[]{ 1, 2, 3 };
+    auto e4{ a4 >> order_by() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e4);
+    // The copies of one result could be read on different threads.
+    auto e5{ e2 >> order_by() };
+    vector<int> v5, v6;
+    thread t1{ [&] { v5 = e5 >> to_vector<int>(); } };
+    thread t2{ [&] { v6 = e5 >> to_vector<int>(); } };
+    t1.join();
+    t2.join();
+    BOOST_CHECK(s3 == v5);
+    BOOST_CHECK(s3 == v6);
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_top_k_test)
+{
+    aggregate_test_pack a1[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Jobs", 78 }, { "Gates", 85 }, { "Cook", 60 } };
+    aggregate_test_pack a2[]{ { "Zh.F. Ren", 92 }, { "Trump", 85 }, { "Gates", 85 } };
+    auto score{ make_comparer([](const aggregate_test_pack& p) { return p.score; }, descending{}) };
+    auto e1{ a1 >> top_k(3, score) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e1);
+    // A sort composed with take uses top_k.
+    auto q{ stable_sort(score) >> take(3) };
+    static_assert(is_same_v<decltype(a1 >> q), vector<aggregate_test_pack>>);
+    auto e2{ a1 >> q };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e2);
+    int a3[]{ 5, 3, 8, 1, 9, 2 };
+    int a4[]{ 1, 2, 3 };
+    auto e3{ a3 >> (sort() >> take(3)) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e3);
+    // Without the parentheses, the sort runs at once into a vector, and take reads it.
+    vector<int> v3{ 5, 3, 8, 1, 9, 2 };
+    auto s3{ v3 >> sort() };
+    static_assert(is_same_v<decltype(s3), vector<int>>);
+    v3.clear();
+    auto e6{ s3 >> take(3) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e6);
+    // The unparenthesised form sorts all the elements, while the composed one only keeps the first ones.
+    auto v7{ range(0, 10000) >> select([](int a) { return (a * 7919) % 10007; }) >> to_vector<int>() };
+    size_t compared{ 0 };
+    auto counted{ [&](int a, int b) { ++compared; return a - b; } };
+    auto s7{ v7 >> sort(counted) >> take(10) >> to_vector<int>() };
+    size_t sorted_all{ compared };
+    compared = 0;
+    auto t7{ v7 >> (sort(counted) >> take(10)) };
+    BOOST_CHECK(s7 == t7);
+    BOOST_CHECK_LT(compared * 4, sorted_all);
+    BOOST_CHECK(a3 >> top_k(0) == vector<int>{});
+    auto e4{ a3 >> top_k(10) };
+    auto e5{ a3 >> sort() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(e5, e4);
+}
+
 BOOST_AUTO_TEST_CASE(aggregate_sorter_test)
 {
     list<aggregate_test_pack> a1{ { "Zh.F. Ren", 92 }, { "Jobs", 78 }, { "Trump", 85 }, { "Gates", 85 } };
@@ -218,6 +386,142 @@ BOOST_AUTO_TEST_CASE(set_except_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a3, e);
 }
 
+BOOST_AUTO_TEST_CASE(set_hash_test)
+{
+    int a1[]{ 1, 1, 2, 3, 3, 4, 5, 6 };
+    int a2[]{ 3, 4, 5, 6, 7, 7, 8 };
+    int a3[]{ 1, 2, 3, 4, 5, 6 };
+    auto e1{ a1 >> hash_distinct() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e1);
+    int a4[]{ 1, 2, 3, 4, 5, 6, 7, 8 };
+    auto e2{ a1 >> hash_union_set(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e2);
+    int a5[]{ 3, 4, 5, 6 };
+    auto e3{ a1 >> hash_intersect(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e3);
+    int a6[]{ 1, 2 };
+    auto e4{ a1 >> hash_except(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e4);
+    // The elements generated by a query are copied into the sets.
+    int a7[]{ 0, 1, 2 };
+    auto e5{ range(0, 30) >> select([](int a) { return a % 3; }) >> hash_distinct() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a7, e5);
+    // The int elements are converted to double when they probe a set of doubles.
+    vector<int> v1{ 1, 2, 3, 4 };
+    vector<double> d1{ 1, 2, 5 };
+    int a8[]{ 1, 2 };
+    auto e6{ v1 >> hash_intersect(d1) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a8, e6);
+    int a9[]{ 3, 4 };
+    auto e7{ v1 >> hash_except(d1) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a9, e7);
+}
+
+BOOST_AUTO_TEST_CASE(set_hash_string_test)
+{
+    vector<string> s1{ "apple", "banana", "apple", "cherry", "banana" };
+    vector<string> s2{ "banana", "durian", "cherry" };
+    // The strings are stored by pointers into the vectors.
+    string a1[]{ "apple", "banana", "cherry" };
+    auto e1{ s1 >> hash_distinct() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    string a2[]{ "apple", "banana", "cherry", "durian" };
+    auto e2{ s1 >> hash_union_set(s2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e2);
+    // The string_views probe the set of strings without allocation.
+    vector<string_view> v1{ "cherry", "fig", "banana", "cherry" };
+    string_view a3[]{ "cherry", "banana" };
+    auto e3{ v1 >> hash_intersect(s2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e3);
+    string_view a4[]{ "fig" };
+    auto e4{ v1 >> hash_except(s2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e4);
+    // A temporary second enumerable is owned by the enumerable, and its strings are stored by pointers.
+    auto e5{ v1 >> hash_except(vector<string>{ "fig" }) };
+    string_view a5[]{ "cherry", "banana" };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e5);
+    // An lvalue second enumerable is copied when the query is applied, so it could be changed later.
+    vector<string> s3{ "cherry", "banana" };
+    auto e6{ v1 >> hash_intersect(s3) };
+    auto e7{ v1 >> hash_except(s3) };
+    s3.clear();
+    s3.shrink_to_fit();
+    s3.push_back("fig");
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e6);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e7);
+}
+
+struct key_comparer_first
+{
+    bool operator()(const pair<int, int>& p1, const pair<int, int>& p2) const { return p1.first < p2.first; }
+};
+
+BOOST_AUTO_TEST_CASE(set_sorted_test)
+{
+    int a1[]{ 1, 1, 2, 3, 3, 4, 5, 6 };
+    int a2[]{ 3, 4, 5, 6, 7, 7, 8 };
+    int a3[]{ 1, 2, 3, 4, 5, 6 };
+    auto e1{ a1 >> distinct_sorted() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e1);
+    int a4[]{ 1, 2, 3, 4, 5, 6, 7, 8 };
+    auto e2{ a1 >> union_sorted(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e2);
+    int a5[]{ 3, 4, 5, 6 };
+    auto e3{ a1 >> intersect_sorted(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e3);
+    int a6[]{ 1, 2 };
+    auto e4{ a1 >> except_sorted(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e4);
+    int a7[]{ 7, 8 };
+    auto e5{ a2 >> except_sorted(a1) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a7, e5);
+    // The results are the same as the operators with sets.
+    auto e6{ range(0, 1000) >> select([](int a) { return a / 3; }) };
+    auto e7{ range(0, 1000) >> select([](int a) { return a / 2 + 100; }) };
+    auto v1{ e6 >> union_set(e7) >> to_vector<int>() };
+    auto v2{ e6 >> union_sorted(e7) >> to_vector<int>() };
+    BOOST_CHECK(v1 == v2);
+    auto v3{ e6 >> intersect(e7) >> to_vector<int>() };
+    auto v4{ e6 >> intersect_sorted(e7) >> to_vector<int>() };
+    BOOST_CHECK(v3 == v4);
+    auto v5{ e6 >> except(e7) >> to_vector<int>() };
+    auto v6{ e6 >> except_sorted(e7) >> to_vector<int>() };
+    BOOST_CHECK(v5 == v6);
+    int d1[]{ 5, 3, 3, 1 };
+    int a8[]{ 5, 3, 1 };
+    auto e8{ d1 >> distinct_sorted<std::greater<>>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a8, e8);
+    // The upstream iterators with large states, like the set of hash_distinct, are not copied for each element.
+    vector<int> v7;
+    for (int i = 0; i < 20000; i++) v7.push_back(i / 2);
+    BOOST_CHECK_EQUAL(10000u, v7 >> hash_distinct() >> distinct_sorted() >> count());
+    BOOST_CHECK_EQUAL(10000u, v7 >> hash_distinct() >> union_sorted(v7) >> count());
+    BOOST_CHECK_EQUAL(10000u, v7 >> hash_distinct() >> intersect_sorted(v7) >> count());
+}
+
+BOOST_AUTO_TEST_CASE(set_merge_sorted_test)
+{
+    int a1[]{ 1, 4, 7 };
+    vector<int> a2{ 2, 4, 8, 9 };
+    list<int> a3{ 0, 4, 10 };
+    int a4[]{ 0, 1, 2, 4, 4, 4, 7, 8, 9, 10 };
+    auto e1{ a1 >> merge_sorted(a2, a3) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e1);
+    BOOST_CHECK_EQUAL(10u, e1 >> count());
+    vector<int> empty;
+    auto e2{ empty >> merge_sorted(a2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e2);
+    // The earlier enumerable takes the equivalent elements.
+    pair<int, int> p1[]{ { 1, 0 }, { 2, 0 } }, p2[]{ { 1, 1 }, { 2, 1 } };
+    pair<int, int> a5[]{ { 1, 0 }, { 1, 1 }, { 2, 0 }, { 2, 1 } };
+    auto e3{ p1 >> merge_sorted<key_comparer_first>(p2) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e3);
+    // A temporary enumerable is owned by the merged one.
+    auto e4{ a1 >> merge_sorted(vector<int>{ 0, 3 }) };
+    int a6[]{ 0, 1, 3, 4, 7 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e4);
+}
+
 struct group_test_pack
 {
     int index;
@@ -267,6 +571,34 @@ BOOST_AUTO_TEST_CASE(group_group_method_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
 
+BOOST_AUTO_TEST_CASE(group_hash_group_test)
+{
+    group_test_pack a1[]{ { 2, 88 }, { 1, 92 }, { 2, 78 }, { 1, 66 }, { 3, 85 }, { 3, 61 } };
+    group_test_pack a2[]{ { 2, 83 }, { 1, 79 }, { 3, 73 } };
+    auto e{ a1 >>
+            hash_group([](const group_test_pack& a) { return a.index; },
+                       [](const group_test_pack& a) { return a.score; },
+                       [](int key, auto e) { return group_test_pack{ key, e >> average() }; }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+    auto e2{ range(0, 10000) >> hash_group([](int a) { return a % 1000; }, [](int a) { return a; }, [](int key, auto e) { return pair{ key, e >> to_vector<int>() }; }) };
+    BOOST_CHECK_EQUAL(1000, e2 >> count());
+    BOOST_CHECK(e2 >> all([](const pair<int, vector<int>>& p) { return p.second.size() == 10 && p.second.front() == p.first && p.second.back() == p.first + 9000; }));
+}
+
+BOOST_AUTO_TEST_CASE(group_aggregate_test)
+{
+    group_test_pack a1[]{ { 2, 88 }, { 1, 92 }, { 2, 78 }, { 1, 66 }, { 3, 85 }, { 3, 61 } };
+    pair<int, int> a2[]{ { 2, 166 }, { 1, 158 }, { 3, 146 } };
+    auto e{ a1 >> group_aggregate([](const group_test_pack& a) { return a.index; }, 0, [](int sum, const group_test_pack& a) { return sum + a.score; }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+    pair<int, int> a3[]{ { 2, 88 }, { 1, 92 }, { 3, 85 } };
+    auto e2{ a1 >> group_aggregate([](const group_test_pack& a) { return a.index; }, 0, [](int& m, const group_test_pack& a) { m = std::max(m, a.score); }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e2);
+    auto e3{ range(0, 10000) >> group_aggregate([](int a) { return a % 1000; }, 0LL, [](long long& s, int a) { s += a; }) };
+    BOOST_CHECK_EQUAL(1000, e3.size());
+    BOOST_CHECK(e3 >> all([](const pair<int, long long>& p) { return p.second == p.first * 10 + 45000; }));
+}
+
 BOOST_AUTO_TEST_CASE(group_group_join_test)
 {
     group_test_pack2 a1[]{ { 1, "Gates" }, { 2, "Jobs" }, { 3, "Trump" } };
@@ -297,6 +629,230 @@ BOOST_AUTO_TEST_CASE(group_join_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a3, e);
 }
 
+BOOST_AUTO_TEST_CASE(group_hash_join_test)
+{
+    vector<int> small{ 3, 7, 3, 42 };
+    vector<int> large;
+    for (int i = 0; i < 1000; i++) large.push_back(i % 10);
+    auto keysel{ [](int a) { return a; } };
+    auto rstsel{ [](int a, int b) { return pair{ a, b }; } };
+    // The smaller outer side is hashed first.
+    auto e1{ small >> join(large, keysel, keysel, keysel, rstsel) };
+    auto v1{ e1 >> to_vector<pair<int, int>>() };
+    BOOST_CHECK_EQUAL(300u, v1.size());
+    BOOST_CHECK(std::all_of(v1.begin(), v1.begin() + 100, [](const pair<int, int>& p) { return p.first == 3 && p.second == 3; }));
+    BOOST_CHECK_EQUAL(7, v1[100].first);
+    auto e2{ small >> join<std::less<>>(large, keysel, keysel, keysel, rstsel) };
+    BOOST_CHECK(v1 == (e2 >> to_vector<pair<int, int>>()));
+    auto e3{ large >> join(small, keysel, keysel, keysel, rstsel) };
+    auto e4{ large >> join<std::less<>>(small, keysel, keysel, keysel, rstsel) };
+    auto v3{ e3 >> to_vector<pair<int, int>>() };
+    auto v4{ e4 >> to_vector<pair<int, int>>() };
+    BOOST_CHECK_EQUAL(300u, v3.size());
+    BOOST_CHECK(v3 == v4);
+    auto counts{ small >> group_join(large, keysel, keysel, keysel, [](int a, auto e) { return pair{ a, e >> count() }; }) };
+    pair<int, size_t> a1[]{ { 3, 100 }, { 7, 100 }, { 3, 100 }, { 42, 0 } };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, counts);
+}
+
+BOOST_AUTO_TEST_CASE(group_join_owned_test)
+{
+    vector<int> v1{ 1, 2, 3, 2 };
+    auto keysel{ [](int a) { return a; } };
+    string prefix{ "key" };
+    // The selectors are owned by the enumerable, so they outlive the temporary query.
+    auto v2{ v1 >> join(vector<int>{ 2, 3, 4 }, keysel, keysel, keysel, [prefix](int a, int) { return prefix + to_string(a); }) >> to_vector<string>() };
+    vector<string> a1{ "key2", "key3", "key2" };
+    BOOST_CHECK(a1 == v2);
+    auto c1{ v1 >> group_join(vector<int>{ 2, 3, 4 }, [prefix](int a) { return a + static_cast<int>(prefix.size()) - 3; }, keysel, keysel, [](int, auto e) { return e >> count(); }) >> count() };
+    BOOST_CHECK_EQUAL(4u, c1);
+    // A named enumerable could be enumerated again.
+    auto e{ v1 >> join(vector<int>{ 2, 3, 4 }, keysel, keysel, keysel, [prefix](int a, int) { return prefix + to_string(a); }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e);
+}
+
+BOOST_AUTO_TEST_CASE(group_join_key_type_test)
+{
+    // The outer keys are converted to the type of the inner keys before they are hashed.
+    vector<int> v1{ 1, 2, 3, 5 };
+    vector<double> v2{ 1.0, 2.0, 3.0, 4.0 };
+    auto id{ [](auto a) { return a; } };
+    auto rstsel{ [](int a, double) { return a; } };
+    int a1[]{ 1, 2, 3 };
+    auto e1{ v1 >> join(v2, id, id, id, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    // The outer side is smaller, and its keys filter the inner side.
+    vector<double> v3{ 1.0, 2.0, 3.0, 4.0, 6.0, 7.0 };
+    auto e2{ v1 >> join(v3, id, id, id, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e2);
+    // The keys of an outer stage are selected only when it is probed.
+    int selected{ 0 };
+    auto e4{ v1 >> select(id) >> join(v3, [&](int a) { ++selected; return a; }, id, id, rstsel) >> to_vector<int>() };
+    BOOST_CHECK(vector<int>(std::begin(a1), std::end(a1)) == e4);
+    BOOST_CHECK_EQUAL(4, selected);
+    vector<const char*> v4{ "a", "b", "c" };
+    vector<string> v5{ "b", "c", "d", "e" };
+    auto e3{ v4 >> join(v5, id, id, id, [](const char*, const string& s) { return s; }) };
+    string a2[]{ "b", "c" };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e3);
+}
+
+struct join_test_key
+{
+    int value;
+};
+
+inline bool operator<(const join_test_key& k1, const join_test_key& k2) { return k1.value < k2.value; }
+
+BOOST_AUTO_TEST_CASE(group_join_composite_key_test)
+{
+    vector<pair<int, int>> v1{ { 1, 2 }, { 2, 1 }, { 3, 3 } };
+    vector<pair<int, int>> v2{ { 2, 1 }, { 3, 3 }, { 3, 3 }, { 1, 1 } };
+    auto id{ [](const pair<int, int>& p) { return p; } };
+    auto rstsel{ [](const pair<int, int>& p, const pair<int, int>&) { return p.first; } };
+    // The pairs and tuples are hashed by their elements.
+    int a1[]{ 2, 3, 3 };
+    auto e1{ v1 >> join(v2, id, id, id, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    auto tie{ [](const pair<int, int>& p) { return tuple{ p.first, p.second, to_string(p.first) }; } };
+    auto e2{ v1 >> join(v2, tie, tie, id, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e2);
+    // The keys which could not be hashed are ordered instead.
+    auto key{ [](const pair<int, int>& p) { return join_test_key{ p.first * 10 + p.second }; } };
+    auto e3{ v1 >> join(v2, key, key, id, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e3);
+    size_t a2[]{ 0, 1, 2 };
+    auto e4{ v1 >> group_join(v2, key, key, id, [](const pair<int, int>&, auto e) { return e >> count(); }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e4);
+}
+
+BOOST_AUTO_TEST_CASE(group_partitioned_join_test)
+{
+    vector<int> outer, inner;
+    for (int i = 0; i < 20000; i++) outer.push_back((i * 7919) % 30011);
+    // It is large enough to be partitioned.
+    for (int i = 0; i < 100000; i++) inner.push_back(i % 50000);
+    auto keysel{ [](int a) { return a; } };
+    auto elesel{ [](int a) { return a * 2; } };
+    auto rstsel{ [](int a, int b) { return pair{ a, b }; } };
+    auto e{ outer >> join(inner, keysel, keysel, elesel, rstsel) };
+    auto v1{ e >> to_vector<pair<int, int>>() };
+    auto v2{ outer >> partitioned_join(inner, keysel, keysel, elesel, rstsel) };
+    BOOST_CHECK_EQUAL(40000u, v2.size());
+    std::sort(v1.begin(), v1.end());
+    std::sort(v2.begin(), v2.end());
+    BOOST_CHECK(v1 == v2);
+    vector<int> empty;
+    BOOST_CHECK((empty >> partitioned_join(inner, keysel, keysel, elesel, rstsel)).empty());
+    // The int outer keys are hashed as the double inner keys, and they are in the same partitions.
+    vector<int> outer2;
+    vector<double> inner2;
+    for (int i = 0; i < 100000; i++)
+    {
+        outer2.push_back(i);
+        inner2.push_back(i);
+    }
+    auto id{ [](auto a) { return a; } };
+    auto v3{ outer2 >> partitioned_join(inner2, id, id, id, [](int a, double) { return a; }) };
+    BOOST_CHECK_EQUAL(100000u, v3.size());
+}
+
+BOOST_AUTO_TEST_CASE(group_merge_join_test)
+{
+    group_test_pack2 a1[]{ { 1, "Gates" }, { 2, "Jobs" }, { 2, "Wozniak" }, { 3, "Trump" }, { 5, "Nobody" } };
+    group_test_pack a2[]{ { 0, 10 }, { 1, 92 }, { 1, 66 }, { 2, 88 }, { 3, 85 }, { 3, 61 }, { 4, 50 } };
+    auto keysel{ [](const group_test_pack2& a) { return a.index; } };
+    auto keysel2{ [](const group_test_pack& a) { return a.index; } };
+    auto elesel2{ [](const group_test_pack& a) { return a.score; } };
+    auto rstsel{ [](const group_test_pack2& a, int score) { return group_test_pack3{ a.name, score }; } };
+    auto e1{ a1 >> join(a2, keysel, keysel2, elesel2, rstsel) };
+    auto e2{ a1 >> merge_join(a2, keysel, keysel2, elesel2, rstsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(e1, e2);
+    auto grpsel{ [](const group_test_pack2& a, auto e) { return group_test_pack3{ a.name, e >> sum() }; } };
+    auto e3{ a1 >> group_join(a2, keysel, keysel2, elesel2, grpsel) };
+    auto e4{ a1 >> merge_group_join(a2, keysel, keysel2, elesel2, grpsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(e3, e4);
+    vector<int> d1{ 5, 3, 3, 1 }, d2{ 4, 3, 2, 1, 1 };
+    auto id{ [](int a) { return a; } };
+    auto e5{ d1 >> merge_join<std::greater<>>(d2, id, id, id, [](int a, int b) { return a * 10 + b; }) };
+    int a3[]{ 33, 33, 11, 11 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e5);
+    vector<int> unsorted{ 1, 5, 3, 7 }, keys{ 3, 7 };
+    auto count_merge_join{ [&](const vector<int>& c1, const vector<int>& c2) {
+        auto e{ c1 >> merge_join(c2, id, id, id, [](int a, int b) { return a + b; }) };
+        return e >> count();
+    } };
+    BOOST_CHECK_THROW(count_merge_join(keys, unsorted), not_sorted);
+    BOOST_CHECK_THROW(count_merge_join(d1, d2), not_sorted);
+    // The selectors are owned by the enumerable, and each group owns a copy of the element selector.
+    string prefix{ "key" };
+    vector<int> k1{ 1, 2, 3 }, k2{ 1, 1, 3 };
+    auto elesel3{ [prefix](int b) { return prefix + to_string(b); } };
+    auto v1{ k1 >> merge_join(k2, id, id, elesel3, [](int, string s) { return s; }) >> to_vector<string>() };
+    vector<string> a4{ "key1", "key1", "key3" };
+    BOOST_CHECK(a4 == v1);
+    auto make_groups{ [&] { return k1 >> merge_group_join(k2, id, id, elesel3, [](int, auto e) { return e; }); } };
+    using group_t = decay_t<decltype(*std::begin(make_groups()))>;
+    auto groups{ make_groups() >> to_vector<group_t>() };
+    BOOST_CHECK_EQUAL(3u, groups.size());
+    vector<string> a5{ "key1", "key1" }, a6{ "key3" };
+    BOOST_CHECK(a5 == (groups[0] >> to_vector<string>()));
+    BOOST_CHECK(groups[1] >> empty());
+    BOOST_CHECK(a6 == (groups[2] >> to_vector<string>()));
+}
+
+BOOST_AUTO_TEST_CASE(group_to_lookup_test)
+{
+    group_test_pack2 a1[]{ { 1, "Gates" }, { 2, "Jobs" }, { 3, "Trump" }, { 4, "Nobody" } };
+    group_test_pack a2[]{ { 2, 88 }, { 1, 92 }, { 2, 78 }, { 1, 66 }, { 3, 85 }, { 3, 61 } };
+    auto keysel{ [](const group_test_pack2& a) { return a.index; } };
+    auto keysel2{ [](const group_test_pack& a) { return a.index; } };
+    auto elesel2{ [](const group_test_pack& a) { return a.score; } };
+    auto scores{ a2 >> to_lookup(keysel2, elesel2) };
+    BOOST_CHECK_EQUAL(3u, scores.size());
+    BOOST_CHECK(scores.contains(2));
+    BOOST_CHECK(!scores.contains(4));
+    int a3[]{ 88, 78 };
+    auto g{ scores[2] };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, g);
+    BOOST_CHECK((scores[4] >> count()) == 0);
+    // The lookup is built once, and joined repeatedly.
+    auto rstsel{ [](const group_test_pack2& a, int score) { return group_test_pack3{ a.name, score }; } };
+    for (int i = 0; i < 2; i++)
+    {
+        auto e1{ a1 >> join(a2, keysel, keysel2, elesel2, rstsel) };
+        auto e2{ a1 >> join(scores, keysel, rstsel) };
+        LINQ_CHECK_EQUAL_COLLECTIONS(e1, e2);
+    }
+    auto grpsel{ [](const group_test_pack2& a, auto e) { return group_test_pack3{ a.name, e >> sum() }; } };
+    auto e3{ a1 >> group_join(a2, keysel, keysel2, elesel2, grpsel) };
+    auto e4{ a1 >> group_join(scores, keysel, grpsel) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(e3, e4);
+    auto ids{ range(0, 10) >> to_lookup([](int a) { return a * 2; }) };
+    int a4[]{ 2, 4, 6 };
+    vector<int> v1{ 1, 2, 3, 4, 4, 6 }, v2{ 1, 2, 3, 3, 21 };
+    auto e5{ v1 >> intersect(ids) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e5);
+    int a5[]{ 1, 3, 21 };
+    auto e6{ v2 >> except(ids) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e6);
+    // A temporary lookup is probed by its keys as well.
+    auto e7{ v1 >> intersect(range(0, 10) >> to_lookup([](int a) { return a * 2; })) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, e7);
+    auto e8{ v2 >> hash_except(range(0, 10) >> to_lookup([](int a) { return a * 2; })) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e8);
+    // A lookup of double keys is probed by int keys, which are converted to double.
+    auto halves{ range(0, 10) >> to_lookup([](int a) { return a / 2.0; }) };
+    BOOST_CHECK(halves.contains(2));
+    BOOST_CHECK((halves[3] >> count()) == 1);
+    int a6[]{ 2, 4, 6, 8, 8 };
+    auto e9{ v1 >> join(halves, [](int a) { return a; }, [](int, int b) { return b; }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e9);
+    auto c1{ v1 >> group_join(halves, [](int a) { return a; }, [](int, auto e) { return e >> count(); }) >> sum() };
+    BOOST_CHECK_EQUAL(5u, c1);
+}
+
 BOOST_AUTO_TEST_CASE(to_container_to_list_test)
 {
     int a1[]{ 1, 2, 3, 4, 5, 6 };
@@ -370,3 +926,73 @@ BOOST_AUTO_TEST_CASE(to_container_to_multimap_test)
     auto e{ a1 >> to_multimap<int, int>([](to_container_pack& a) { return a.index; }, [](to_container_pack& a) { return a.score; }) };
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
+
+BOOST_AUTO_TEST_CASE(aggregate_random_access_test)
+{
+    vector<int> v{ 1, 2, 3, 4, 5, 6 };
+    auto e{ v >> select([](int a) { return a * 10; }) };
+    BOOST_CHECK_EQUAL(6ULL, e >> count());
+    BOOST_CHECK_EQUAL(40, e >> get_at(3));
+    BOOST_CHECK_EQUAL(0, e >> get_at(6));
+    BOOST_CHECK_EQUAL(60, e >> back());
+    BOOST_CHECK_EQUAL(50, e >> back([](int a) { return a < 55; }, 0));
+    int a1[]{ 60, 50, 40, 30, 20, 10 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e >> reverse());
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_known_size_test)
+{
+    auto e{ range(0, 100) >> select([](int a) { return a * 2; }) };
+    BOOST_CHECK_EQUAL(100ULL, e >> count());
+    BOOST_CHECK_EQUAL(100ULL, (e >> to_vector<int>()).capacity());
+    BOOST_CHECK_EQUAL(90ULL, (e >> skip(10) >> to_vector<int>()).capacity());
+    BOOST_CHECK_EQUAL(5ULL, (e >> take(5) >> to_vector<int>()).capacity());
+    int a1[]{ 198, 196, 194 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e >> reverse() >> take(3));
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_push_test)
+{
+    int selected{ 0 };
+    auto e{ range(0, 100) >> select([&](int a) { ++selected; return a * 2; }) };
+    BOOST_CHECK(e >> any([](int a) { return a >= 10; }));
+    BOOST_CHECK_EQUAL(6, selected);
+    selected = 0;
+    int a1[]{ 0, 2, 4 };
+    auto v1{ e >> take(3) >> to_vector<int>() };
+    BOOST_CHECK_EQUAL(3, selected);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, v1);
+    BOOST_CHECK_EQUAL(4950, e >> where([](int a) { return a % 4 == 0; }) >> append(50) >> sum());
+    BOOST_CHECK_EQUAL(4ULL, e >> take_while([](int a) { return a < 7; }) >> count());
+    BOOST_CHECK_EQUAL(3ULL, e >> index_of([](int a) { return a == 6; }));
+
+    vector<int> v{ 1, 2, 3, 4, 5, 6 };
+    auto e2{ v >> select([](int a) { return a * 10; }) >> take(4) };
+    BOOST_CHECK_EQUAL(100, e2 >> sum());
+    BOOST_CHECK_EQUAL(20, e2 >> where([](int a) { return a > 10; }) >> front());
+    BOOST_CHECK_EQUAL(62, v >> where([](int a) { return a % 2 == 0; }) >> select_index([](int a, size_t i) { return a * 10 + (int)i; }) >> concat(vector<int>{ 7, 8 }) >> (max)());
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_query_test)
+{
+    // The captures are owned by the query.
+    auto q{ [] {
+        auto pred{ [n = 2](int a) { return a % n == 0; } };
+        return where(pred) >> select([](int a) { return a * a; }) >> take(2);
+    }() };
+    vector<int> v{ 1, 2, 3, 4, 5, 6 };
+    list<int> l{ 6, 7, 8 };
+    int a1[]{ 4, 16 };
+    int a2[]{ 36, 64 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, v >> q);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, l >> q);
+    auto q2{ q >> sum() };
+    BOOST_CHECK_EQUAL(20, v >> q2);
+    BOOST_CHECK_EQUAL(100, l >> q2);
+    BOOST_CHECK_EQUAL(5ULL, v >> (skip(1) >> concat(l) >> where([](int a) { return a > 4; }) >> count()));
+    // A move-only query is moved when applied as a temporary.
+    auto q3{ where([p = make_unique<int>(3)](int a) { return a % *p == 0; }) >> to_vector<int>() };
+    int a3[]{ 3, 6 };
+    auto v3{ v >> std::move(q3) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, v3);
+}
@@ -3,6 +3,12 @@
 #include "test_utility.hpp"
 #include <linq/core.hpp>
 #include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 using namespace std;
@@ -28,12 +34,110 @@ BOOST_AUTO_TEST_CASE(construct_repeat_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
 
+BOOST_AUTO_TEST_CASE(random_access_range_test)
+{
+    auto e1{ range(0, 10, 3) };
+    static_assert(impl::is_iterator_category_v<decltype(std::begin(e1)), random_access_iterator_tag>);
+    BOOST_CHECK_EQUAL(4, std::end(e1) - std::begin(e1));
+    BOOST_CHECK_EQUAL(6, std::begin(e1)[2]);
+    BOOST_CHECK_EQUAL(9, *(std::end(e1) - 1));
+    int a1[]{ 0, 3, 6, 9 };
+    auto v1{ e1 >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, v1);
+    int a2[]{ 3, 4, 5, 6 };
+    auto v2{ range(0, 10) >> skip(3) >> take(4) >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, v2);
+    double a3[]{ 0.0, 0.25, 0.5, 0.75 };
+    auto e3{ range(0.0, 1.0, 0.25) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e3);
+    BOOST_CHECK(range(5, 1) >> to_vector<int>() == vector<int>{});
+    BOOST_CHECK(range(1, 5, -1) >> to_vector<int>() == vector<int>{});
+    // The count of a range over the whole type does not overflow.
+    auto e5{ range(numeric_limits<int>::min(), numeric_limits<int>::max()) };
+    BOOST_CHECK_EQUAL(0xFFFFFFFFULL, *e5.known_size());
+    BOOST_CHECK_EQUAL(numeric_limits<int>::max() - 1, *(std::end(e5) - 1));
+    BOOST_CHECK_EQUAL(-1, std::begin(e5)[0x7FFFFFFF]);
+    auto e6{ range<signed char>(-128, 127, static_cast<signed char>(2)) };
+    BOOST_CHECK_EQUAL(128, std::end(e6) - std::begin(e6));
+    BOOST_CHECK_EQUAL(126, *(std::end(e6) - 1));
+    BOOST_CHECK_THROW(range(0.0, 1e300, 1e-300), length_error);
+
+    auto e4{ repeat(string{ "a" }, 3) };
+    static_assert(impl::is_iterator_category_v<decltype(std::begin(e4)), random_access_iterator_tag>);
+    BOOST_CHECK_EQUAL(3, std::end(e4) - std::begin(e4));
+    BOOST_CHECK_EQUAL("a", std::begin(e4)[1]);
+    auto v4{ e4 >> skip(1) >> to_vector<string>() };
+    BOOST_CHECK(v4 == vector<string>(2, "a"));
+}
+
+BOOST_AUTO_TEST_CASE(sentinel_test)
+{
+    auto e{ range(0, 10, [](int a) { return a + 3; }) };
+    int a1[]{ 0, 3, 6, 9 };
+    vector<int> v;
+    for (auto it{ std::begin(e) }; it != sentinel; ++it)
+        v.push_back(*it);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, v);
+    BOOST_CHECK(std::end(e) == sentinel);
+    BOOST_CHECK(sentinel != std::begin(range(0, 10)));
+    BOOST_CHECK(sentinel == std::end(range(0, 10)));
+}
+
+#ifdef __cpp_lib_ranges
+BOOST_AUTO_TEST_CASE(std_ranges_test)
+{
+    list<int> l{ 1, 2, 3, 4 };
+    auto e1{ l >> where([](int a) { return a % 2 == 0; }) };
+    static_assert(ranges::view<decltype(e1)> && ranges::bidirectional_range<decltype(e1)>);
+    auto e2{ range(0, 4) >> select([](int a) { return a * 2; }) };
+    static_assert(ranges::view<decltype(e2)> && ranges::random_access_range<decltype(e2)> && ranges::sized_range<decltype(e2)>);
+    auto e3{ range(0, 10, [](int a) { return a + 3; }) };
+    static_assert(ranges::view<decltype(e3)> && ranges::input_range<decltype(e3)> && !ranges::sized_range<decltype(e3)>);
+
+    int a1[]{ 6, 4 };
+    auto v1{ (e2 | views::reverse | views::take(2)) >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, v1);
+    vector<int> v2;
+    ranges::copy(e3, back_inserter(v2));
+    int a2[]{ 0, 3, 6, 9 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, v2);
+    BOOST_CHECK_EQUAL(2, ranges::distance(ranges::subrange(std::begin(e1), sentinel)));
+
+    vector<int> v3{ 4, 1, 3, 2 };
+    ranges::sort(v3 >> skip(1));
+    int a3[]{ 4, 1, 2, 3 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, v3);
+}
+#endif // __cpp_lib_ranges
+
 BOOST_AUTO_TEST_CASE(calculate_concat_test)
 {
     int a1[]{ 1, 2, 3, 4, 5, 6 };
     int a2[]{ 1, 3, 5, 2, 4, 6 };
     auto e{ a1 >> where([](int a) { return a % 2 != 0; }) >> concat(a1 >> where([](int a) { return a % 2 == 0; })) };
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+
+    vector<int> v1{ 1, 2 }, v2{}, v3{ 3 };
+    list<int> l{ 4, 5 };
+    int a3[]{ 1, 2, 3, 4, 5, 6, 7 };
+    auto e3{ v1 >> concat(v2, v3, l, range(6, 8)) };
+    // The size of the list is not kept.
+    BOOST_CHECK(!e3.known_size());
+    BOOST_CHECK_EQUAL(5ULL, *(v1 >> concat(v2, v3, range(6, 8))).known_size());
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, e3);
+    auto v4{ e3 >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, v4);
+    // The nested segments are flattened when copying.
+    auto v5{ v2 >> concat(v1 >> concat(v3), l >> concat(v2)) >> concat(range(6, 8)) >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a3, v5);
+    BOOST_CHECK(v2 >> concat(v2, v2) >> to_vector<int>() == vector<int>{});
+    // A temporary container is owned by the enumerable.
+    auto e6{ v1 >> concat(vector<int>{ 3, 4 }, list<int>{ 5 }) };
+    int a6[]{ 1, 2, 3, 4, 5 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e6);
+    BOOST_CHECK_EQUAL(5ULL, *e6.known_size());
+    auto v6{ e6 >> to_vector<int>() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, v6);
 }
 
 BOOST_AUTO_TEST_CASE(calculate_pend_test)
@@ -43,3 +147,50 @@ BOOST_AUTO_TEST_CASE(calculate_pend_test)
     auto e{ a1 >> prepend(1) >> append(6) };
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
+
+BOOST_AUTO_TEST_CASE(iterator_copy_test)
+{
+    int a1[]{ 1, 2, 3, 4, 5, 6 };
+    int a2[]{ 2, 4, 6 };
+    auto e{ a1 >> where([](int a) { return a % 2 == 0; }) };
+    auto it{ std::begin(e) };
+    auto it2{ it };
+    ++it;
+    BOOST_CHECK_EQUAL(2, *it2);
+    BOOST_CHECK_EQUAL(4, *it);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+}
+
+BOOST_AUTO_TEST_CASE(iterator_move_only_test)
+{
+    int a1[]{ 1, 2, 3, 4, 5, 6 };
+    int a2[]{ 3, 6 };
+    auto e{ a1 >> where([p = make_unique<int>(3)](int a) { return a % *p == 0; }) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
+}
+
+BOOST_AUTO_TEST_CASE(calculate_pend_select_test)
+{
+    vector<int> v{ 2, 3, 4, 5 };
+    int a1[]{ 1, 4, 6, 8, 10, 12 };
+    auto e{ v >> select([](int a) { return a * 2; }) >> prepend(1) >> append(12) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e);
+}
+
+BOOST_AUTO_TEST_CASE(known_size_test)
+{
+    vector<int> v{ 1, 2, 3 };
+    BOOST_CHECK_EQUAL(10ULL, *(range(0, 10) >> select([](int a) { return a * 2; })).known_size());
+    BOOST_CHECK_EQUAL(4ULL, *range(0, 10, 3).known_size());
+    BOOST_CHECK_EQUAL(5ULL, *repeat(1, 5).known_size());
+    BOOST_CHECK_EQUAL(8ULL, *(v >> concat(range(0, 5))).known_size());
+    BOOST_CHECK_EQUAL(5ULL, *(v >> append(4) >> prepend(0)).known_size());
+    BOOST_CHECK(!(v >> where([](int a) { return a > 1; })).known_size());
+    // The size of a node-based container is not kept, because it may grow without invalidating the iterators.
+    list<int> l{ 1, 2, 3 };
+    auto e{ l >> select([](int a) { return a * 2; }) };
+    l.push_back(4);
+    BOOST_CHECK(!e.known_size());
+    BOOST_CHECK_EQUAL(4, std::distance(std::begin(e), std::end(e)));
+}
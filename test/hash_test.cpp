@@ -0,0 +1,71 @@
+#define BOOST_TEST_MODULE HashTest
+
+#include "test_utility.hpp"
+#include <cctype>
+#include <linq/hash.hpp>
+#include <string>
+#include <string_view>
+
+using namespace std;
+using namespace linq;
+
+BOOST_AUTO_TEST_CASE(flat_hash_index_test)
+{
+    impl::flat_hash_index<int> index;
+    for (int i = 0; i < 10000; i++)
+    {
+        // The multiples of a power of 2 are spread over the slots.
+        auto [id, inserted] = index.insert(i * 1024);
+        BOOST_CHECK_EQUAL(static_cast<size_t>(i), id);
+        BOOST_CHECK(inserted);
+    }
+    BOOST_CHECK_EQUAL(10000ULL, index.size());
+    BOOST_CHECK_EQUAL(42ULL, index.find(42 * 1024));
+    BOOST_CHECK_EQUAL(42ULL, index.insert(42 * 1024).first);
+    BOOST_CHECK(!index.insert(42 * 1024).second);
+    BOOST_CHECK_EQUAL(index.npos, index.find(1));
+    BOOST_CHECK_EQUAL(impl::flat_hash_index<int>::npos, impl::flat_hash_index<int>{}.find(0));
+}
+
+BOOST_AUTO_TEST_CASE(flat_hash_index_heterogeneous_test)
+{
+    impl::flat_hash_index<string> index;
+    index.insert("apple"s);
+    index.insert("banana"s);
+    BOOST_CHECK_EQUAL(1ULL, index.find("banana"sv));
+    BOOST_CHECK_EQUAL(index.npos, index.find("cherry"sv));
+}
+
+struct hash_test_case_hash
+{
+    size_t operator()(const string& s) const
+    {
+        size_t h = 0;
+        for (char c : s)
+            h = h * 31 + static_cast<size_t>(tolower(static_cast<unsigned char>(c)));
+        return h;
+    }
+};
+
+struct hash_test_case_equal
+{
+    bool operator()(const string& a, const string& b) const
+    {
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return tolower(static_cast<unsigned char>(x)) == tolower(static_cast<unsigned char>(y)); });
+    }
+};
+
+BOOST_AUTO_TEST_CASE(flat_lookup_test)
+{
+    string a[]{ "Apple", "banana", "APPLE", "Banana", "cherry", "apple" };
+    auto keysel = [](const string& s) { return s; };
+    auto elesel = [](const string& s) { return s.size(); };
+    impl::flat_lookup<string, size_t, hash_test_case_hash, hash_test_case_equal> lookup{ begin(a), end(a), keysel, elesel };
+    BOOST_CHECK_EQUAL(3ULL, lookup.size());
+    BOOST_CHECK_EQUAL("Apple", lookup.key(0));
+    BOOST_CHECK_EQUAL(3ULL, lookup.group(0).known_size().value());
+    BOOST_CHECK_EQUAL(1ULL, lookup.find("BANANA"s));
+    size_t sizes[]{ 6, 6 };
+    auto g{ lookup.group(1) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(sizes, g);
+}
@@ -0,0 +1,256 @@
+#define BOOST_TEST_MODULE ParallelTest
+
+#include "test_utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <linq/aggregate.hpp>
+#include <linq/parallel.hpp>
+#include <linq/query.hpp>
+#include <linq/to_container.hpp>
+#include <list>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace linq;
+
+BOOST_AUTO_TEST_CASE(split_test)
+{
+    vector<int> v(100);
+    iota(v.begin(), v.end(), 0);
+    auto e1{ v >> where([](int a) { return a % 2 == 0; }) >> select([](int a) { return a * 3; }) };
+    static_assert(impl::is_splittable_v<decltype(std::begin(e1))>);
+    auto e2{ v >> parallel(4, 10) };
+    BOOST_CHECK_EQUAL(10ULL, e2.split().size());
+    auto e3{ e1 >> parallel(2, 10) };
+    auto chunks{ e3.split() };
+    BOOST_CHECK_EQUAL(8ULL, chunks.size());
+    vector<int> result;
+    for (auto& [begin, end] : chunks)
+    {
+        // The chunks are unseeked until the thread which runs them seeks them.
+        impl::iterable_access::seek_first(begin);
+        result.insert(result.end(), begin, end);
+    }
+    auto expected{ e1 >> to_vector<int>() };
+    BOOST_CHECK(result == expected);
+
+    list<int> l{ 1, 2, 3 };
+    auto e4{ l >> where([](int a) { return a > 1; }) };
+    static_assert(!impl::is_splittable_v<decltype(std::begin(e4))>);
+    BOOST_CHECK_EQUAL(1ULL, (l >> parallel()).split().size());
+}
+
+BOOST_AUTO_TEST_CASE(split_unseeked_test)
+{
+    vector<int> v(100000);
+    iota(v.begin(), v.end(), 0);
+    const auto caller{ this_thread::get_id() };
+    atomic<size_t> caller_calls{ 0 };
+    auto rare{ [&](int a) {
+        if (this_thread::get_id() == caller) ++caller_calls;
+        return a % 1000 == 999;
+    } };
+    auto e1{ v >> where(rare) >> parallel(4, 100) };
+    size_t built{ caller_calls.load() };
+    BOOST_CHECK_EQUAL(16ULL, e1.split().size());
+    BOOST_CHECK_EQUAL(built, caller_calls.load());
+    BOOST_CHECK_EQUAL(100ULL, e1 >> count());
+
+    auto e2{ v >> select([](int a) { return a * 2; }) >> where([&](int a) { return rare(a / 2); }) >> select([](int a) { return a + 1; }) >> parallel(4, 100) };
+    built = caller_calls.load();
+    BOOST_CHECK_EQUAL(16ULL, e2.split().size());
+    BOOST_CHECK_EQUAL(built, caller_calls.load());
+    BOOST_CHECK_EQUAL(v >> where(rare) >> select([](int a) { return a * 2 + 1; }) >> sum(), e2 >> sum());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_aggregate_test)
+{
+    vector<long long> v(100000);
+    iota(v.begin(), v.end(), 0LL);
+    auto q{ where([](long long a) { return a % 3 == 0; }) >> select([](long long a) { return a * 2; }) };
+    BOOST_CHECK_EQUAL(v >> q >> sum(), v >> q >> parallel(4, 100) >> sum());
+    BOOST_CHECK_EQUAL(v >> q >> count(), v >> q >> parallel(4, 100) >> count());
+    BOOST_CHECK_EQUAL(14286ULL, v >> parallel(4, 100) >> count([](long long a) { return a % 7 == 0; }));
+    auto mod{ select([](long long a) { return (a * 7919) % 100003; }) };
+    BOOST_CHECK_EQUAL(v >> mod >> (max)(), v >> mod >> parallel(4, 100) >> (max)());
+    BOOST_CHECK_EQUAL(v >> mod >> (min)(), v >> mod >> parallel(4, 100) >> (min)());
+    BOOST_CHECK_EQUAL(-1, v >> mod >> parallel(4, 100) >> (min)(-1));
+    BOOST_CHECK(v >> parallel(4, 100) >> any([](long long a) { return a == 99999; }));
+    BOOST_CHECK(!(v >> parallel(4, 100) >> any([](long long a) { return a < 0; })));
+    BOOST_CHECK(v >> parallel(4, 100) >> all([](long long a) { return a >= 0; }));
+    BOOST_CHECK(!(v >> parallel(4, 100) >> all([](long long a) { return a < 5000; })));
+    auto concat_str{ [](const string& a, const string& b) { return a + b; } };
+    auto s{ range(0, 1000) >> select([](int a) { return to_string(a % 10); }) };
+    BOOST_CHECK_EQUAL(s >> aggregate(string{}, concat_str, concat_str), s >> parallel(4, 10) >> aggregate(string{}, concat_str, concat_str));
+    BOOST_CHECK_EQUAL(0, vector<int>{} >> parallel() >> sum());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_reduce_test)
+{
+    static_assert(alignof(impl::padded_partial<int>) == impl::cache_line_size);
+    vector<double> v(10000);
+    iota(v.begin(), v.end(), 1.0);
+    BOOST_CHECK_EQUAL(5000.5, v >> parallel(4, 100) >> average());
+    auto fold{ [](pair<double, double>& r, double a) {
+        r.first = (min)(r.first, a);
+        r.second = (max)(r.second, a);
+    } };
+    auto combine{ [](const pair<double, double>& a, const pair<double, double>& b) { return pair{ (min)(a.first, b.first), (max)(a.second, b.second) }; } };
+    auto r1{ v >> parallel(4, 100) >> reduce(pair{ 1e9, -1e9 }, fold, combine) };
+    BOOST_CHECK_EQUAL(1.0, r1.first);
+    BOOST_CHECK_EQUAL(10000.0, r1.second);
+    // Once a chunk decides the result, the other chunks stop.
+    atomic<size_t> folded{ 0 };
+    auto r2{ v >> parallel(4, 100) >> reduce(
+                                         false, [&](bool& r, double a) { ++folded; return !(r = a == 1.0); }, logical_or<bool>{}) };
+    BOOST_CHECK(r2);
+    BOOST_CHECK_LT(folded.load(), v.size());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_to_vector_test)
+{
+    vector<int> v(10000);
+    iota(v.begin(), v.end(), 0);
+    auto e1{ v >> where([](int a) { return a % 3 == 0; }) };
+    auto v1{ e1 >> to_vector<int>() };
+    auto p1{ e1 >> parallel(4, 100) >> to_vector<int>() };
+    BOOST_CHECK(v1 == p1);
+    auto e2{ range(0, 10000) >> select([](int a) { return a * 2; }) };
+    auto v2{ e2 >> to_vector<int>() };
+    auto p2{ e2 >> parallel(4, 100) >> to_vector<int>() };
+    BOOST_CHECK(v2 == p2);
+}
+
+struct parallel_test_item
+{
+    explicit parallel_test_item(int value) : value(value) {}
+    int value;
+};
+
+BOOST_AUTO_TEST_CASE(parallel_sort_test)
+{
+    auto e1{ range(0, 100000) >> select([](int a) { return (a * 7919) % 100003; }) };
+    auto v1{ e1 >> sort() };
+    for (size_t threads : { 2, 3, 4, 7 })
+    {
+        auto p1{ e1 >> parallel(threads, 100) >> sort() };
+        BOOST_CHECK(v1 == p1);
+    }
+    // The equivalent elements keep their order.
+    auto e2{ range(0, 10000) >> select([](int a) { return pair{ a % 10, a }; }) };
+    auto key{ make_comparer([](const pair<int, int>& p) { return p.first; }) };
+    auto v2{ e2 >> stable_sort(key) };
+    auto p2{ e2 >> parallel(5, 100) >> stable_sort(key) };
+    BOOST_CHECK(v2 == p2);
+    BOOST_CHECK(is_sorted(p2.begin(), p2.end()));
+    // The elements which could not be default constructed are merged in place.
+    auto e3{ e1 >> select([](int a) { return parallel_test_item{ a }; }) };
+    auto p3{ e3 >> parallel(4, 100) >> sort(make_comparer([](const parallel_test_item& i) { return i.value; }, descending{})) };
+    BOOST_CHECK(is_sorted(p3.rbegin(), p3.rend(), [](const parallel_test_item& a, const parallel_test_item& b) { return a.value < b.value; }));
+    BOOST_CHECK_EQUAL(v1.size(), p3.size());
+    BOOST_CHECK(vector<int>{} == (vector<int>{} >> parallel() >> sort()));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_top_k_test)
+{
+    auto e1{ range(0, 100000) >> select([](int a) { return pair{ (a * 7919) % 1009, a }; }) };
+    auto key{ make_comparer([](const pair<int, int>& p) { return p.first; }, descending{}) };
+    auto v1{ e1 >> stable_sort(key) >> take(500) >> to_vector<pair<int, int>>() };
+    auto p1{ e1 >> parallel(4, 100) >> top_k(500, key) };
+    BOOST_CHECK(v1 == p1);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_group_aggregate_test)
+{
+    auto keysel{ [](int a) { return (a * 7919) % 1009; } };
+    auto fold{ [](long long& s, int a) { s += a; } };
+    auto v1{ range(0, 100000) >> group_aggregate(keysel, 0LL, fold) };
+    auto p1{ range(0, 100000) >> parallel(4, 100) >> group_aggregate(keysel, 0LL, fold, std::plus<long long>{}) };
+    BOOST_CHECK(v1 == p1);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_partitioned_join_test)
+{
+    auto keysel{ [](int a) { return a % 50000; } };
+    auto rstsel{ [](int a, int b) { return pair{ a, b }; } };
+    auto outer{ range(0, 30000) };
+    auto inner{ range(0, 100000) };
+    auto v1{ outer >> partitioned_join(inner, keysel, keysel, keysel, rstsel) };
+    auto p1{ outer >> parallel(4, 100) >> partitioned_join(inner, keysel, keysel, keysel, rstsel) };
+    BOOST_CHECK_EQUAL(60000u, p1.size());
+    BOOST_CHECK(v1 == p1);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_nested_test)
+{
+    vector<int> v(64);
+    iota(v.begin(), v.end(), 0);
+    // The inner queries run on the same pool.
+    auto total{ v >> parallel(0, 1) >> aggregate(
+                                           0LL, [](long long a, int b) { return a + (range(0, b * 100) >> parallel(0, 10) >> count([](int x) { return x >= 0; })); }, std::plus<long long>{}) };
+    BOOST_CHECK_EQUAL(201600LL, total);
+    BOOST_CHECK_THROW(v >> parallel(4, 1) >> all([](int a) -> bool { if (a == 42) throw out_of_range("42"); return true; }), out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(work_deque_test)
+{
+    constexpr int count{ 100000 };
+    vector<int> items(count);
+    impl::work_deque<int> deque{ 4 };
+    vector<atomic<int>> taken(count);
+    atomic<bool> stop{ false };
+    vector<thread> thieves;
+    for (int i = 0; i < 3; i++)
+    {
+        thieves.emplace_back([&] {
+            while (!stop.load())
+            {
+                if (int* item = deque.steal()) ++taken[*item];
+            }
+        });
+    }
+    for (int i = 0; i < count; i++)
+    {
+        items[i] = i;
+        deque.push(&items[i]);
+        if (i % 3 == 0)
+        {
+            if (int* item = deque.pop()) ++taken[*item];
+        }
+    }
+    while (int* item = deque.pop())
+        ++taken[*item];
+    stop = true;
+    for (auto& t : thieves)
+        t.join();
+    BOOST_CHECK(all_of(taken.begin(), taken.end(), [](const atomic<int>& t) { return t.load() == 1; }));
+}
+
+struct counting_executor : executor
+{
+    atomic<size_t> submitted{ 0 };
+
+    void submit(function<void()> task) override
+    {
+        ++submitted;
+        thread{ std::move(task) }.detach();
+    }
+
+    size_t concurrency() const noexcept override { return 3; }
+};
+
+BOOST_AUTO_TEST_CASE(executor_test)
+{
+    auto exec{ make_shared<counting_executor>() };
+    set_executor(exec);
+    BOOST_CHECK_EQUAL(exec, get_executor());
+    BOOST_CHECK_EQUAL(4950, range(0, 100) >> parallel(0, 1) >> sum());
+    BOOST_CHECK_EQUAL(3ULL, exec->submitted.load());
+    set_executor(nullptr);
+    BOOST_CHECK_NE(exec, get_executor());
+    BOOST_CHECK_EQUAL(4950, range(0, 100) >> parallel(0, 1) >> sum());
+    BOOST_CHECK_EQUAL(3ULL, exec->submitted.load());
+}
@@ -3,6 +3,8 @@
 #include "test_utility.hpp"
 #include <cmath>
 #include <linq/query.hpp>
+#include <list>
+#include <vector>
 
 using namespace std;
 using namespace linq;
@@ -63,6 +65,17 @@ BOOST_AUTO_TEST_CASE(where_select_select_many_test)
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
 
+BOOST_AUTO_TEST_CASE(concat_all_test)
+{
+    vector<vector<int>> v{ {}, { 1, 2 }, {}, { 3 }, { 4, 5 }, {} };
+    int a1[]{ 1, 2, 3, 4, 5 };
+    auto e1{ v >> concat_all() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    int a2[]{ 1, 2, 2, 3, 3, 3 };
+    auto e2{ range(0, 4) >> select([](int n) { return vector<int>(n, n); }) >> concat_all() };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e2);
+}
+
 BOOST_AUTO_TEST_CASE(where_select_select_many_index_test)
 {
     pack a1[]{ { 1, 1 }, { 2, 4 }, { 3, 9 } };
@@ -136,3 +149,123 @@ BOOST_AUTO_TEST_CASE(linear_zip_index_test)
     auto e{ a1 >> zip_index([](int i1, int i2, size_t index) { return (int)(i1 + i2 * index); }, v) };
     LINQ_CHECK_EQUAL_COLLECTIONS(a2, e);
 }
+
+template <typename Container>
+using category_of = typename iterator_traits<decltype(std::begin(declval<Container&>()))>::iterator_category;
+
+BOOST_AUTO_TEST_CASE(category_random_access_test)
+{
+    vector<int> v{ 1, 2, 3, 4, 5, 6 };
+    auto e{ v >> select([](int a) { return a * a; }) >> skip(1) >> take(4) };
+    static_assert(is_same_v<category_of<decltype(e)>, random_access_iterator_tag>);
+    auto begin{ std::begin(e) };
+    auto end{ std::end(e) };
+    BOOST_CHECK_EQUAL(4, end - begin);
+    BOOST_CHECK_EQUAL(16, begin[2]);
+    BOOST_CHECK_EQUAL(25, *(end - 1));
+    BOOST_CHECK(begin < end);
+    BOOST_CHECK(!(end <= begin));
+    int a1[]{ 25, 16, 9, 4 };
+    auto r{ make_reverse_iterator(end) };
+    BOOST_CHECK_EQUAL_COLLECTIONS(std::begin(a1), std::end(a1), r, make_reverse_iterator(begin));
+}
+
+BOOST_AUTO_TEST_CASE(category_zip_test)
+{
+    vector<int> v1{ 1, 2, 3, 4, 5, 6 };
+    int a1[]{ 10, 20, 30, 40 };
+    auto e{ v1 >> zip_index([](int i1, int i2, size_t i) { return i1 + i2 + (int)i; }, a1) };
+    static_assert(is_same_v<category_of<decltype(e)>, random_access_iterator_tag>);
+    BOOST_CHECK_EQUAL(4, std::end(e) - std::begin(e));
+    BOOST_CHECK_EQUAL(47, *(std::end(e) - 1));
+    BOOST_CHECK_EQUAL(23, std::begin(e)[1]);
+}
+
+BOOST_AUTO_TEST_CASE(category_where_test)
+{
+    list<int> l{ 1, 2, 3, 4, 5, 6 };
+    auto e{ l >> where([](int a) { return a % 2 == 0; }) };
+    static_assert(is_same_v<category_of<decltype(e)>, bidirectional_iterator_tag>);
+    int a1[]{ 6, 4, 2 };
+    auto end{ std::end(e) };
+    BOOST_CHECK_EQUAL(6, *--end);
+    BOOST_CHECK_EQUAL(4, *--end);
+    auto e2{ l >> take(3) };
+    static_assert(is_same_v<category_of<decltype(e2)>, input_iterator_tag>);
+    BOOST_CHECK_EQUAL_COLLECTIONS(std::begin(a1), std::end(a1), make_reverse_iterator(std::end(e)), make_reverse_iterator(std::begin(e)));
+}
+
+BOOST_AUTO_TEST_CASE(category_arrow_test)
+{
+    vector<pack> v{ { { 1, 2 } }, { { 3, 4 } } };
+    auto e1{ v >> where([](const pack& p) { return p.arr[0] > 1; }) };
+    BOOST_CHECK_EQUAL(4, std::begin(e1)->arr[1]);
+    // The selected values are held by the pointers.
+    auto e2{ v >> select([](const pack& p) { return pack{ { p.arr[1], p.arr[0] } }; }) };
+    auto it{ std::begin(e2) };
+    BOOST_CHECK_EQUAL(1, it->arr[1]);
+    BOOST_CHECK_EQUAL(3, (++it)->arr[1]);
+    // The iterators convert to bool implicitly.
+    bool valid = ++it;
+    BOOST_CHECK(!valid);
+    static_assert(noexcept(static_cast<bool>(it)));
+}
+
+BOOST_AUTO_TEST_CASE(select_once_test)
+{
+    vector<int> v{ 1, 2, 3, 4 };
+    list<int> l{ 1, 2, 3, 4 };
+    int selected{ 0 };
+    auto f{ [&](int a) { ++selected; return a * a; } };
+    auto p{ [](int a) { return a > 1; } };
+    int a1[]{ 4, 9, 16 };
+    auto e1{ v >> select(f) >> where(p) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    BOOST_CHECK_EQUAL(4, selected);
+    selected = 0;
+    auto e2{ l >> select(f) >> take(4) >> where(p) };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e2);
+    BOOST_CHECK_EQUAL(4, selected);
+    selected = 0;
+    auto e3{ l >> select(f) };
+    int a2[]{ 16, 9, 4, 1 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(std::begin(a2), std::end(a2), make_reverse_iterator(std::end(e3)), make_reverse_iterator(std::begin(e3)));
+    BOOST_CHECK_EQUAL(4, selected);
+}
+
+BOOST_AUTO_TEST_CASE(fusion_test)
+{
+    vector<int> v{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    using It = vector<int>::iterator;
+    auto p1{ [](int a) { return a % 2 == 0; } };
+    auto p2{ [](int a) { return a % 3 == 0; } };
+    auto f1{ [](int a) { return a * 10; } };
+    auto f2{ [](int a) { return a + 1; } };
+    auto e1{ v >> where(p1) >> where(p2) };
+    static_assert(is_same_v<decltype(e1), impl::iterable<impl::where_iterator<It, impl::and_pred<decltype(p1), decltype(p2)>>>>);
+    int a1[]{ 6, 12 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a1, e1);
+    auto e2{ v >> select(f1) >> select(f2) };
+    static_assert(is_same_v<decltype(e2), impl::iterable<impl::select_iterator<It, impl::compose_selector<decltype(f1), decltype(f2)>>>>);
+    BOOST_CHECK_EQUAL(12ULL, *e2.known_size());
+    BOOST_CHECK_EQUAL(121, *(std::end(e2) - 1));
+    auto e3{ v >> where(p1) >> where(p2) >> select(f1) >> select(f2) };
+    static_assert(is_same_v<decltype(e3), impl::iterable<impl::where_select_iterator<It, impl::and_pred<decltype(p1), decltype(p2)>, impl::compose_selector<decltype(f1), decltype(f2)>>>>);
+    int a2[]{ 61, 121 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a2, e3);
+    int a3[]{ 121, 61 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(std::begin(a3), std::end(a3), make_reverse_iterator(std::end(e3)), make_reverse_iterator(std::begin(e3)));
+    // The end of a subrange is kept after fusion.
+    int a4[]{ 11, 21, 31 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a4, v >> select(f1) >> take(3) >> select(f2));
+    auto e4{ range(0, 100, f2) >> take(10) >> take(5) };
+    static_assert(is_same_v<decltype(e4), decltype(range(0, 100, f2) >> take(10))>);
+    int a5[]{ 0, 1, 2, 3, 4 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a5, e4);
+    auto e5{ v >> select(f1) >> where(p1) >> where(p2) };
+    static_assert(is_same_v<decltype(e5), impl::iterable<impl::select_where_iterator<It, decltype(f1), impl::and_pred<decltype(p1), decltype(p2)>>>>);
+    int a6[]{ 30, 60, 90, 120 };
+    LINQ_CHECK_EQUAL_COLLECTIONS(a6, e5);
+    int a7[]{ 120, 90, 60, 30 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(std::begin(a7), std::end(a7), make_reverse_iterator(std::end(e5)), make_reverse_iterator(std::begin(e5)));
+}